@@ -0,0 +1,575 @@
+/******************************************************************************/
+/**
+@file		bench_tefs.c
+@author     Wade Penson
+@date		October, 2026
+@brief      Benchmarks for the block and stdio interfaces of TEFS.
+@details	Every benchmark formats the device first and uses a fixed seed for
+			its random pages, so runs on the same device are comparable. Each
+			one reports the operations per second, the bytes per second, the
+			latency percentiles of a single operation and the number of
+			device reads, writes and flushes it took.
+
+@copyright  Copyright 2015 Wade Penson
+
+@license    Licensed under the Apache License, Version 2.0 (the "License");
+            you may not use this file except in compliance with the License.
+            You may obtain a copy of the License at
+
+              http://www.apache.org/licenses/LICENSE-2.0
+
+            Unless required by applicable law or agreed to in writing, software
+            distributed under the License is distributed on an "AS IS" BASIS,
+            WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+            implied. See the License for the specific language governing
+            permissions and limitations under the License.
+*/
+/******************************************************************************/
+
+#if !defined(ARDUINO)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#define CHIP_SELECT_PIN 4
+
+#include "../src/tefs/tefs.h"
+#include "../src/tefs_stdio/tefs_stdio.h"
+
+#if defined(TEFS_DEVICE_BACKEND)
+#include "../src/tefs_mmap/tefs_mmap.h"
+#endif
+
+#if !defined(ARDUINO)
+#include <time.h>
+#endif
+
+/* The format that the benchmarks of the page interface run on. */
+#define BENCH_NUM_PAGES				62500
+#define BENCH_PAGE_SIZE				512
+#define BENCH_BLOCK_SIZE			8
+#define BENCH_HASH_SIZE				4
+#define BENCH_META_DATA_SIZE		32
+#define BENCH_MAX_FILE_NAME_SIZE	12
+
+/* The file storms run on smaller blocks so that 10k files fit on the
+   device. */
+#define BENCH_STORM_BLOCK_SIZE		2
+
+/* The number of pages in the file of the page benchmarks. */
+#define BENCH_FILE_PAGES			1024
+/* The number of records and the size of a record for t_fwrite(). */
+#define BENCH_RECORDS				10000
+#define BENCH_RECORD_SIZE			16
+/* The number of lookups of the last file in the directory. */
+#define BENCH_LOOKUPS				100
+/* The max number of latencies that are kept for the percentiles. */
+#define BENCH_MAX_SAMPLES			10000
+
+#if defined(TEFS_DEVICE_BACKEND)
+/* The image file that the benchmarks are run on. */
+#define BENCH_IMAGE_PATH			"tefs_bench.img"
+#endif
+
+/* The results of the benchmark that is running. */
+typedef struct bench
+{
+	const char	*name;
+	uint32_t	number_of_ops;
+	uint32_t	number_of_bytes;
+	uint64_t	start_time;
+	uint64_t	op_start_time;
+	uint32_t	samples[BENCH_MAX_SAMPLES];
+	uint32_t	number_of_samples;
+	uint32_t	start_reads;
+	uint32_t	start_writes;
+	uint32_t	start_flushes;
+} bench_t;
+
+static bench_t	bench;
+static uint8_t	page[BENCH_PAGE_SIZE];
+static uint32_t random_state;
+
+/* The device operations that have been done. They are counted for a device
+   backend (otherwise they are taken from tefs_get_stats() if TEFS_STATS is
+   defined). */
+static uint32_t device_reads;
+static uint32_t device_writes;
+static uint32_t device_flushes;
+
+#if defined(TEFS_DEVICE_BACKEND)
+static tefs_mmap_device_t mmap_device;
+
+/* The functions of the memory mapped device that the counting functions
+   call. */
+static int8_t (*mmap_read_pages)(tefs_device_t *device, uint32_t page, uint32_t number_of_pages, void *buffer);
+static int8_t (*mmap_write_pages)(tefs_device_t *device, uint32_t page, uint32_t number_of_pages, void *data);
+static int8_t (*mmap_flush)(tefs_device_t *device);
+
+static int8_t
+counting_read_pages(
+	tefs_device_t	*device,
+	uint32_t		page_address,
+	uint32_t		number_of_pages,
+	void			*buffer
+)
+{
+	device_reads++;
+	return mmap_read_pages(device, page_address, number_of_pages, buffer);
+}
+
+static int8_t
+counting_write_pages(
+	tefs_device_t	*device,
+	uint32_t		page_address,
+	uint32_t		number_of_pages,
+	void			*data
+)
+{
+	device_writes++;
+	return mmap_write_pages(device, page_address, number_of_pages, data);
+}
+
+static int8_t
+counting_flush(
+	tefs_device_t *device
+)
+{
+	device_flushes++;
+	return mmap_flush(device);
+}
+#endif
+
+/* Updates the number of device operations that have been done. */
+static void
+bench_count_device_ops(
+	void
+)
+{
+#if !defined(TEFS_DEVICE_BACKEND) && defined(TEFS_STATS)
+	tefs_stats_t stats;
+	uint8_t region;
+
+	tefs_get_stats(&stats);
+
+	device_reads = 0;
+	device_writes = 0;
+	device_flushes = stats.device_flushes;
+
+	for (region = 0; region < TEFS_NUMBER_OF_REGIONS; region++)
+	{
+		device_reads += stats.device_reads[region];
+		device_writes += stats.device_writes[region];
+	}
+#endif
+}
+
+/* Gets the time in nanoseconds. */
+static uint64_t
+bench_time(
+	void
+)
+{
+#if defined(ARDUINO)
+	return (uint64_t) micros() * 1000;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#endif
+}
+
+/* A linear congruential generator so that every run uses the same pages. */
+static uint32_t
+bench_random(
+	void
+)
+{
+	random_state = random_state * 1103515245 + 12345;
+
+	return random_state >> 8;
+}
+
+static void
+bench_format(
+	uint16_t block_size
+)
+{
+	if (tefs_format_device(BENCH_NUM_PAGES, BENCH_PAGE_SIZE, block_size, BENCH_HASH_SIZE, BENCH_META_DATA_SIZE,
+						   BENCH_MAX_FILE_NAME_SIZE, 0))
+	{
+		printf("Format failed.\n");
+		exit(-1);
+	}
+
+	random_state = 1;
+}
+
+static void
+bench_start(
+	const char *name
+)
+{
+	bench.name				= name;
+	bench.number_of_ops		= 0;
+	bench.number_of_bytes	= 0;
+	bench.number_of_samples	= 0;
+
+	bench_count_device_ops();
+	bench.start_reads		= device_reads;
+	bench.start_writes		= device_writes;
+	bench.start_flushes		= device_flushes;
+	bench.start_time		= bench_time();
+}
+
+static void
+bench_op_start(
+	void
+)
+{
+	bench.op_start_time = bench_time();
+}
+
+static void
+bench_op_end(
+	uint32_t	number_of_bytes,
+	int8_t		response
+)
+{
+	uint64_t op_time = bench_time() - bench.op_start_time;
+
+	if (response)
+	{
+		printf("%s failed with error %d.\n", bench.name, response);
+		exit(-1);
+	}
+
+	if (bench.number_of_samples < BENCH_MAX_SAMPLES)
+	{
+		bench.samples[bench.number_of_samples++] = (uint32_t) op_time;
+	}
+
+	bench.number_of_ops++;
+	bench.number_of_bytes += number_of_bytes;
+}
+
+static int
+compare_samples(
+	const void *a,
+	const void *b
+)
+{
+	uint32_t first = *(const uint32_t *) a;
+	uint32_t second = *(const uint32_t *) b;
+
+	return (first > second) - (first < second);
+}
+
+/* Gets a percentile of the latencies in microseconds. */
+static double
+bench_percentile(
+	uint32_t percent
+)
+{
+	if (bench.number_of_samples == 0)
+	{
+		return 0;
+	}
+
+	uint32_t index = (bench.number_of_samples * percent) / 100;
+
+	if (index >= bench.number_of_samples)
+	{
+		index = bench.number_of_samples - 1;
+	}
+
+	return bench.samples[index] / 1000.0;
+}
+
+static void
+bench_end(
+	void
+)
+{
+	double seconds = (bench_time() - bench.start_time) / 1e9;
+
+	qsort(bench.samples, bench.number_of_samples, sizeof(uint32_t), compare_samples);
+
+	printf("%-24s %8lu %11.0f %9.2f %9.2f %9.2f %9.2f %10.2f",
+		   bench.name,
+		   (unsigned long) bench.number_of_ops,
+		   bench.number_of_ops / seconds,
+		   bench.number_of_bytes / seconds / 1e6,
+		   bench_percentile(50),
+		   bench_percentile(90),
+		   bench_percentile(99),
+		   bench_percentile(100));
+
+#if defined(TEFS_DEVICE_BACKEND) || defined(TEFS_STATS)
+	bench_count_device_ops();
+	printf(" %8lu %8lu %8lu\n",
+		   (unsigned long) (device_reads - bench.start_reads),
+		   (unsigned long) (device_writes - bench.start_writes),
+		   (unsigned long) (device_flushes - bench.start_flushes));
+#else
+	printf(" %8s %8s %8s\n", "-", "-", "-");
+#endif
+}
+
+static void
+bench_pages(
+	void
+)
+{
+	file_t file;
+	uint32_t i;
+
+	bench_format(BENCH_BLOCK_SIZE);
+
+	if (tefs_open(&file, "pages"))
+	{
+		printf("Open failed.\n");
+		exit(-1);
+	}
+
+	bench_start("seq page write");
+
+	for (i = 0; i < BENCH_FILE_PAGES; i++)
+	{
+		page[0] = (uint8_t) i;
+		bench_op_start();
+		bench_op_end(BENCH_PAGE_SIZE, tefs_write(&file, i, page, BENCH_PAGE_SIZE, 0));
+	}
+
+	bench_op_start();
+	bench_op_end(0, tefs_flush(&file));
+	bench_end();
+
+	bench_start("seq page read");
+
+	for (i = 0; i < BENCH_FILE_PAGES; i++)
+	{
+		bench_op_start();
+		bench_op_end(BENCH_PAGE_SIZE, tefs_read(&file, i, page, BENCH_PAGE_SIZE, 0));
+	}
+
+	bench_end();
+
+	bench_start("rand page write");
+
+	for (i = 0; i < BENCH_FILE_PAGES; i++)
+	{
+		uint32_t file_page = bench_random() % BENCH_FILE_PAGES;
+
+		page[0] = (uint8_t) file_page;
+		bench_op_start();
+		bench_op_end(BENCH_PAGE_SIZE, tefs_write(&file, file_page, page, BENCH_PAGE_SIZE, 0));
+	}
+
+	bench_op_start();
+	bench_op_end(0, tefs_flush(&file));
+	bench_end();
+
+	bench_start("rand page read");
+
+	for (i = 0; i < BENCH_FILE_PAGES; i++)
+	{
+		bench_op_start();
+		bench_op_end(BENCH_PAGE_SIZE, tefs_read(&file, bench_random() % BENCH_FILE_PAGES, page, BENCH_PAGE_SIZE, 0));
+	}
+
+	bench_end();
+
+	bench_start("read_pages");
+	bench_op_start();
+	{
+		uint8_t *pages = malloc((size_t) BENCH_FILE_PAGES * BENCH_PAGE_SIZE);
+
+		if (pages == NULL)
+		{
+			printf("Out of memory.\n");
+			exit(-1);
+		}
+
+		bench_op_end((uint32_t) BENCH_FILE_PAGES * BENCH_PAGE_SIZE, tefs_read_pages(&file, 0, BENCH_FILE_PAGES, pages));
+		free(pages);
+	}
+	bench_end();
+
+	tefs_close(&file);
+}
+
+static void
+bench_records(
+	void
+)
+{
+	uint32_t i;
+
+	bench_format(BENCH_BLOCK_SIZE);
+
+	/* t_fwrite() and t_fread() return the number of bytes. */
+	T_FILE *file = t_fopen("records", "w+");
+
+	if (file == NULL)
+	{
+		printf("Open failed.\n");
+		exit(-1);
+	}
+
+	bench_start("t_fwrite 16B records");
+
+	for (i = 0; i < BENCH_RECORDS; i++)
+	{
+		page[0] = (uint8_t) i;
+		bench_op_start();
+		bench_op_end(BENCH_RECORD_SIZE, t_fwrite(page, BENCH_RECORD_SIZE, 1, file) == BENCH_RECORD_SIZE ? 0 : TEFS_ERR_WRITE);
+	}
+
+	bench_op_start();
+	bench_op_end(0, t_fflush(file) ? TEFS_ERR_WRITE : 0);
+	bench_end();
+
+	t_rewind(file);
+	bench_start("t_fread 16B records");
+
+	for (i = 0; i < BENCH_RECORDS; i++)
+	{
+		bench_op_start();
+		bench_op_end(BENCH_RECORD_SIZE, t_fread(page, BENCH_RECORD_SIZE, 1, file) == BENCH_RECORD_SIZE ? 0 : TEFS_ERR_READ);
+	}
+
+	bench_end();
+
+	t_fclose(file);
+}
+
+static void
+bench_file_storm(
+	uint32_t number_of_files
+)
+{
+	file_t file;
+	char file_name[BENCH_MAX_FILE_NAME_SIZE + 1];
+	char name[32];
+	uint32_t i;
+
+	bench_format(BENCH_STORM_BLOCK_SIZE);
+
+	sprintf(name, "create %lu", (unsigned long) number_of_files);
+	bench_start(name);
+
+	for (i = 0; i < number_of_files; i++)
+	{
+		sprintf(file_name, "f%lu", (unsigned long) i);
+		bench_op_start();
+
+		int8_t response = tefs_open(&file, file_name);
+
+		if (response == TEFS_ERR_OK)
+		{
+			response = tefs_close(&file);
+		}
+
+		bench_op_end(0, response);
+	}
+
+	bench_end();
+
+	sprintf(name, "open %lu", (unsigned long) number_of_files);
+	bench_start(name);
+
+	for (i = 0; i < number_of_files; i++)
+	{
+		sprintf(file_name, "f%lu", (unsigned long) (bench_random() % number_of_files));
+		bench_op_start();
+
+		int8_t response = tefs_open(&file, file_name);
+
+		if (response == TEFS_ERR_OK)
+		{
+			response = tefs_close(&file);
+		}
+
+		bench_op_end(0, response);
+	}
+
+	bench_end();
+
+	/* Look up the file that is at the end of the directory. */
+	sprintf(file_name, "f%lu", (unsigned long) (number_of_files - 1));
+	sprintf(name, "tail lookup %lu", (unsigned long) number_of_files);
+	bench_start(name);
+
+	for (i = 0; i < BENCH_LOOKUPS; i++)
+	{
+		bench_op_start();
+		bench_op_end(0, tefs_exists(file_name) == 1 ? TEFS_ERR_OK : TEFS_ERR_FILE_NOT_FOUND);
+	}
+
+	bench_end();
+
+	sprintf(name, "remove %lu", (unsigned long) number_of_files);
+	bench_start(name);
+
+	for (i = 0; i < number_of_files; i++)
+	{
+		sprintf(file_name, "f%lu", (unsigned long) i);
+		bench_op_start();
+		bench_op_end(0, tefs_remove(file_name));
+	}
+
+	bench_end();
+}
+
+int
+main(
+	void
+)
+{
+#if defined(TEFS_DEVICE_BACKEND)
+	int error = 0;
+
+	if ((error = tefs_mmap_open(&mmap_device, BENCH_IMAGE_PATH, BENCH_NUM_PAGES)))
+	{
+		printf("Image file failed to open. Error code: %i\n", error);
+		return -1;
+	}
+
+	mmap_read_pages = mmap_device.device.read_pages;
+	mmap_write_pages = mmap_device.device.write_pages;
+	mmap_flush = mmap_device.device.flush;
+	mmap_device.device.read_pages = counting_read_pages;
+	mmap_device.device.write_pages = counting_write_pages;
+	mmap_device.device.flush = counting_flush;
+
+	if ((error = tefs_select_device(&mmap_device.device)))
+	{
+		printf("Device failed to be selected. Error code: %i\n", error);
+		return -1;
+	}
+#elif defined(USE_SD)
+	int error = 0;
+
+	if ((error = sd_spi_init(CHIP_SELECT_PIN)))
+	{
+		printf("SD initialization failed. Error code: %i\n", error);
+		return -1;
+	}
+#endif
+
+	printf("%-24s %8s %11s %9s %9s %9s %9s %10s %8s %8s %8s\n", "benchmark", "ops", "ops/s", "MB/s",
+		   "p50 us", "p90 us", "p99 us", "max us", "reads", "writes", "flushes");
+
+	bench_pages();
+	bench_records();
+	bench_file_storm(10);
+	bench_file_storm(1000);
+	bench_file_storm(10000);
+
+#if defined(TEFS_DEVICE_BACKEND)
+	tefs_mmap_close(&mmap_device);
+#endif
+
+	return 0;
+}
@@ -21,53 +21,192 @@
 */
 /******************************************************************************/
 
+#include "../tefs_configuration.h"
+
+#if defined(TEFS_THREAD_SAFE)
+#if !defined(TEFS_LOCK_DEVICE)
+#include <pthread.h>
+/** Serializes the use of the device, the page cache and the volumes. */
+static pthread_mutex_t device_lock						= PTHREAD_MUTEX_INITIALIZER;
+#define TEFS_LOCK_DEVICE()		pthread_mutex_lock(&device_lock)
+#define TEFS_UNLOCK_DEVICE()	pthread_mutex_unlock(&device_lock)
+#if defined(TEFS_ASYNC_QUEUE_SIZE)
+/** Serializes the use of the asynchronous queue. */
+static pthread_mutex_t queue_lock						= PTHREAD_MUTEX_INITIALIZER;
+#define TEFS_LOCK_QUEUE()		pthread_mutex_lock(&queue_lock)
+#define TEFS_UNLOCK_QUEUE()		pthread_mutex_unlock(&queue_lock)
+#endif
+#if !defined(TEFS_THREAD_LOCAL)
+#define TEFS_THREAD_LOCAL		__thread
+#endif
+#endif
+
+/* The functions are implemented without locking under these names (which
+   are also used for the prototypes in tefs.h). The versions at the end of the
+   file take the device lock and call them, so calls between the functions do
+   not lock again. */
+#define tefs_format_device				tefs_format_device_unlocked
+#define tefs_mount						tefs_mount_unlocked
+#define tefs_select_device				tefs_select_device_unlocked
+#define tefs_open						tefs_open_unlocked
+#define tefs_exists						tefs_exists_unlocked
+#define tefs_close						tefs_close_unlocked
+#define tefs_remove						tefs_remove_unlocked
+#define tefs_compact_directory			tefs_compact_directory_unlocked
+#define tefs_idle						tefs_idle_unlocked
+#define tefs_statfs						tefs_statfs_unlocked
+#define tefs_set_allocation_policy		tefs_set_allocation_policy_unlocked
+#define tefs_get_stats					tefs_get_stats_unlocked
+#define tefs_reset_stats				tefs_reset_stats_unlocked
+#define tefs_set_trace_hook				tefs_set_trace_hook_unlocked
+#define tefs_opendir					tefs_opendir_unlocked
+#define tefs_readdir					tefs_readdir_unlocked
+#define tefs_closedir					tefs_closedir_unlocked
+#define tefs_release_block				tefs_release_block_unlocked
+#define tefs_set_consistency			tefs_set_consistency_unlocked
+#define tefs_fallocate					tefs_fallocate_unlocked
+#define tefs_truncate					tefs_truncate_unlocked
+#define tefs_drop_head					tefs_drop_head_unlocked
+#define tefs_write						tefs_write_unlocked
+#define tefs_write_continuous_start		tefs_write_continuous_start_unlocked
+#define tefs_write_continuous_stop		tefs_write_continuous_stop_unlocked
+#define tefs_flush						tefs_flush_unlocked
+#define tefs_read						tefs_read_unlocked
+#define tefs_read_pages					tefs_read_pages_unlocked
+#define tefs_read_continuous_start		tefs_read_continuous_start_unlocked
+#define tefs_read_continuous_stop		tefs_read_continuous_stop_unlocked
+#define tefs_map_page					tefs_map_page_unlocked
+#define tefs_commit_page				tefs_commit_page_unlocked
+#define tefs_unmap_page					tefs_unmap_page_unlocked
+#endif
+
 #include "tefs.h"
 
-#if defined(USE_SD)
-/** Current bit that represents a free block in the state section. */
-static uint32_t state_section_bit					= 0xFFFFFFFF;
-/** The size of the state section. */
-static uint32_t state_section_size					= 0;
-/** Keeps track if the state section is empty or not. */
-static uint8_t	is_block_pool_empty					= 0;
-#endif
-
-/** The number of pages that the device has. */
-static uint32_t number_of_pages						= 0;
-/** The size of a page in bytes. */
-static uint16_t page_size							= 0;
-/** The number of addresses that can fit into a block. */
-static uint32_t addresses_per_block					= 0;
-/** The size of a block in pages. */
-static uint16_t block_size							= 0;
-/** The size of an address in bytes. */
-static uint8_t	address_size						= 0;
-/** The power of 2 exponent for the size of a page (used to improve
-	performance). */
-static uint8_t	page_size_exponent					= 0;
-/** The power of 2 exponent for the number of addresses that can fit into a
-	block (used to improve performance). */
-static uint8_t	addresses_per_block_exponent		= 0;
-/** The power of 2 exponent for the size of a block (used to improve
-	performance). */
-static uint8_t	block_size_exponent					= 0;
-/** The power of 2 exponent for the size of an address (used to improve
-	performance). */
-static uint8_t	address_size_exponent				= 0;
-/**	The size of a hash value. Either 2 or 4 bytes. */
-static uint8_t 	hash_size							= 0;
-/** The size of a metadata entry. */
-static uint16_t metadata_size						= 0;
-/** The max size for a file name. */
-static uint16_t max_file_name_size					= 0;
-/** Metadata entries file used by the directory. */
-static file_t	metadata;
-/** Hash entries file used by the directory. */
-static file_t	hash_entries;
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if !defined(TEFS_THREAD_LOCAL)
+#define TEFS_THREAD_LOCAL
+#endif
+
+#if !defined(TEFS_THREAD_SAFE)
+#define TEFS_LOCK_DEVICE()
+#define TEFS_UNLOCK_DEVICE()
+#define TEFS_LOCK_QUEUE()
+#define TEFS_UNLOCK_QUEUE()
+#endif
+
+/** The volume that is used when no other volume has been selected. */
+static tefs_volume_t default_volume;
+/** The volume that has been selected by tefs_select_volume() (for each thread
+	if TEFS_THREAD_SAFE is defined). */
+static TEFS_THREAD_LOCAL tefs_volume_t *selected_volume	= &default_volume;
+/** The volume that the functions work with. The pages in the device buffer
+	and the page cache belong to it. */
+static tefs_volume_t *volume							= &default_volume;
+
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+/** The pages in the page cache. */
+static uint8_t	page_cache[TEFS_PAGE_CACHE_SIZE][TEFS_PAGE_CACHE_PAGE_SIZE];
+/** The address of the page in each cache slot (0xFFFFFFFF if it is empty). */
+static uint32_t page_cache_address[TEFS_PAGE_CACHE_SIZE];
+/** Keeps track if the page in each slot has been changed since it was read. */
+static uint8_t	page_cache_is_dirty[TEFS_PAGE_CACHE_SIZE];
+/** Keeps track if the page in each slot has been accessed since the clock
+	hand last passed it. */
+static uint8_t	page_cache_is_referenced[TEFS_PAGE_CACHE_SIZE];
+/** The slot that the clock hand is at. */
+static uint8_t	page_cache_hand						= 0;
+/** Keeps track if the page in each slot has been mapped with tefs_map_page()
+	(mapped pages are not replaced). */
+static uint8_t	page_cache_is_mapped[TEFS_PAGE_CACHE_SIZE];
+/** The number of slots that have a mapped page. */
+static uint8_t	page_cache_mapped_count				= 0;
+#endif
+
+#if defined(TEFS_DEVICE_BACKEND)
+/** The page of a device backend that partial pages are read and written
+	through. */
+static uint8_t	device_buffer[TEFS_DEVICE_PAGE_SIZE];
+/** The address of the page in the device buffer (0xFFFFFFFF if it is empty). */
+static uint32_t device_buffer_page					= 0xFFFFFFFF;
+/** The device that the page in the device buffer belongs to. */
+static tefs_device_t *device_buffer_device			= NULL;
+/** Keeps track if the page in the device buffer has been changed since it was
+	read. */
+static uint8_t	device_buffer_is_dirty				= 0;
+/** Set when a page is written without being read into the device buffer
+	first. */
+uint8_t			tefs_device_dirty_write				= 0;
+#endif
+
+#if defined(TEFS_ASYNC_QUEUE_SIZE)
+/** The file of each request in the asynchronous queue. */
+static file_t	*async_file[TEFS_ASYNC_QUEUE_SIZE];
+/** The page in the file of each request. */
+static uint32_t async_page[TEFS_ASYNC_QUEUE_SIZE];
+/** The data that is written or the buffer that is read into for each
+	request. */
+static void		*async_data[TEFS_ASYNC_QUEUE_SIZE];
+/** The number of bytes of each request. */
+static uint16_t async_number_of_bytes[TEFS_ASYNC_QUEUE_SIZE];
+/** The byte in the page where each request starts. */
+static uint16_t async_byte_offset[TEFS_ASYNC_QUEUE_SIZE];
+/** 1 if a request is a write and 0 if it is a read. */
+static uint8_t	async_is_write[TEFS_ASYNC_QUEUE_SIZE];
+/** The state of each slot in the queue (one of the TEFS_ASYNC_* states). */
+static volatile uint8_t async_state[TEFS_ASYNC_QUEUE_SIZE];
+/** The error code of each request that has been carried out. */
+static int8_t	async_response[TEFS_ASYNC_QUEUE_SIZE];
+/** The slot of the next request to carry out. */
+static uint8_t	async_head							= 0;
+/** The slot that the next request is added to. */
+static uint8_t	async_tail							= 0;
+/** Keeps track if a request is being carried out. */
+static volatile uint8_t is_async_processing			= 0;
+
+#define TEFS_ASYNC_FREE			0
+#define TEFS_ASYNC_QUEUED		1
+#define TEFS_ASYNC_COMPLETE		2
+#endif
 
 #if defined(TEFS_CONTINUOUS_SUPPORT)
-/** Determines if continuous writing or reading is in progress. */
+/** Determines if continuous writing (1) or reading (2) is in progress. */
 static uint8_t	is_read_write_continuous			= 0;
+/** Determines if the device is in a sequence for the current data block. */
+static uint8_t	is_continuous_block_open			= 0;
+/** The page in the file that the sequence is at. */
+static uint32_t continuous_page_address				= 0;
+/** The end of the data that has been written to the current page of a
+	continuous write. */
+static uint16_t continuous_page_bytes				= 0;
+#endif
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+/** The region of the page that the next read or write of the device is
+	counted in, if the page is not in the information page or the state
+	section. It is set back to TEFS_REGION_INDEX by each read and write. */
+static uint8_t	device_region						= TEFS_REGION_INDEX;
+#define TEFS_SET_DEVICE_REGION(region)	(device_region = (region))
+#else
+#define TEFS_SET_DEVICE_REGION(region)
+#endif
+
+/* The region of the pages of a file. */
+#define TEFS_FILE_REGION(file) \
+		(((file) == &volume->hash_entries || (file) == &volume->metadata) ? TEFS_REGION_DIRECTORY : TEFS_REGION_DATA)
+
+#if defined(TEFS_STATS)
+#define TEFS_RECORD_LOOKUP(probes)	tefs_record_lookup(probes)
+#else
+#define TEFS_RECORD_LOOKUP(probes)
+#endif
+
+#if defined(TEFS_TRACE) && defined(TEFS_TRACE_MICROSECONDS)
+#define TEFS_TRACE_TIME()	((uint32_t) TEFS_TRACE_MICROSECONDS())
+#else
+#define TEFS_TRACE_TIME()	((uint32_t) 0)
 #endif
 
 /**
@@ -93,15 +232,178 @@ tefs_find_file_directory_entry(
 );
 
 /**
-@brief		Reserves a block and returns the address to the start of the block.
+@brief		Checks if the directory entry with the given index belongs to the
+			file name. If it does and the file is being removed, the hash of the
+			entry is cleared.
+
+@param[in]	file_name			Name of file as char array with null bit.
+@param		entry_number		The index of the entry in the directory.
+@param		file_operation		Same as for tefs_find_file_directory_entry().
+@param[out]	dir_page_address	Page in the metadata file where the metadata entry is.
+@param[out]	dir_byte_in_page	Byte in the page of the file where the metadata entry is.
+
+@return		TEFS_ERR_OK if the entry belongs to the file, TEFS_ERR_FILE_NOT_FOUND
+			if it does not, or another error code as defined by one of the
+			TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_check_directory_entry(
+	char		*file_name,
+	uint32_t	entry_number,
+	uint8_t		file_operation,
+	uint32_t	*dir_page_address,
+	uint16_t	*dir_byte_in_page
+);
+
+/**
+@brief		Compares a file name with the name that is stored in a directory
+			entry.
+
+@param[in]	file_name			Name of file as char array with null bit.
+@param		dir_page_address	Page in the metadata file where the metadata entry is.
+@param		dir_byte_in_page	Byte in the page of the file where the metadata entry is.
+
+@return		TEFS_ERR_OK if the names are the same, TEFS_ERR_FILE_NOT_FOUND if
+			they are not, or another error code as defined by one of the
+			TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_compare_file_name(
+	char		*file_name,
+	uint32_t	dir_page_address,
+	uint16_t	dir_byte_in_page
+);
+
+/**
+@brief		Finds the first hash in a buffer of hashes that is equal to the
+			given hash or, optionally, that is empty.
+
+@param[in]	hashes				A buffer of 2 or 4 byte hashes (as given by the
+								hash size).
+@param		start				The index of the hash to start at.
+@param		number_of_hashes	The number of hashes in the buffer.
+@param		hash				The hash to find.
+@param		find_empty			1 if an empty hash (0) should also be found.
+
+@return		The index of the hash that was found or number_of_hashes if none
+			were found.
+*/
+static uint16_t
+tefs_scan_hashes(
+	void		*hashes,
+	uint16_t	start,
+	uint16_t	number_of_hashes,
+	uint32_t	hash,
+	uint8_t		find_empty
+);
+
+/**
+@brief		Maps the number of an entry in the directory to the location of its
+			hash in the hash entries file and to the location of its metadata
+			entry in the metadata file.
+
+@param		entry_number		The index of the entry in the directory.
+@param[out]	hash_page_address	Page in the hash entries file where the hash is.
+@param[out]	hash_byte_in_page	Byte in the page of the file where the hash is.
+@param[out]	dir_page_address	Page in the metadata file where the metadata entry is.
+@param[out]	dir_byte_in_page	Byte in the page of the file where the metadata entry is.
+*/
+static void
+tefs_map_directory_entry(
+	uint32_t	entry_number,
+	uint16_t	*hash_page_address,
+	uint16_t	*hash_byte_in_page,
+	uint32_t	*dir_page_address,
+	uint16_t	*dir_byte_in_page
+);
+
+#if defined(TEFS_HASH_INDEX_SIZE)
+/**
+@brief	Reads the hash entries file into the in-memory hash index.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_build_hash_index(
+	void
+);
+#endif
+
+/**
+@brief		Reserves up to a number of blocks at once and returns the addresses
+			to the start of the blocks in the order that they are to be used.
+@details	With TEFS_ALLOCATE_LOWEST, a run of free blocks that is long enough
+			for all of the blocks is used if one is known. Otherwise, the blocks
+			are taken from the lowest runs. The other policies search the state
+			section from the allocation cursor or from the block after
+			near_block. The state section is flushed once for all of the
+			blocks.
+
+@param[out]	*block_addresses	Reserved block addresses.
+@param		number_of_blocks	The number of blocks to reserve.
+@param		near_block			The address of a block of the file that the
+								blocks are for or 0 if there is none.
+@param[out]	*number_reserved	The number of blocks that were reserved. This is
+								less than number_of_blocks if the device is
+								almost full.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+			TEFS_ERR_DEVICE_FULL is returned if no blocks could be reserved.
+*/
+static int8_t
+tefs_reserve_device_blocks(
+	uint32_t	*block_addresses,
+	uint8_t		number_of_blocks,
+	uint32_t	near_block,
+	uint8_t		*number_reserved
+);
+
+/**
+@brief		Gets the next block that has been reserved for a file. If there
+			are none left, more blocks are reserved for the file.
+@details	The directory files are never closed, so they only reserve one
+			block at a time.
+
+@param		file			A file_t structure.
+@param[out]	*block_address	Reserved block address.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_reserve_file_block(
+	file_t		*file,
+	uint32_t	*block_address
+);
+
+/**
+@brief	Releases the blocks that have been reserved for a file but have not
+		been used.
+
+@param	file	A file_t structure.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_release_reserved_blocks(
+	file_t *file
+);
+
+/**
+@brief		Releases the data blocks of a file from a block to the last one that
+			has been allocated (including the ones allocated by
+			tefs_fallocate()).
+@details	The child index blocks that start at or after the block are
+			released as well. The index entries are not changed.
 
-@param[out]	*block_address	Reserved block address
+@param		file				A file_t structure.
+@param		number_of_blocks	The number of data blocks that are kept.
 
 @return		An error code as defined by one of the TEFS_ERR_* definitions.
 */
 static int8_t
-tefs_reserve_device_block(
-	uint32_t *block_address
+tefs_release_blocks_past(
+	file_t		*file,
+	uint32_t	number_of_blocks
 );
 
 /**
@@ -117,20 +419,89 @@ tefs_release_device_block(
 );
 
 /**
-@brief	Erases a block and fills it with zeros.
+@brief		Adds a block to the blocks that are waiting to be released.
+@details	The state section is not flushed. tefs_release_queued_blocks
+			must be called once all of the blocks have been queued.
+
+@param		block_address	The address of the block to release.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_queue_block_release(
+	uint32_t block_address
+);
+
+/**
+@brief	Releases the blocks that are waiting to be released and flushes the
+		state section.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_release_queued_blocks(
+	void
+);
+
+/**
+@brief		Releases all of the data and index blocks of a file.
+@details	The addresses in the child index blocks are read in pieces and
+			the state section is flushed once at the end.
+
+@param		root_index_block_address	The root index block address from the
+										directory entry of the file.
+@param		eof_page					The last page of the file.
+@param		eof_byte					The last byte in the last page of the file.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_release_file_blocks(
+	uint32_t	root_index_block_address,
+	uint32_t	eof_page,
+	uint16_t	eof_byte
+);
+
+/**
+@brief	Fills pages on the device with a byte value.
+@details	The pages are written whole with a multi-block write on an SD
+			card (or through a device backend), a buffer at a time, instead of
+			a byte at a time. They are written around the page cache.
+
+@param	start_page		The address of the first page to fill.
+@param	number_of_pages	The number of pages to fill.
+@param	value			The value that every byte is set to.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_fill_pages(
+	uint32_t	start_page,
+	uint32_t	number_of_pages,
+	uint8_t		value
+);
+
+/**
+@brief	Erases a run of blocks and fills them with zeros.
+@details	With TEFS_NATIVE_ERASE, the erase commands of the SD card are
+			used for the whole run.
 
-@param	block_address	The address of the block to erase.
+@param	block_address		The address of the first block to erase.
+@param	number_of_blocks	The number of contiguous blocks to erase.
 
 @return	An error code as defined by one of the TEFS_ERR_* definitions.
 */
 static int8_t
 tefs_erase_block(
-	uint32_t block_address
+	uint32_t block_address,
+	uint32_t number_of_blocks
 );
 
 #if defined(USE_SD)
 /**
 @brief	Finds the next empty block in the block state section.
+@details	The block is taken from the free extent cache. The state
+			section is only scanned if the cache is empty.
 
 @param	*state_section_bit	The bit that represents the next empty block.
 
@@ -140,6 +511,140 @@ static int8_t
 tefs_find_next_empty_block(
 	uint32_t *state_section_bit
 );
+
+/**
+@brief		Scans the state section a word at a time from the scan bit and fills
+			the free extent cache with the free blocks that are found.
+@details	The scan stops after the first piece of a page that has free
+			blocks in it, when the cache is full, or at the end of the state
+			section.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_scan_state_section(
+	void
+);
+
+/**
+@brief	Sets the bits for a run of blocks in the state section. The bytes
+		that hold the bits are read and written once for each page of the
+		state section that they are in. The state section is not flushed.
+
+@param	state_bit	The bit of the first block in the run.
+@param	length		The number of blocks in the run.
+@param	is_free		1 to mark the blocks as free or 0 to mark them as reserved.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_set_state_bits(
+	uint32_t	state_bit,
+	uint32_t	length,
+	uint8_t		is_free
+);
+
+/**
+@brief	Writes out the runs of blocks that are waiting to be released to the
+		state section and adds them to the free extent cache. The state
+		section is not flushed.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_write_released_blocks(
+	void
+);
+
+/**
+@brief	Finds a run of free blocks in the state section from a bit. The
+		search wraps around at the end of the state section and it stops at
+		the first run if is_fit is 0. Otherwise, the first run that is at least
+		number_of_blocks long is used, or the first run if there is no such
+		run within a buffer of the state section after it.
+
+@param	start_bit			The bit to start the search from.
+@param	number_of_blocks	The number of blocks that are needed. Runs that are
+							longer are only measured up to this length.
+@param	is_fit				1 to look for a run with room for all of the blocks.
+@param	*run_start			The bit of the first block in the run.
+@param	*run_length			The number of blocks in the run (0 if there are no
+							free blocks).
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_find_free_run(
+	uint32_t	start_bit,
+	uint32_t	number_of_blocks,
+	uint8_t		is_fit,
+	uint32_t	*run_start,
+	uint32_t	*run_length
+);
+
+/**
+@brief	Removes blocks that have been reserved from the free extent cache. An
+		extent that the blocks split in two needs another slot, so the extent
+		with the highest blocks is dropped (and found again by the next scan)
+		if the cache is full.
+
+@param	state_bit	The bit of the first block.
+@param	length		The number of blocks.
+*/
+static void
+tefs_remove_free_extent(
+	uint32_t state_bit,
+	uint32_t length
+);
+
+/**
+@brief	Adds an extent of free blocks to the free extent cache. It is merged
+		with the extents next to it if they are adjacent.
+
+@param	state_bit	The bit of the first block in the extent.
+@param	length		The number of blocks in the extent.
+
+@return	1 if the extent was added or 0 if the cache is full.
+*/
+static uint8_t
+tefs_add_free_extent(
+	uint32_t state_bit,
+	uint32_t length
+);
+
+/**
+@brief	Counts the number of leading zero bits in a word.
+
+@param	word	A non-zero word.
+
+@return	The number of leading zeros.
+*/
+static uint8_t
+tefs_count_leading_zeros(
+	uint32_t word
+);
+
+/**
+@brief	Writes the free block hint and the number of used blocks out to the
+		information page if they have changed. The state section is flushed
+		first so that they never describe changes that are not on the device.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_write_free_space(
+	void
+);
+
+/**
+@brief	Counts the blocks that are marked as reserved in the state section.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_count_used_blocks(
+	void
+);
 #endif
 
 /**
@@ -177,1846 +682,7218 @@ tefs_map_page_to_child_index_address(
 );
 
 /**
-@brief	Writes out the file size to the directory entry of the file.
+@brief		Finds the data block that has the page in the file. The child
+			index block and data block addresses in the file_t are only read
+			from the device if the page is not in the current data block.
+@details	If the data block is new, it is reserved and added to the child
+			index block instead (along with a new child index block if the
+			data block is the first one that it points to).
 
-@param	file	A file_t structure.
+@param		file				A file_t structure.
+@param		file_page_address	The address of the logical page in the file.
+@param		is_new_block		1 if the data block has not been allocated yet.
 
-@return	An error code as defined by one of the TEFS_ERR_* definitions.
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
 */
 static int8_t
-tefs_update_file_size(
-	file_t *file
+tefs_find_data_block(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint8_t		is_new_block
 );
 
 /**
-@brief	Finds the bit position from the right for a number that is of power 2.
+@brief		Counts the data blocks that hold the data of a file (a file
+			always has at least one).
 
-@param	number	A number that is a power of 2.
+@param		eof_page	The last page of the file.
+@param		eof_byte	The last byte in the last page of the file.
 
-@return	The bit position.
+@return		The number of data blocks up to the end of the file.
 */
-static uint8_t
-tefs_power_of_two_exponent(
-	uint32_t number
+static uint32_t
+tefs_count_file_blocks(
+	uint32_t	eof_page,
+	uint16_t	eof_byte
 );
 
 /**
-@brief	Gets the data from the information section of the card and loads it into memory.
+@brief		Makes the data block with the end of a file the current data block
+			after blocks of the file have been released.
 
-@return	An error code as defined by one of the TEFS_ERR_* definitions.
+@param		file	A file_t structure.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
 */
 static int8_t
-tefs_load_card_data(
-	void
+tefs_find_last_data_block(
+	file_t *file
 );
 
 /**
-@brief	DJB2a hash function that hashes strings.
+@brief		Finds the first data block of a file that has not been released by
+			tefs_drop_head() when the file is opened.
+@details	The released blocks at the start of the file are skipped a child
+			index block at a time where possible. If every block up to the end
+			of the file has been released (the size that was written out can be
+			older than the drop), the end of the file is moved to the start of
+			the block after them so that the file is empty.
 
-@param	*str	A string with a null byte at the end.
+@param		file	A file_t structure.
 
-@return	The hash of the string.
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
 */
-static uint32_t
-hash_string(
-	char *str
+static int8_t
+tefs_find_first_data_block(
+	file_t *file
 );
 
-int8_t
-tefs_format_device(
-	uint32_t 	num_pages,
-	uint16_t 	physical_page_size,
-	uint16_t 	logical_block_size,
-	uint8_t		hash_size,
-	uint16_t	metadata_size,
-	uint16_t 	max_file_name_size,
-	uint8_t		erase_before_format
-)
-{
-	if (erase_before_format)
-	{
-#if defined(USE_SD)
-        /* Erase the storage device before formatting. */
-		if (sd_spi_erase_all())
-		{
-			return TEFS_ERR_ERASE;
-		}
-#endif
-        /* TODO: Add erase for dataflash */
-	}
+#if defined(TEFS_EXTENT_SUPPORT)
+/**
+@brief		Grows the extent of a file until it has a data block or the run of
+			contiguous data blocks ends.
+@details	The addresses after the extent are read from the child index
+			blocks in pieces of up to TEFS_SCAN_BUFFER_SIZE bytes. Blocks that
+			have not been allocated yet are left for when they are added.
 
-	/* Determine the size of an address. */
-	if (num_pages < POW_2_TO(16))
-	{
-		address_size = 2;
-		address_size_exponent = 1;
-	}
-	else
-	{
-		address_size = 4;
-		address_size_exponent = 2;
-	}
+@param		file			A file_t structure.
+@param		block_number	The data block in the file.
 
-	page_size = physical_page_size;
-	block_size = logical_block_size;
-	page_size_exponent = tefs_power_of_two_exponent(physical_page_size);
-	block_size_exponent = tefs_power_of_two_exponent(logical_block_size);
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_extend_extent(
+	file_t		*file,
+	uint32_t	block_number
+);
+#endif
+
+/**
+@brief		Reserves the root index block of a file when the file grows past
+			the pages that a single child index block can point to. The
+			current child index block becomes the first one in the root index.
+
+@param		file	A file_t structure.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_create_root_index(
+	file_t *file
+);
+
+#if defined(TEFS_INDEX_CACHE_SIZE)
+/**
+@brief		Reads or writes an address in a child index page through the index
+			cache of the file. The part of the page that has the address is
+			read into the cache first if it is not already there.
+@details	The addresses of the hash entries and metadata files are written
+			through to the device straight away.
+
+@param		file				A file_t structure.
+@param		index_page			The device page in the child index block.
+@param		byte_in_index_page	The byte in the page where the address is.
+@param[in,out]	address			The address that is read or written.
+@param		is_write			1 to write the address and 0 to read it.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_access_index_cache(
+	file_t		*file,
+	uint32_t	index_page,
+	uint16_t	byte_in_index_page,
+	uint32_t	*address,
+	uint8_t		is_write
+);
+
+/**
+@brief		Writes out the addresses in the index cache of the file that have
+			not been written to the device yet.
+
+@param		file	A file_t structure.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_write_index_cache(
+	file_t *file
+);
+#endif
+
+#if defined(TEFS_CONTINUOUS_SUPPORT)
+/**
+@brief		Starts a sequence on the device for the rest of the data block
+			that has the current page of a continuous write or read.
+@details	A sequence never goes past the end of a data block since the
+			index blocks can only be accessed once it has been stopped.
+
+@param		file	A file_t structure.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_open_continuous_block(
+	file_t *file
+);
+
+/**
+@brief		Writes out the current page of a continuous write and advances to
+			the next page. The file size is updated and the sequence is
+			stopped at the end of a data block.
+
+@param		file	A file_t structure.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_write_continuous_page(
+	file_t *file
+);
+#endif
+
+/**
+@brief	Moves the end of the file past the bytes that were written to its last
+		page. A root index block is created if the file grows past the pages
+		that a single child index block can address.
+
+@param	file		A file_t structure.
+@param	end_byte	The byte after the last byte that was written to the page.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_extend_file(
+	file_t		*file,
+	uint16_t	end_byte
+);
+
+/**
+@brief	Writes out the file size to the directory entry of the file.
+
+@param	file	A file_t structure.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_update_file_size(
+	file_t *file
+);
+
+/**
+@brief	Writes out the file size after a write if the consistency policy of
+		the file requires it.
+
+@param	file				A file_t structure.
+@param	file_page_address	The page in the file that was written to.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_apply_consistency_policy(
+	file_t		*file,
+	uint32_t	file_page_address
+);
+
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+/**
+@brief		Finds the slot in the page cache that has the page. If the page is
+			not cached, a slot is freed with the clock algorithm (writing out
+			its page if it has been changed) and the page is read into it.
+
+@param		page		The address of the page on the device.
+@param		is_new_page	1 if the page does not need to be read from the card.
+@param[out]	slot		The slot that has the page.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_cache_load_page(
+	uint32_t	page,
+	uint8_t		is_new_page,
+	uint8_t		*slot
+);
+
+/**
+@brief		Writes out the page in a slot of the page cache if it has been
+			changed.
+
+@param		slot	The slot in the page cache.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_cache_write_page(
+	uint8_t slot
+);
+
+/**
+@brief		Removes the pages in a range from the page cache without writing
+			them out. This is used when the pages are written on the card
+			directly.
+
+@param		start_page	The first page in the range.
+@param		end_page	The page after the last page in the range.
+*/
+static void
+tefs_cache_invalidate(
+	uint32_t	start_page,
+	uint32_t	end_page
+);
+
+/**
+@brief		Finds the slot in the page cache that a page of the file has been
+			mapped to.
+
+@param		file				A file_t structure.
+@param		file_page_address	The address of the logical page in the file.
+@param[out]	slot				The slot that has the page.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_cache_find_mapped_page(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint8_t		*slot
+);
+#endif
+
+#if defined(TEFS_ASYNC_QUEUE_SIZE)
+/**
+@brief		Adds a request to the end of the asynchronous queue.
+
+@param		file				A file_t structure.
+@param		file_page_address	The address of the logical page in the file.
+@param		data				The data to write or the buffer to read into.
+@param		number_of_bytes		The number of bytes to write or read.
+@param		byte_offset			The byte offset of where to start in the page.
+@param		is_write			1 for a write and 0 for a read.
+@param[out]	request				The request that was added.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_queue_async(
+	file_t		*file,
+	uint32_t	file_page_address,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset,
+	uint8_t		is_write,
+	uint8_t		*request
+);
+#endif
+
+/**
+@brief	Finds the bit position from the right for a number that is of power 2.
+
+@param	number	A number that is a power of 2.
+
+@return	The bit position.
+*/
+static uint8_t
+tefs_power_of_two_exponent(
+	uint32_t number
+);
+
+/**
+@brief	Gets the data from the information section of the card and loads it into memory.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_load_card_data(
+	void
+);
+
+/**
+@brief	Makes a volume the one that the functions work with. The buffer of the
+		device and the page cache are written out first since their pages
+		belong to the previous volume.
+
+@param	new_volume	The volume to switch to.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_use_volume(
+	tefs_volume_t *new_volume
+);
+
+#if defined(TEFS_DEVICE_BACKEND)
+/**
+@brief	Gets the device that the current volume is stored on.
+
+@return	The device or NULL if no device has been set.
+*/
+static tefs_device_t *
+tefs_current_device(
+	void
+);
+
+/**
+@brief	Puts a page of the current device into the device buffer. The page
+		that was in the buffer is written out first if it has been changed.
+
+@param	page		The address of the page on the device.
+@param	is_read		1 if the page is read from the device or 0 if the buffer is
+					filled with zeros instead.
+
+@return	An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+static int8_t
+tefs_device_load_page(
+	uint32_t	page,
+	uint8_t		is_read
+);
+#endif
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+/**
+@brief	Counts an operation on the device for the current volume and passes it
+		to the trace hook of the volume.
+
+@param	operation		One of the TEFS_TRACE_* definitions.
+@param	region			The region of the page if it is not in the information
+						page or the state section (one of TEFS_REGION_*).
+@param	page			The address of the page on the device.
+@param	number_of_bytes	The number of bytes that were read or written.
+@param	response		The error code of the operation.
+@param	start_time		TEFS_TRACE_TIME() from before the operation.
+*/
+static void
+tefs_record_device_op(
+	uint8_t		operation,
+	uint8_t		region,
+	uint32_t	page,
+	uint32_t	number_of_bytes,
+	int8_t		response,
+	uint32_t	start_time
+);
+#endif
+
+#if defined(TEFS_STATS)
+/**
+@brief	Counts a directory lookup of a file name for the current volume.
+
+@param	probes	The number of hash entries that the lookup looked at.
+*/
+static void
+tefs_record_lookup(
+	uint32_t probes
+);
+#endif
+
+/**
+@brief	DJB2a hash function that hashes strings.
+
+@param	*str	A string with a null byte at the end.
+
+@return	The hash of the string.
+*/
+static uint32_t
+hash_string(
+	char *str
+);
+
+#if defined(TEFS_OPEN_CACHE_SIZE)
+/**
+@brief	Finds a file in the open cache by its name.
+
+@param	*file_name	The name of the file.
+@param	name_hash	The hash of the name.
+
+@return	The slot of the file or TEFS_OPEN_CACHE_SIZE if it is not in the cache.
+*/
+static uint8_t
+tefs_open_cache_find(
+	char		*file_name,
+	uint32_t	name_hash
+);
+
+/**
+@brief	Adds a file that has just been opened to the open cache. The least
+		recently used file that is closed is replaced if the cache is full.
+		The file is not added if every file in the cache is open.
+
+@param	*file		A file_t structure of the opened file.
+@param	*file_name	The name of the file.
+@param	name_hash	The hash of the name.
+*/
+static void
+tefs_open_cache_insert(
+	file_t		*file,
+	char		*file_name,
+	uint32_t	name_hash
+);
+
+/**
+@brief	Finds the slot of a file in the open cache from its directory entry.
+
+@param	*file	A file_t structure of an open file.
+
+@return	The slot of the file or TEFS_OPEN_CACHE_SIZE if it is not in the cache.
+*/
+static uint8_t
+tefs_open_cache_find_open(
+	file_t *file
+);
+
+/**
+@brief	Removes every file from the open cache of the volume.
+*/
+static void
+tefs_open_cache_clear(
+	void
+);
+#endif
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+int8_t
+tefs_stats_write(
+	uint32_t	page,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+)
+{
+	uint8_t region = device_region;
+	device_region = TEFS_REGION_INDEX;
+
+#if defined(TEFS_STATS) && defined(USE_SD) && !defined(TEFS_PAGE_CACHE_SIZE)
+	if (device_is_page_buffered(page))
+	{
+		volume->stats.buffer_hits++;
+	}
+	else
+	{
+		volume->stats.buffer_misses++;
+	}
+#endif
+
+	uint32_t start_time = TEFS_TRACE_TIME();
+	int8_t response = device_base_write(page, data, number_of_bytes, byte_offset);
+
+	tefs_record_device_op(TEFS_TRACE_WRITE, region, page, number_of_bytes, response, start_time);
+
+	return response;
+}
+
+int8_t
+tefs_stats_read(
+	uint32_t	page,
+	void		*buffer,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+)
+{
+	uint8_t region = device_region;
+	device_region = TEFS_REGION_INDEX;
+
+#if defined(TEFS_STATS) && defined(USE_SD) && !defined(TEFS_PAGE_CACHE_SIZE)
+	if (device_is_page_buffered(page))
+	{
+		volume->stats.buffer_hits++;
+	}
+	else
+	{
+		volume->stats.buffer_misses++;
+	}
+#endif
+
+	uint32_t start_time = TEFS_TRACE_TIME();
+	int8_t response = device_base_read(page, buffer, number_of_bytes, byte_offset);
+
+	tefs_record_device_op(TEFS_TRACE_READ, region, page, number_of_bytes, response, start_time);
+
+	return response;
+}
+
+int8_t
+tefs_stats_flush(
+	void
+)
+{
+	uint32_t start_time = TEFS_TRACE_TIME();
+	int8_t response = device_base_flush();
+
+	tefs_record_device_op(TEFS_TRACE_FLUSH, TEFS_REGION_INFO, 0, 0, response, start_time);
+
+	return response;
+}
+
+static void
+tefs_record_device_op(
+	uint8_t		operation,
+	uint8_t		region,
+	uint32_t	page,
+	uint32_t	number_of_bytes,
+	int8_t		response,
+	uint32_t	start_time
+)
+{
+	if (operation != TEFS_TRACE_FLUSH)
+	{
+		if (page < TEFS_INFO_SECTION_SIZE)
+		{
+			region = TEFS_REGION_INFO;
+		}
+#if defined(USE_SD)
+		else if (page < TEFS_INFO_SECTION_SIZE + volume->state_section_size)
+		{
+			region = TEFS_REGION_STATE;
+		}
+#endif
+	}
+
+#if defined(TEFS_STATS)
+	if (operation == TEFS_TRACE_READ)
+	{
+		volume->stats.device_reads[region]++;
+	}
+	else if (operation == TEFS_TRACE_WRITE)
+	{
+		volume->stats.device_writes[region]++;
+	}
+	else
+	{
+		volume->stats.device_flushes++;
+	}
+#endif
+
+#if defined(TEFS_TRACE)
+	if (volume->trace_hook != NULL)
+	{
+		volume->trace_hook(operation, region, page, number_of_bytes, response, TEFS_TRACE_TIME() - start_time);
+	}
+#else
+	(void) number_of_bytes;
+	(void) response;
+	(void) start_time;
+#endif
+}
+#endif
+
+#if defined(TEFS_STATS)
+static void
+tefs_record_lookup(
+	uint32_t probes
+)
+{
+	volume->stats.lookups++;
+	volume->stats.lookup_probes += probes;
+
+	if (probes > volume->stats.lookup_max_probes)
+	{
+		volume->stats.lookup_max_probes = probes;
+	}
+}
+#endif
+
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+int8_t
+tefs_cache_write(
+	uint32_t	page,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+)
+{
+	/* The cache is not used before the device has been formatted or if the
+	   pages do not fit in it. */
+	if (volume->page_size == 0 || volume->page_size > TEFS_PAGE_CACHE_PAGE_SIZE)
+	{
+		return device_raw_write(page, data, number_of_bytes, byte_offset);
+	}
+
+	int8_t response;
+	uint8_t slot;
+
+	if ((response = tefs_cache_load_page(page, sd_spi_dirty_write, &slot)))
+	{
+		return response;
+	}
+
+	memcpy(page_cache[slot] + byte_offset, data, number_of_bytes);
+	page_cache_is_dirty[slot] = 1;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_cache_read(
+	uint32_t	page,
+	void		*buffer,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+)
+{
+	if (volume->page_size == 0 || volume->page_size > TEFS_PAGE_CACHE_PAGE_SIZE)
+	{
+		return device_raw_read(page, buffer, number_of_bytes, byte_offset);
+	}
+
+	int8_t response;
+	uint8_t slot;
+
+	if ((response = tefs_cache_load_page(page, 0, &slot)))
+	{
+		return response;
+	}
+
+	memcpy(buffer, page_cache[slot] + byte_offset, number_of_bytes);
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_cache_flush(
+	void
+)
+{
+	int8_t response;
+	uint8_t slot;
+
+	for (slot = 0; slot < TEFS_PAGE_CACHE_SIZE; slot++)
+	{
+		if ((response = tefs_cache_write_page(slot)))
+		{
+			return response;
+		}
+	}
+
+	if (device_raw_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	return TEFS_ERR_OK;
+}
+#endif
+
+#if defined(TEFS_DEVICE_BACKEND)
+int8_t
+tefs_device_write(
+	uint32_t	page,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+)
+{
+	tefs_device_t *device = tefs_current_device();
+
+	if (device == NULL)
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	/* A whole page does not need to go through the buffer. */
+	if (number_of_bytes == TEFS_DEVICE_PAGE_SIZE && tefs_device_buffered_page() != page)
+	{
+		if (device->write_pages(device, page, 1, data))
+		{
+			return TEFS_ERR_WRITE;
+		}
+
+		return TEFS_ERR_OK;
+	}
+
+	int8_t response;
+	if ((response = tefs_device_load_page(page, !tefs_device_dirty_write)))
+	{
+		return response;
+	}
+
+	memcpy(device_buffer + byte_offset, data, number_of_bytes);
+	device_buffer_is_dirty = 1;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_device_read(
+	uint32_t	page,
+	void		*buffer,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+)
+{
+	tefs_device_t *device = tefs_current_device();
+
+	if (device == NULL)
+	{
+		return TEFS_ERR_READ;
+	}
+
+	if (number_of_bytes == TEFS_DEVICE_PAGE_SIZE && tefs_device_buffered_page() != page)
+	{
+		if (device->read_pages(device, page, 1, buffer))
+		{
+			return TEFS_ERR_READ;
+		}
+
+		return TEFS_ERR_OK;
+	}
+
+	int8_t response;
+	if ((response = tefs_device_load_page(page, 1)))
+	{
+		return response;
+	}
+
+	memcpy(buffer, device_buffer + byte_offset, number_of_bytes);
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_device_flush(
+	void
+)
+{
+	if (device_buffer_is_dirty)
+	{
+		if (device_buffer_device->write_pages(device_buffer_device, device_buffer_page, 1, device_buffer))
+		{
+			return TEFS_ERR_WRITE;
+		}
+
+		device_buffer_is_dirty = 0;
+	}
+
+	/* The device of the buffer is flushed when there is one since the volume
+	   that it was loaded for may be switched away from (and no longer be in
+	   memory). */
+	tefs_device_t *device = device_buffer_device;
+
+	if (device == NULL)
+	{
+		device = tefs_current_device();
+	}
+
+	if (device != NULL && device->flush != NULL && device->flush(device))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_device_erase(
+	uint32_t start_page,
+	uint32_t end_page
+)
+{
+	tefs_device_t *device = tefs_current_device();
+
+	if (device == NULL)
+	{
+		return TEFS_ERR_ERASE;
+	}
+
+	if (end_page >= device->number_of_pages)
+	{
+		end_page = device->number_of_pages - 1;
+	}
+
+	/* The buffered page is dropped if it is erased. */
+	if (device_buffer_device == device && device_buffer_page >= start_page && device_buffer_page <= end_page)
+	{
+		device_buffer_page = 0xFFFFFFFF;
+		device_buffer_is_dirty = 0;
+	}
+
+	if (device->erase_range != NULL)
+	{
+		if (device->erase_range(device, start_page, end_page))
+		{
+			return TEFS_ERR_ERASE;
+		}
+
+		return TEFS_ERR_OK;
+	}
+
+	/* Write zeros from the buffer instead. It is empty afterwards. */
+	int8_t response;
+	if ((response = tefs_device_flush()))
+	{
+		return response;
+	}
+
+	memset(device_buffer, 0, TEFS_DEVICE_PAGE_SIZE);
+	device_buffer_page = 0xFFFFFFFF;
+
+	for (; start_page <= end_page; start_page++)
+	{
+		if (device->write_pages(device, start_page, 1, device_buffer))
+		{
+			return TEFS_ERR_ERASE;
+		}
+	}
+
+	return TEFS_ERR_OK;
+}
+
+uint32_t
+tefs_device_buffered_page(
+	void
+)
+{
+	if (device_buffer_device != tefs_current_device())
+	{
+		return 0xFFFFFFFF;
+	}
+
+	return device_buffer_page;
+}
+#endif
+
+int8_t
+tefs_select_volume(
+	tefs_volume_t *new_volume
+)
+{
+	selected_volume = (new_volume == NULL) ? &default_volume : new_volume;
+
+	return TEFS_ERR_OK;
+}
+
+#if defined(TEFS_DEVICE_BACKEND)
+int8_t
+tefs_select_device(
+	tefs_device_t *device
+)
+{
+	/* Write out the pages of the device that the volume was on. */
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+#if defined(TEFS_PAGE_CACHE_SIZE)
+	tefs_cache_invalidate(0, 0xFFFFFFFF);
+#endif
+
+	device_buffer_page = 0xFFFFFFFF;
+	device_buffer_device = NULL;
+
+	selected_volume->device = device;
+	selected_volume->address_size = 0;
+
+	return TEFS_ERR_OK;
+}
+#endif
+
+int8_t
+tefs_format_device(
+	uint32_t 	num_pages,
+	uint16_t 	physical_page_size,
+	uint16_t 	logical_block_size,
+	uint8_t		hash_size,
+	uint16_t	metadata_size,
+	uint16_t 	max_file_name_size,
+	uint8_t		erase_before_format
+)
+{
+	/* Switch to the volume that has been selected. */
+	if (selected_volume != volume && tefs_use_volume(selected_volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+#if defined(TEFS_DEVICE_BACKEND)
+	/* Pages are accessed through a buffer of the page size of the backend. */
+	if (physical_page_size != TEFS_DEVICE_PAGE_SIZE)
+	{
+		return TEFS_ERR_PAGE_SIZE;
+	}
+#endif
+
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+	/* The cached pages belong to the previous format. */
+	tefs_cache_invalidate(0, 0xFFFFFFFF);
+#endif
+
+	if (erase_before_format)
+	{
+#if defined(USE_SD)
+        /* Erase the storage device before formatting. */
+		if (device_raw_erase_all())
+		{
+			return TEFS_ERR_ERASE;
+		}
+#endif
+        /* TODO: Add erase for dataflash */
+	}
+
+	/* Determine the size of an address. */
+	if (num_pages < POW_2_TO(16))
+	{
+		volume->address_size = 2;
+		volume->address_size_exponent = 1;
+	}
+	else
+	{
+		volume->address_size = 4;
+		volume->address_size_exponent = 2;
+	}
+
+	volume->page_size = physical_page_size;
+	volume->block_size = logical_block_size;
+	volume->page_size_exponent = tefs_power_of_two_exponent(physical_page_size);
+	volume->block_size_exponent = tefs_power_of_two_exponent(logical_block_size);
+
+#if defined(USE_SD)
+	/* Calculate the state section size. */
+	/* TODO: Get the number of bits instead of bytes */
+	//uint32_t state_section_size_in_bits = ((format_info->number_of_pages - info_section_size) - 1) / (format_info->block_size) + 1;
+	uint32_t state_section_size_in_bytes =
+		DIV_BY_POW_2_EXP(num_pages - TEFS_INFO_SECTION_SIZE, volume->block_size_exponent + 3);
+
+	volume->state_section_size = DIV_BY_POW_2_EXP(state_section_size_in_bytes - 1, volume->page_size_exponent) + 1;
+#endif
+
+#if defined(USE_DATAFLASH) && defined(USE_FTL)
+	/* Reserve the pages required for the info page, and directory. */
+	uint32_t i;
+	for (i = 0; i < TEFS_INFO_SECTION_SIZE + directory_size; i++)
+	{
+		flare_logical_page_t p;
+		flare_GetPage(&ftl, &p);
+	}
+#endif
+
+	/* Fill the info page with zeros first. */
+	if (tefs_fill_pages(0, TEFS_INFO_SECTION_SIZE, 0))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	uint16_t current_byte = 0;
+	uint8_t data = TEFS_CHECK_FLAG;
+
+	/* Write the check flag. */
+	for (current_byte = 0; current_byte < 4; current_byte++)
+	{
+		if (device_write(0, &data, 1, current_byte))
+		{
+			return TEFS_ERR_WRITE;
+		}
+	}
+
+	/* Write the number of pages that the device has. */
+	if (device_write(0, &num_pages, 4, current_byte))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	current_byte += 4;
+
+	/* Write the physical page size. */
+	if (device_write(0, &volume->page_size_exponent, 1, current_byte))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	current_byte += 1;
+
+	/* Write the block size. */
+	if (device_write(0, &volume->block_size_exponent, 1, current_byte))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	current_byte += 1;
+
+	/* Write the address size. */
+	if (device_write(0, &volume->address_size_exponent, 1, current_byte))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	current_byte += 1;
+
+	/* Write the size of a hash value. */
+	if (device_write(0, &hash_size, 1, current_byte))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	current_byte += 1;
+
+	/* Write the size of a metadata record. */
+	if (device_write(0, &metadata_size, 2, current_byte))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	current_byte += 2;
+
+	/* Write the max size for a file name. */
+	if (device_write(0, &max_file_name_size, 2, current_byte))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	current_byte += 2;
+
+#if defined(USE_SD)
+	/* Write the state section size. */
+	if (device_write(0, &volume->state_section_size, 4, current_byte))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	current_byte += 4;
+#endif
+
+	/* Write out the metadata for the hash entries file and meta data file. */
+	uint8_t i;
+	for (i = 0; i < 2; i++) {
+		int8_t response;
+
+		/* Get the child index block address and the data block address for the file. */
+		uint32_t child_index_block_address = MULT_BY_POW_2_EXP((uint32_t) (i * 2), volume->block_size_exponent) +
+												(1 + volume->state_section_size);
+		uint32_t data_block_address = MULT_BY_POW_2_EXP((uint32_t) (i * 2 + 1), volume->block_size_exponent) +
+										(1 + volume->state_section_size);
+
+		/* Set file size to 0 for hash file directory entry. */
+		uint32_t zero = 0;
+		if (device_write(0, &zero, TEFS_DIR_EOF_PAGE_SIZE, current_byte))
+		{
+			return TEFS_ERR_WRITE;
+		}
+
+		current_byte += TEFS_DIR_EOF_PAGE_SIZE;
+
+		if (device_write(0, &zero, TEFS_DIR_EOF_BYTE_SIZE, current_byte))
+		{
+			return TEFS_ERR_WRITE;
+		}
+
+		current_byte += TEFS_DIR_EOF_BYTE_SIZE;
+
+		/* Write root index block address to the information page. */
+		if (device_write(0, &child_index_block_address, volume->address_size, current_byte))
+		{
+			return TEFS_ERR_WRITE;
+		}
+
+		current_byte += 4;
+
+		/* Write the first data block address to the beginning of the root index. */
+		if (device_write(child_index_block_address, &data_block_address, volume->address_size, 0))
+		{
+			return TEFS_ERR_WRITE;
+		}
+	}
+
+#if defined(USE_SD)
+	/* The blocks before the first free one and the number of used blocks are
+	   the four blocks of the directory files. */
+	uint32_t free_space[2] = {4, 4};
+	if (device_write(0, free_space, 8, TEFS_INFO_FREE_SPACE_BYTE))
+	{
+		return TEFS_ERR_WRITE;
+	}
+#endif
+
+	/* Write out the state section. Set the first four bits as 0 since the
+	   directory files use the first four blocks. The bytes past the end of
+	   the state section in its last page are set to 0 as well. */
+#if defined(USE_SD)
+	uint8_t zero_buffer[TEFS_SCAN_BUFFER_SIZE] = {0};
+
+	if (tefs_fill_pages(TEFS_INFO_SECTION_SIZE, volume->state_section_size, 0xFF))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	for (current_byte = MOD_BY_POW_2(state_section_size_in_bytes, POW_2_TO(volume->page_size_exponent));
+		 current_byte < physical_page_size;
+		 current_byte += TEFS_SCAN_BUFFER_SIZE)
+	{
+		uint16_t number_of_bytes = physical_page_size - current_byte;
+
+		if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+		{
+			number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+		}
+
+		if (device_write(TEFS_INFO_SECTION_SIZE + volume->state_section_size - 1, zero_buffer, number_of_bytes,
+						 current_byte))
+		{
+			return TEFS_ERR_WRITE;
+		}
+	}
+
+	data = 0x0F;
+	if (device_write(1, &data, 1, 0))
+	{
+		return TEFS_ERR_WRITE;
+	}
+#endif
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	/* Address size is set to 0 so that the data is loaded from the card into memory. */
+	volume->address_size = 0;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_mount(
+	void
+)
+{
+	/* Switch to the volume that has been selected. */
+	if (selected_volume != volume && tefs_use_volume(selected_volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (volume->address_size != 0)
+	{
+		return TEFS_ERR_OK;
+	}
+
+	return tefs_load_card_data();
+}
+
+int8_t
+tefs_open(
+	file_t 		*file,
+	char 		*file_name
+)
+{
+	/* Switch to the volume that has been selected. */
+	if (selected_volume != volume && tefs_use_volume(selected_volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	int8_t response;
+
+	/* Load the data from the information page if it has not been previously loaded. */
+	if (volume->address_size == 0)
+	{
+		if ((response = tefs_load_card_data()))
+		{
+			return response;
+		}
+	}
+
+	/* Get the size of the file name. Return an error if it exceeds the max length. */
+	uint16_t file_name_size = 0;
+	while (file_name[file_name_size] != '\0')
+	{
+		file_name_size++;
+	}
+
+	if (file_name_size > volume->max_file_name_size)
+	{
+		return TEFS_ERR_FILE_NAME_TOO_LONG;
+	}
+
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	uint32_t name_hash = hash_string(file_name);
+	uint8_t cache_slot = TEFS_OPEN_CACHE_SIZE;
+
+	if (file_name_size <= TEFS_OPEN_CACHE_NAME_SIZE &&
+		(cache_slot = tefs_open_cache_find(file_name, name_hash)) < TEFS_OPEN_CACHE_SIZE)
+	{
+		volume->open_cache_time[cache_slot] = ++volume->open_cache_clock;
+
+		if (volume->open_cache_count[cache_slot] == 0)
+		{
+			/* The file was closed with nothing else changing it since, so
+			   the state that it was closed with is still valid. */
+			memcpy(file, &volume->open_cache_file[cache_slot], sizeof(file_t));
+			volume->open_cache_count[cache_slot] = 1;
+
+			file->is_file_size_consistent 		= 1;
+			file->consistency_policy			= TEFS_DEFAULT_CONSISTENCY;
+			file->group_commit_pages			= 0;
+			file->group_commit_interval			= 0;
+			file->committed_eof_page			= file->eof_page;
+#if defined(TEFS_MILLISECONDS)
+			file->committed_time				= TEFS_MILLISECONDS();
+#else
+			file->committed_time				= 0;
+#endif
+			file->number_of_allocated_blocks	= tefs_count_file_blocks(file->eof_page, file->eof_byte);
+			file->number_of_reserved_blocks		= 0;
+			file->next_reserved_block			= 0;
+			file->volume						= volume;
+
+			return TEFS_ERR_OK;
+		}
+
+		/* The handles that are open at the same time change the file
+		   without each other knowing, so the state of neither is kept. */
+		volume->open_cache_count[cache_slot]++;
+		volume->open_cache_is_stale[cache_slot] = 1;
+	}
+#endif
+
+	if ((response = tefs_find_file_directory_entry(file_name, &(file->directory_page), &(file->directory_byte), 1)) !=
+		TEFS_NEW_FILE && response != TEFS_ERR_OK)
+	{
+#if defined(TEFS_OPEN_CACHE_SIZE)
+		if (cache_slot < TEFS_OPEN_CACHE_SIZE)
+		{
+			volume->open_cache_count[cache_slot]--;
+		}
+#endif
+
+		return response;
+	}
+
+	file->root_index_block_address		= 0;
+	file->child_index_block_address		= 0;
+	file->data_block_address			= 0;
+
+	uint16_t meta_entry_byte = file->directory_byte;
+
+	if (response == TEFS_NEW_FILE) /* Create a new file */
+	{
+		/* Reserve the first child index block and the first data block together. */
+		uint32_t block_addresses[2] = {0, 0};
+		uint8_t number_reserved;
+
+		if ((response = tefs_reserve_device_blocks(block_addresses, 2, 0, &number_reserved)))
+		{
+			return response;
+		}
+
+		/* A file cannot be created with only one of the blocks (the other
+		   address would be the information page). */
+		if (number_reserved < 2)
+		{
+			if ((response = tefs_release_device_block(block_addresses[0])))
+			{
+				return response;
+			}
+
+			return TEFS_ERR_DEVICE_FULL;
+		}
+
+		file->root_index_block_address = block_addresses[0];
+		file->child_index_block_address = block_addresses[0];
+		file->data_block_address = block_addresses[1];
+		file->eof_page = 0;
+		file->eof_byte = 0;
+
+		/* Build the directory entry in memory and write it out in as few
+		   pieces as the buffer allows. The status is zero for now to avoid
+		   writing past the end of the file. The file size is 0, the root index
+		   block address is the first child index block, and the file name is
+		   padded with null chars up to the end of the entry.
+
+		   TODO: Write out metadata */
+		uint8_t entry_buffer[TEFS_SCAN_BUFFER_SIZE];
+		uint16_t number_of_bytes;
+		uint16_t entry_byte;
+
+		for (entry_byte = 0; entry_byte < volume->metadata_size; entry_byte += number_of_bytes)
+		{
+			number_of_bytes = volume->metadata_size - entry_byte;
+
+			if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+			{
+				number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+			}
+
+			memset(entry_buffer, 0, number_of_bytes);
+
+			uint16_t i;
+			for (i = 0; i < number_of_bytes; i++)
+			{
+				uint16_t current_byte = entry_byte + i;
+
+				if (current_byte >= TEFS_DIR_STATIC_DATA_SIZE)
+				{
+					if (current_byte < TEFS_DIR_STATIC_DATA_SIZE + file_name_size)
+					{
+						entry_buffer[i] = (uint8_t) file_name[current_byte - TEFS_DIR_STATIC_DATA_SIZE];
+					}
+				}
+				else if (current_byte >= TEFS_DIR_STATIC_DATA_SIZE - TEFS_DIR_ROOT_INDEX_ADDRESS_SIZE)
+				{
+					entry_buffer[i] = ((uint8_t *) &(file->child_index_block_address))
+										[current_byte - (TEFS_DIR_STATIC_DATA_SIZE - TEFS_DIR_ROOT_INDEX_ADDRESS_SIZE)];
+				}
+			}
+
+			if ((response = tefs_write(&volume->metadata, file->directory_page, entry_buffer, number_of_bytes,
+									   meta_entry_byte + entry_byte)))
+			{
+				return response;
+			}
+		}
+
+		/* Change status to IN_USE for directory entry. */
+		uint8_t status = TEFS_IN_USE;
+		if ((response = tefs_write(&volume->metadata, file->directory_page, &status, 1, file->directory_byte)))
+		{
+			return response;
+		}
+
+		/* Write first data block address to first child index block. */
+		if (device_write(file->child_index_block_address, &(file->data_block_address), volume->address_size, 0))
+		{
+			return TEFS_ERR_WRITE;
+		}
+
+		/* Write out the sizes of the directory files so that the new entry is
+		   found after the volume is mounted again. */
+		if (!volume->hash_entries.is_file_size_consistent &&
+			(response = tefs_update_file_size(&volume->hash_entries)))
+		{
+			return response;
+		}
+
+		if (!volume->metadata.is_file_size_consistent &&
+			(response = tefs_update_file_size(&volume->metadata)))
+		{
+			return response;
+		}
+
+		if (device_flush())
+		{
+			return TEFS_ERR_WRITE;
+		}
+	}
+	else /* Open an existing file. */
+	{
+		meta_entry_byte += TEFS_DIR_STATUS_SIZE;
+
+		/* Read the file size. */
+		if ((response = tefs_read(&volume->metadata, file->directory_page, &(file->eof_page),
+								  TEFS_DIR_EOF_PAGE_SIZE, meta_entry_byte)))
+		{
+			return response;
+		}
+
+		meta_entry_byte += TEFS_DIR_EOF_PAGE_SIZE;
+
+		if ((response = tefs_read(&volume->metadata, file->directory_page, &(file->eof_byte),
+								  TEFS_DIR_EOF_BYTE_SIZE, meta_entry_byte)))
+		{
+			return response;
+		}
+
+		meta_entry_byte += TEFS_DIR_EOF_BYTE_SIZE;
+
+		/* Read the file pointer. */
+		if ((response = tefs_read(&volume->metadata, file->directory_page, &(file->root_index_block_address),
+								  volume->address_size, meta_entry_byte)))
+		{
+			return response;
+		}
+
+		if (file->eof_page >= MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent))
+		{
+			/* Read the first child index block address. */
+			if (device_read(file->root_index_block_address, &(file->child_index_block_address), volume->address_size, 0))
+			{
+				return TEFS_ERR_READ;
+			}
+
+			/* Read the first data block address (the child index block is
+			   gone if the head of the file has been dropped). */
+			if (file->child_index_block_address == TEFS_DELETED)
+			{
+				file->data_block_address = TEFS_DELETED;
+			}
+			else if (device_read(file->child_index_block_address, &(file->data_block_address), volume->address_size, 0))
+			{
+				return TEFS_ERR_READ;
+			}
+		}
+		else
+		{
+			file->child_index_block_address = file->root_index_block_address;
+
+			/* Read the first data block address. */
+			if (device_read(file->child_index_block_address, &(file->data_block_address), volume->address_size, 0))
+			{
+				return TEFS_ERR_READ;
+			}
+		}
+	}
+
+	file->data_block_number				= 0;
+	file->current_page_number			= 0;
+	file->first_block_number			= 0;
+	file->is_file_size_consistent 		= 1;
+	file->consistency_policy			= TEFS_DEFAULT_CONSISTENCY;
+	file->group_commit_pages			= 0;
+	file->group_commit_interval			= 0;
+	file->committed_eof_page			= file->eof_page;
+#if defined(TEFS_MILLISECONDS)
+	file->committed_time				= TEFS_MILLISECONDS();
+#else
+	file->committed_time				= 0;
+#endif
+	file->number_of_allocated_blocks	= tefs_count_file_blocks(file->eof_page, file->eof_byte);
+#if defined(TEFS_EXTENT_SUPPORT)
+	file->extent_address				= file->data_block_address;
+	file->extent_length					= 1;
+	file->is_extent_ended				= 0;
+#endif
+	file->number_of_reserved_blocks		= 0;
+	file->next_reserved_block			= 0;
+#if defined(TEFS_INDEX_CACHE_SIZE)
+	file->index_cache_page				= 0;
+	file->is_index_cache_dirty			= 0;
+#endif
+	file->volume						= volume;
+
+	/* The first data block has been released if the head of the file was
+	   dropped, so none of the blocks are current. */
+	if (file->data_block_address == TEFS_DELETED)
+	{
+		if ((response = tefs_find_first_data_block(file)))
+		{
+			return response;
+		}
+
+		if (file->child_index_block_address == TEFS_DELETED)
+		{
+			file->child_index_block_address = 0;
+		}
+
+		file->data_block_number = 0xFFFFFFFF;
+		file->current_page_number = 0xFFFFFFFF;
+#if defined(TEFS_EXTENT_SUPPORT)
+		file->extent_length = 0;
+		file->is_extent_ended = 1;
+#endif
+	}
+
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	if (file_name_size <= TEFS_OPEN_CACHE_NAME_SIZE && cache_slot == TEFS_OPEN_CACHE_SIZE)
+	{
+		tefs_open_cache_insert(file, file_name, name_hash);
+	}
+#endif
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_exists(
+	char *file_name
+)
+{
+	/* Switch to the volume that has been selected. */
+	if (selected_volume != volume && tefs_use_volume(selected_volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	int8_t response;
+
+	/* Load the data from the information page if it has not been previously loaded. */
+	if (volume->address_size == 0)
+	{
+		if ((response = tefs_load_card_data()))
+		{
+			return response;
+		}
+	}
+
+	uint32_t directory_page;
+	uint16_t directory_byte;
+
+	if (tefs_find_file_directory_entry(file_name, &directory_page, &directory_byte, 0))
+	{
+		return 0;
+	}
+
+	/* Check if the status for the file's directory entry is set to IN_USE. */
+	uint8_t status;
+	if ((response = tefs_read(&volume->metadata, directory_page, &status, 1, directory_byte)))
+	{
+		return response;
+	}
+
+	if (status == TEFS_IN_USE)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+int8_t
+tefs_close(
+	file_t *file
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	/* Take the file out of the open cache. It is put back with its state
+	   below if it was the only handle and the file is closed properly. */
+	uint8_t cache_slot = tefs_open_cache_find_open(file);
+	uint8_t is_state_kept = 0;
+
+	if (cache_slot < TEFS_OPEN_CACHE_SIZE && --volume->open_cache_count[cache_slot] == 0)
+	{
+		is_state_kept = !volume->open_cache_is_stale[cache_slot];
+		volume->open_cache_time[cache_slot] = 0;
+	}
+#endif
+
+	if (tefs_flush(file))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	/* Release the blocks that were reserved ahead or preallocated but not
+	   used. */
+	int8_t response;
+	if ((response = tefs_release_blocks_past(file, tefs_count_file_blocks(file->eof_page, file->eof_byte))))
+	{
+		return response;
+	}
+
+	if ((response = tefs_release_reserved_blocks(file)))
+	{
+		return response;
+	}
+
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	if (is_state_kept)
+	{
+		memcpy(&volume->open_cache_file[cache_slot], file, sizeof(file_t));
+		volume->open_cache_time[cache_slot] = ++volume->open_cache_clock;
+	}
+#endif
+
+#if defined(USE_SD)
+	if ((response = tefs_write_free_space()))
+	{
+		return response;
+	}
+#endif
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_remove(
+	char *file_name
+)
+{
+	/* Switch to the volume that has been selected. */
+	if (selected_volume != volume && tefs_use_volume(selected_volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	int8_t response;
+
+	/* Load the data from the information page if it has not been previously loaded. */
+	if (volume->address_size == 0)
+	{
+		if ((response = tefs_load_card_data()))
+		{
+			return response;
+		}
+	}
+
+	uint32_t directory_page;
+	uint16_t directory_byte;
+
+	if ((response = tefs_find_file_directory_entry(file_name, &directory_page, &directory_byte, 2)))
+	{
+		return response;
+	}
+
+	uint32_t root_index_block_address = 0;
+
+	/* Get the root index block address for the file. */
+	if ((response = tefs_read(&volume->metadata, directory_page, &root_index_block_address, TEFS_DIR_ROOT_INDEX_ADDRESS_SIZE,
+							  directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_BYTE_SIZE + TEFS_DIR_EOF_PAGE_SIZE)))
+	{
+		return response;
+	}
+
+	uint32_t eof_page = 0;
+	uint16_t eof_byte = 0;
+
+	/* Read the file size. */
+	if ((response = tefs_read(&volume->metadata, directory_page, &eof_page, TEFS_DIR_EOF_PAGE_SIZE, directory_byte + TEFS_DIR_STATUS_SIZE)))
+	{
+		return response;
+	}
+
+	if ((response = tefs_read(&volume->metadata, directory_page, &eof_byte, TEFS_DIR_EOF_BYTE_SIZE,
+							  directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE)))
+	{
+		return response;
+	}
+
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	/* A file that is opened again after this is a new file. */
+	uint8_t cache_slot = tefs_open_cache_find(file_name, hash_string(file_name));
+
+	if (cache_slot < TEFS_OPEN_CACHE_SIZE)
+	{
+		volume->open_cache_time[cache_slot] = 0;
+	}
+#endif
+
+	/* Change file status to deleted. */
+	uint8_t status = TEFS_DELETED;
+
+	if ((response = tefs_write(&volume->metadata, directory_page, &status, 1, directory_byte)))
+	{
+		return response;
+	}
+
+#if defined(TEFS_LAZY_FREE_QUEUE_SIZE)
+	/* Leave the blocks to be released by tefs_idle. If the queue is full,
+	   the blocks of the last file in it are released now. */
+	if (volume->lazy_free_count == TEFS_LAZY_FREE_QUEUE_SIZE)
+	{
+		if ((response = tefs_release_file_blocks(volume->lazy_free_root_index_address[volume->lazy_free_count - 1],
+												 volume->lazy_free_eof_page[volume->lazy_free_count - 1],
+												 volume->lazy_free_eof_byte[volume->lazy_free_count - 1])))
+		{
+			return response;
+		}
+
+		volume->lazy_free_count--;
+	}
+
+	volume->lazy_free_root_index_address[volume->lazy_free_count] = root_index_block_address;
+	volume->lazy_free_eof_page[volume->lazy_free_count] = eof_page;
+	volume->lazy_free_eof_byte[volume->lazy_free_count] = eof_byte;
+	volume->lazy_free_count++;
+#else
+	/* Release all blocks that are in the file. */
+	if ((response = tefs_release_file_blocks(root_index_block_address, eof_page, eof_byte)))
+	{
+		return response;
+	}
+#endif
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_compact_directory(
+	void
+)
+{
+	/* Switch to the volume that has been selected. */
+	if (selected_volume != volume && tefs_use_volume(selected_volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	int8_t response;
+
+	/* Load the data from the information page if it has not been previously loaded. */
+	if (volume->address_size == 0)
+	{
+		if ((response = tefs_load_card_data()))
+		{
+			return response;
+		}
+	}
+
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	/* The directory entries of the files in the open cache are moved. */
+	tefs_open_cache_clear();
+#endif
+
+	uint8_t hash_size_exponent = volume->hash_size_exponent;
+	uint32_t number_of_entries = DIV_BY_POW_2_EXP(MULT_BY_POW_2_EXP(volume->hash_entries.eof_page, volume->page_size_exponent) +
+												  volume->hash_entries.eof_byte, hash_size_exponent);
+	uint32_t hash_buffer[TEFS_SCAN_BUFFER_SIZE / 4];
+	uint8_t entry_buffer[TEFS_SCAN_BUFFER_SIZE];
+	uint32_t entry_number = 0;
+	uint32_t live_entry_number = 0;
+
+	uint16_t hash_page_address;
+	uint16_t hash_byte_in_page;
+	uint32_t dir_page_address;
+	uint16_t dir_byte_in_page;
+
+	/* Move each entry that is in use down to the first entry that is free.
+	   The hashes are read as many at a time as fit into the buffer. */
+	while (entry_number < number_of_entries)
+	{
+		tefs_map_directory_entry(entry_number, &hash_page_address, &hash_byte_in_page, &dir_page_address, &dir_byte_in_page);
+
+		uint16_t number_of_hashes = DIV_BY_POW_2_EXP(volume->page_size - hash_byte_in_page, hash_size_exponent);
+
+		if (number_of_hashes > DIV_BY_POW_2_EXP(TEFS_SCAN_BUFFER_SIZE, hash_size_exponent))
+		{
+			number_of_hashes = DIV_BY_POW_2_EXP(TEFS_SCAN_BUFFER_SIZE, hash_size_exponent);
+		}
+
+		if (number_of_hashes > number_of_entries - entry_number)
+		{
+			number_of_hashes = (uint16_t) (number_of_entries - entry_number);
+		}
+
+		if ((response = tefs_read(&volume->hash_entries, hash_page_address, hash_buffer,
+								  MULT_BY_POW_2_EXP(number_of_hashes, hash_size_exponent), hash_byte_in_page)))
+		{
+			return response;
+		}
+
+		uint16_t current_hash;
+		for (current_hash = 0; current_hash < number_of_hashes; current_hash++, entry_number++)
+		{
+			uint32_t entry_hash_value = (volume->hash_size == 4) ? hash_buffer[current_hash] :
+														   ((uint16_t *) hash_buffer)[current_hash];
+
+			if (entry_hash_value == 0)
+			{
+				continue;
+			}
+
+			tefs_map_directory_entry(entry_number, &hash_page_address, &hash_byte_in_page, &dir_page_address,
+									 &dir_byte_in_page);
+
+			uint8_t status;
+			if ((response = tefs_read(&volume->metadata, dir_page_address, &status, 1, dir_byte_in_page)))
+			{
+				return response;
+			}
+
+			if (status == TEFS_IN_USE && live_entry_number == entry_number)
+			{
+				live_entry_number++;
+				continue;
+			}
+
+			if (status == TEFS_IN_USE)
+			{
+				uint16_t live_hash_page_address;
+				uint16_t live_hash_byte_in_page;
+				uint32_t live_dir_page_address;
+				uint16_t live_dir_byte_in_page;
+
+				tefs_map_directory_entry(live_entry_number, &live_hash_page_address, &live_hash_byte_in_page,
+										 &live_dir_page_address, &live_dir_byte_in_page);
+
+				/* Copy the metadata entry and then its hash. */
+				uint16_t entry_byte;
+				uint16_t number_of_bytes;
+
+				for (entry_byte = 0; entry_byte < volume->metadata_size; entry_byte += number_of_bytes)
+				{
+					number_of_bytes = volume->metadata_size - entry_byte;
+
+					if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+					{
+						number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+					}
+
+					if ((response = tefs_read(&volume->metadata, dir_page_address, entry_buffer, number_of_bytes,
+											  dir_byte_in_page + entry_byte)) ||
+						(response = tefs_write(&volume->metadata, live_dir_page_address, entry_buffer, number_of_bytes,
+											   live_dir_byte_in_page + entry_byte)))
+					{
+						return response;
+					}
+				}
+
+				if ((response = tefs_write(&volume->hash_entries, live_hash_page_address,
+										   (uint8_t *) hash_buffer + MULT_BY_POW_2_EXP(current_hash, hash_size_exponent),
+										   volume->hash_size, live_hash_byte_in_page)))
+				{
+					return response;
+				}
+
+				live_entry_number++;
+			}
+
+			/* Clear the old entry (or an entry that was never finished). */
+			uint32_t empty_hash_value = 0;
+			status = TEFS_DELETED;
+
+			if ((response = tefs_write(&volume->hash_entries, hash_page_address, &empty_hash_value, volume->hash_size,
+									   hash_byte_in_page)) ||
+				(response = tefs_write(&volume->metadata, dir_page_address, &status, 1, dir_byte_in_page)))
+			{
+				return response;
+			}
+		}
+	}
+
+	/* Shorten the directory files to the entries that are in use. */
+	if (live_entry_number < number_of_entries)
+	{
+		uint32_t hash_bytes = MULT_BY_POW_2_EXP(live_entry_number, hash_size_exponent);
+		uint32_t metadata_bytes = live_entry_number * volume->metadata_size;
+
+		if ((response = tefs_truncate(&volume->hash_entries, DIV_BY_POW_2_EXP(hash_bytes, volume->page_size_exponent),
+									  (uint16_t) MOD_BY_POW_2(hash_bytes, volume->page_size))) ||
+			(response = tefs_truncate(&volume->metadata, DIV_BY_POW_2_EXP(metadata_bytes, volume->page_size_exponent),
+									  (uint16_t) MOD_BY_POW_2(metadata_bytes, volume->page_size))))
+		{
+			return response;
+		}
+	}
+
+#if defined(TEFS_HASH_INDEX_SIZE)
+	if ((response = tefs_build_hash_index()))
+	{
+		return response;
+	}
+#endif
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_idle(
+	void
+)
+{
+	/* Switch to the volume that has been selected. */
+	if (selected_volume != volume && tefs_use_volume(selected_volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+#if defined(TEFS_LAZY_FREE_QUEUE_SIZE)
+	/* Release the blocks of the files that have been removed. */
+	while (volume->lazy_free_count > 0)
+	{
+		int8_t response;
+		if ((response = tefs_release_file_blocks(volume->lazy_free_root_index_address[volume->lazy_free_count - 1],
+												 volume->lazy_free_eof_page[volume->lazy_free_count - 1],
+												 volume->lazy_free_eof_byte[volume->lazy_free_count - 1])))
+		{
+			return response;
+		}
+
+		volume->lazy_free_count--;
+	}
+#endif
+
+#if defined(USE_SD)
+	return tefs_write_free_space();
+#else
+	return TEFS_ERR_OK;
+#endif
+}
+
+#if defined(USE_SD)
+int8_t
+tefs_statfs(
+	uint32_t	*number_of_blocks,
+	uint32_t	*number_of_free_blocks
+)
+{
+	/* Switch to the volume that has been selected. */
+	if (selected_volume != volume && tefs_use_volume(selected_volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	int8_t response;
+
+	/* Load the data from the information page if it has not been previously loaded. */
+	if (volume->address_size == 0)
+	{
+		if ((response = tefs_load_card_data()))
+		{
+			return response;
+		}
+	}
+
+	if (volume->used_block_count == 0 && (response = tefs_count_used_blocks()))
+	{
+		return response;
+	}
+
+	*number_of_blocks = volume->number_of_blocks;
+	*number_of_free_blocks = volume->number_of_blocks - volume->used_block_count;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_set_allocation_policy(
+	uint8_t policy
+)
+{
+	selected_volume->allocation_policy = policy;
+
+	return TEFS_ERR_OK;
+}
+#endif
+
+#if defined(TEFS_STATS)
+int8_t
+tefs_get_stats(
+	tefs_stats_t *stats
+)
+{
+	memcpy(stats, &selected_volume->stats, sizeof(tefs_stats_t));
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_reset_stats(
+	void
+)
+{
+	memset(&selected_volume->stats, 0, sizeof(tefs_stats_t));
+
+	return TEFS_ERR_OK;
+}
+#endif
+
+#if defined(TEFS_TRACE)
+int8_t
+tefs_set_trace_hook(
+	tefs_trace_hook_t hook
+)
+{
+	selected_volume->trace_hook = hook;
+
+	return TEFS_ERR_OK;
+}
+#endif
+
+int8_t
+tefs_opendir(
+	tefs_dir_t *dir
+)
+{
+	/* Switch to the volume that has been selected. */
+	if (selected_volume != volume && tefs_use_volume(selected_volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	int8_t response;
+
+	/* Load the data from the information page if it has not been previously loaded. */
+	if (volume->address_size == 0)
+	{
+		if ((response = tefs_load_card_data()))
+		{
+			return response;
+		}
+	}
+
+	dir->volume = volume;
+	dir->entry_number = 0;
+	dir->hash_entry_number = 0;
+	dir->number_of_hashes = 0;
+	dir->metadata_entry_number = 0;
+	dir->number_of_metadata_entries = 0;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_readdir(
+	tefs_dir_t	*dir,
+	char		*file_name,
+	uint32_t	*eof_page,
+	uint16_t	*eof_byte,
+	uint32_t	*root_index_block_address
+)
+{
+	/* Switch to the volume that the directory is on. */
+	if (dir->volume != volume && tefs_use_volume(dir->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	int8_t response;
+	uint8_t hash_size_exponent = volume->hash_size_exponent;
+	uint32_t number_of_entries = DIV_BY_POW_2_EXP(MULT_BY_POW_2_EXP(volume->hash_entries.eof_page, volume->page_size_exponent) +
+												  volume->hash_entries.eof_byte, hash_size_exponent);
+
+	/* Only the static data and the name of an entry are needed. */
+	uint16_t entry_size = TEFS_DIR_STATIC_DATA_SIZE + volume->max_file_name_size;
+
+	uint16_t hash_page_address;
+	uint16_t hash_byte_in_page;
+	uint32_t dir_page_address;
+	uint16_t dir_byte_in_page;
+
+	for (; dir->entry_number < number_of_entries; dir->entry_number++)
+	{
+		uint32_t entry_hash_value;
+
+#if defined(TEFS_HASH_INDEX_SIZE)
+		if (dir->entry_number < volume->hash_index_count)
+		{
+			entry_hash_value = volume->hash_index[dir->entry_number];
+		}
+		else
+#endif
+		{
+			/* Read as many hashes as fit into the buffer from the page of the
+			   entry. */
+			if (dir->entry_number < dir->hash_entry_number ||
+				dir->entry_number >= dir->hash_entry_number + dir->number_of_hashes)
+			{
+				tefs_map_directory_entry(dir->entry_number, &hash_page_address, &hash_byte_in_page, &dir_page_address,
+										 &dir_byte_in_page);
+
+				uint16_t number_of_hashes = DIV_BY_POW_2_EXP(volume->page_size - hash_byte_in_page, hash_size_exponent);
+
+				if (number_of_hashes > DIV_BY_POW_2_EXP(TEFS_SCAN_BUFFER_SIZE, hash_size_exponent))
+				{
+					number_of_hashes = DIV_BY_POW_2_EXP(TEFS_SCAN_BUFFER_SIZE, hash_size_exponent);
+				}
+
+				if (number_of_hashes > number_of_entries - dir->entry_number)
+				{
+					number_of_hashes = (uint16_t) (number_of_entries - dir->entry_number);
+				}
+
+				if ((response = tefs_read(&volume->hash_entries, hash_page_address, dir->hash_buffer,
+										  MULT_BY_POW_2_EXP(number_of_hashes, hash_size_exponent), hash_byte_in_page)))
+				{
+					return response;
+				}
+
+				dir->hash_entry_number = dir->entry_number;
+				dir->number_of_hashes = number_of_hashes;
+			}
+
+			uint16_t current_hash = (uint16_t) (dir->entry_number - dir->hash_entry_number);
+			entry_hash_value = (volume->hash_size == 4) ? dir->hash_buffer[current_hash] :
+														  ((uint16_t *) dir->hash_buffer)[current_hash];
+		}
+
+		/* The hash of an empty or deleted entry is 0. */
+		if (entry_hash_value == 0)
+		{
+			continue;
+		}
+
+		uint8_t *entry;
+		uint8_t static_data[TEFS_DIR_STATIC_DATA_SIZE];
+
+		if (dir->entry_number < dir->metadata_entry_number ||
+			dir->entry_number >= dir->metadata_entry_number + dir->number_of_metadata_entries)
+		{
+			tefs_map_directory_entry(dir->entry_number, &hash_page_address, &hash_byte_in_page, &dir_page_address,
+									 &dir_byte_in_page);
+
+			/* Read the entries that fit into the buffer from the page of the
+			   entry. */
+			uint16_t number_of_bytes = volume->page_size - dir_byte_in_page;
+
+			if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+			{
+				number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+			}
+
+			dir->metadata_entry_number = dir->entry_number;
+			dir->number_of_metadata_entries = 0;
+
+			if (number_of_bytes >= entry_size)
+			{
+				uint32_t number_of_metadata_entries = (number_of_bytes - entry_size) / volume->metadata_size + 1;
+
+				if (number_of_metadata_entries > number_of_entries - dir->entry_number)
+				{
+					number_of_metadata_entries = number_of_entries - dir->entry_number;
+				}
+
+				if ((response = tefs_read(&volume->metadata, dir_page_address, dir->metadata_buffer,
+										  (uint16_t) ((number_of_metadata_entries - 1) * volume->metadata_size + entry_size),
+										  dir_byte_in_page)))
+				{
+					return response;
+				}
+
+				dir->number_of_metadata_entries = (uint16_t) number_of_metadata_entries;
+			}
+			else
+			{
+				/* The entry does not fit into the buffer, so its static data
+				   and its name are read on their own. */
+				if ((response = tefs_read(&volume->metadata, dir_page_address, static_data, TEFS_DIR_STATIC_DATA_SIZE,
+										  dir_byte_in_page)))
+				{
+					return response;
+				}
+
+				if (static_data[0] == TEFS_IN_USE &&
+					(response = tefs_read(&volume->metadata, dir_page_address, file_name, volume->max_file_name_size,
+										  dir_byte_in_page + TEFS_DIR_STATIC_DATA_SIZE)))
+				{
+					return response;
+				}
+			}
+		}
+
+		if (dir->number_of_metadata_entries > 0)
+		{
+			entry = dir->metadata_buffer + (dir->entry_number - dir->metadata_entry_number) * volume->metadata_size;
+
+			if (entry[0] == TEFS_IN_USE)
+			{
+				memcpy(file_name, entry + TEFS_DIR_STATIC_DATA_SIZE, volume->max_file_name_size);
+			}
+		}
+		else
+		{
+			entry = static_data;
+		}
+
+		/* Skip the entries that are not in use (a new entry has a hash before
+		   its status is set). */
+		if (entry[0] != TEFS_IN_USE)
+		{
+			continue;
+		}
+
+		file_name[volume->max_file_name_size] = '\0';
+
+		memcpy(eof_page, entry + TEFS_DIR_STATUS_SIZE, TEFS_DIR_EOF_PAGE_SIZE);
+		memcpy(eof_byte, entry + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE, TEFS_DIR_EOF_BYTE_SIZE);
+		*root_index_block_address = 0;
+		memcpy(root_index_block_address, entry + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE + TEFS_DIR_EOF_BYTE_SIZE,
+			   volume->address_size);
+
+		dir->entry_number++;
+
+		return TEFS_ERR_OK;
+	}
+
+	return TEFS_ERR_EOF;
+}
+
+int8_t
+tefs_closedir(
+	tefs_dir_t *dir
+)
+{
+	dir->number_of_hashes = 0;
+	dir->number_of_metadata_entries = 0;
+
+	return TEFS_ERR_OK;
+}
+
+uint8_t
+tefs_page_size_exponent(
+	void
+)
+{
+	return selected_volume->page_size_exponent;
+}
+
+int8_t
+tefs_write(
+	file_t 		*file,
+	uint32_t	file_page_address,
+	void	 	*data,
+	uint16_t 	number_of_bytes,
+	uint16_t 	byte_offset
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	uint8_t is_new_page = 0;
+	uint16_t eof_byte = file->eof_byte;
+
+	/* The data block for the page has not been allocated if this is the first
+	   write to a page that starts a block (the first block is allocated when
+	   the file is created). It has already been allocated if the page has
+	   been mapped before or if the block was preallocated. */
+	uint8_t is_new_block = file_page_address == file->eof_page && file->eof_byte == 0 && number_of_bytes > 0 &&
+						   file_page_address > 0 && MOD_BY_POW_2(file_page_address, volume->block_size) == 0 &&
+						   DIV_BY_POW_2_EXP(file_page_address, volume->block_size_exponent) >= file->number_of_allocated_blocks;
+
+	if (file_page_address == file->eof_page)
+	{
+		if (byte_offset > file->eof_byte)
+		{
+			return TEFS_ERR_WRITE_PAST_END;
+		}
+		else if (byte_offset + number_of_bytes > file->eof_byte)
+		{
+			is_new_page = 1;
+		}
+
+		int8_t response;
+		if ((response = tefs_extend_file(file, byte_offset + number_of_bytes)))
+		{
+			return response;
+		}
+	}
+	else if (file_page_address > file->eof_page)
+	{
+		return TEFS_ERR_WRITE_PAST_END;
+	}
+
+	/* Get the data block of the page (a new one is allocated if needed) and
+	   then write the data. */
+	int8_t response;
+	if ((response = tefs_find_data_block(file, file_page_address, is_new_block)))
+	{
+		return response;
+	}
+
+	/* The end of the file is written without reading the page first if
+	   nothing has been written to it yet or if it is already in the buffer
+	   (which is only known once the data block of the page has been found). */
+	if (is_new_page && eof_byte != 0)
+	{
+		is_new_page = device_is_page_buffered(file->data_block_address + MOD_BY_POW_2(file_page_address, volume->block_size));
+	}
+
+	sd_spi_dirty_write = is_new_page;
+	TEFS_SET_DEVICE_REGION(TEFS_FILE_REGION(file));
+
+	if (device_write(file->data_block_address + MOD_BY_POW_2(file_page_address, volume->block_size),
+					 data, number_of_bytes, byte_offset))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	sd_spi_dirty_write = 0;
+
+	/* Update file size. */
+	if ((response = tefs_apply_consistency_policy(file, file_page_address)))
+	{
+		return response;
+	}
+
+	file->current_page_number = file_page_address;
+
+	return TEFS_ERR_OK;
+}
+
+#if defined(TEFS_CONTINUOUS_SUPPORT)
+int8_t
+tefs_write_continuous_start(
+	file_t 		*file,
+	uint32_t 	start_file_page_address
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (is_read_write_continuous)
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (start_file_page_address > file->eof_page)
+	{
+		return TEFS_ERR_WRITE_PAST_END;
+	}
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	is_read_write_continuous = 1;
+	is_continuous_block_open = 0;
+	continuous_page_address = start_file_page_address;
+	continuous_page_bytes = 0;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_write_continuous(
+	file_t 		*file,
+	void	 	*data,
+	uint16_t 	number_of_bytes,
+	uint16_t 	byte_offset
+)
+{
+	int8_t response;
+
+	if (is_read_write_continuous != 1)
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (continuous_page_address == file->eof_page)
+	{
+		if (byte_offset > file->eof_byte && byte_offset > continuous_page_bytes)
+		{
+			return TEFS_ERR_WRITE_PAST_END;
+		}
+	}
+	else if (continuous_page_address > file->eof_page)
+	{
+		return TEFS_ERR_WRITE_PAST_END;
+	}
+
+	if (number_of_bytes == 0)
+	{
+		return TEFS_ERR_OK;
+	}
+
+	if (!is_continuous_block_open && (response = tefs_open_continuous_block(file)))
+	{
+		return response;
+	}
+
+	if (sd_spi_write_continuous(data, number_of_bytes, byte_offset))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (byte_offset + number_of_bytes > continuous_page_bytes)
+	{
+		continuous_page_bytes = byte_offset + number_of_bytes;
+	}
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_write_continuous_next(
+	file_t *file
+)
+{
+	int8_t response;
+
+	if (is_read_write_continuous != 1)
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	/* The end of the file can only be passed by writing to the page. */
+	if (continuous_page_address >= file->eof_page && continuous_page_bytes == 0)
+	{
+		return TEFS_ERR_WRITE_PAST_END;
+	}
+
+	if (!is_continuous_block_open && (response = tefs_open_continuous_block(file)))
+	{
+		return response;
+	}
+
+	return tefs_write_continuous_page(file);
+}
+
+int8_t
+tefs_write_continuous_stop(
+	file_t *file
+)
+{
+	int8_t response = TEFS_ERR_OK;
+
+	if (is_read_write_continuous != 1)
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	/* Write out the page if it has data that is still in the buffer. */
+	if (continuous_page_bytes > 0)
+	{
+		response = tefs_write_continuous_page(file);
+	}
+
+	if (is_continuous_block_open)
+	{
+		is_continuous_block_open = 0;
+
+		if (sd_spi_write_continuous_stop() && response == TEFS_ERR_OK)
+		{
+			response = TEFS_ERR_WRITE;
+		}
+	}
+
+	is_read_write_continuous = 0;
+	continuous_page_bytes = 0;
+
+	if (response)
+	{
+		return response;
+	}
+
+	return tefs_flush(file);
+}
+#endif
+
+int8_t
+tefs_flush(
+	file_t *file
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+#if defined(TEFS_INDEX_CACHE_SIZE)
+	int8_t response;
+	if ((response = tefs_write_index_cache(file)))
+	{
+		return response;
+	}
+#endif
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	/* Update file size. */
+	if (!file->is_file_size_consistent)
+	{
+		int8_t err;
+		if ((err = tefs_update_file_size(file)))
+		{
+			return err;
+		}
+	}
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_read(
+	file_t 		*file,
+	uint32_t 	file_page_address,
+	void		*buffer,
+	uint16_t 	number_of_bytes,
+	uint16_t 	byte_offset
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	/* Update file size if necessary. */
+	if (file->consistency_policy == TEFS_CONSISTENCY_PAGE && !file->is_file_size_consistent &&
+		file_page_address != file->current_page_number)
+	{
+		int8_t err;
+		if ((err = tefs_update_file_size(file)))
+		{
+			return err;
+		}
+	}
+
+	if (file_page_address == file->eof_page)
+	{
+		if (byte_offset > file->eof_byte)
+		{
+			return TEFS_ERR_EOF;
+		}
+		else if (byte_offset + number_of_bytes > file->eof_byte)
+		{
+			return TEFS_ERR_EOF;
+		}
+	}
+	else if (file_page_address > file->eof_page)
+	{
+		return TEFS_ERR_EOF;
+	}
+
+	int8_t response;
+	if ((response = tefs_find_data_block(file, file_page_address, 0)))
+	{
+		return response;
+	}
+
+	TEFS_SET_DEVICE_REGION(TEFS_FILE_REGION(file));
+
+	if (device_read(file->data_block_address + MOD_BY_POW_2(file_page_address, volume->block_size),
+					buffer, number_of_bytes, byte_offset))
+	{
+		return TEFS_ERR_READ;
+	}
+
+	file->current_page_number = file_page_address;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_read_pages(
+	file_t		*file,
+	uint32_t	first_file_page_address,
+	uint32_t	number_of_pages,
+	void		*buffer
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	int8_t response;
+
+	/* Update file size if necessary. */
+	if (file->consistency_policy == TEFS_CONSISTENCY_PAGE && !file->is_file_size_consistent)
+	{
+		if ((response = tefs_update_file_size(file)))
+		{
+			return response;
+		}
+	}
+
+	/* Only whole pages can be read. */
+	if (first_file_page_address + number_of_pages > file->eof_page)
+	{
+		return TEFS_ERR_EOF;
+	}
+
+	if (number_of_pages == 0)
+	{
+		return TEFS_ERR_OK;
+	}
+
+#if defined(USE_SD)
+	/* Write out the buffer so that the card has the latest data. */
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+#endif
+
+	uint8_t *page_buffer = (uint8_t *) buffer;
+	uint32_t current_page = first_file_page_address;
+	uint32_t last_page = first_file_page_address + number_of_pages;
+
+	while (current_page < last_page)
+	{
+		if ((response = tefs_find_data_block(file, current_page, 0)))
+		{
+			return response;
+		}
+
+		/* The current page has to be in the data block that was found before
+		   another block is looked up. */
+		file->current_page_number = current_page;
+
+		/* Read the pages that are in the data block in one sequence. */
+		uint32_t end_page = MULT_BY_POW_2_EXP(DIV_BY_POW_2_EXP(current_page, volume->block_size_exponent) + 1, volume->block_size_exponent);
+
+#if defined(TEFS_EXTENT_SUPPORT)
+		/* The pages in the rest of the extent are read in the same sequence. */
+		if (DIV_BY_POW_2_EXP(current_page, volume->block_size_exponent) < file->extent_length)
+		{
+			end_page = MULT_BY_POW_2_EXP(file->extent_length, volume->block_size_exponent);
+		}
+#endif
+
+		if (end_page > last_page)
+		{
+			end_page = last_page;
+		}
+
+		uint32_t device_page = file->data_block_address + MOD_BY_POW_2(current_page, volume->block_size);
+
+#if defined(TEFS_DEVICE_BACKEND)
+		tefs_device_t *device = tefs_current_device();
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+		uint32_t start_time = TEFS_TRACE_TIME();
+#endif
+
+		if (device == NULL || device->read_pages(device, device_page, end_page - current_page, page_buffer))
+		{
+			return TEFS_ERR_READ;
+		}
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+		/* The pages are counted as one read. */
+		tefs_record_device_op(TEFS_TRACE_READ, TEFS_FILE_REGION(file), device_page,
+							  MULT_BY_POW_2_EXP(end_page - current_page, volume->page_size_exponent), TEFS_ERR_OK, start_time);
+#endif
+
+		page_buffer += MULT_BY_POW_2_EXP(end_page - current_page, volume->page_size_exponent);
+		current_page = end_page;
+#elif defined(USE_SD)
+		if (sd_spi_read_continuous_start(device_page))
+		{
+			return TEFS_ERR_READ;
+		}
+
+		for (; current_page < end_page; current_page++, device_page++)
+		{
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+			uint32_t start_time = TEFS_TRACE_TIME();
+#endif
+
+			if (sd_spi_read_continuous(page_buffer, volume->page_size, 0) || sd_spi_read_continuous_next())
+			{
+				sd_spi_read_continuous_stop();
+				return TEFS_ERR_READ;
+			}
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+			tefs_record_device_op(TEFS_TRACE_READ, TEFS_FILE_REGION(file), device_page, volume->page_size, TEFS_ERR_OK, start_time);
+#endif
+
+			page_buffer += volume->page_size;
+		}
+
+		if (sd_spi_read_continuous_stop())
+		{
+			return TEFS_ERR_READ;
+		}
+#else
+		for (; current_page < end_page; current_page++, device_page++)
+		{
+			TEFS_SET_DEVICE_REGION(TEFS_FILE_REGION(file));
+
+			if (device_read(device_page, page_buffer, volume->page_size, 0))
+			{
+				return TEFS_ERR_READ;
+			}
+
+			page_buffer += volume->page_size;
+		}
+#endif
+
+#if defined(TEFS_EXTENT_SUPPORT)
+		/* The last block that was read becomes the current data block. */
+		if ((response = tefs_find_data_block(file, end_page - 1, 0)))
+		{
+			return response;
+		}
+#endif
+
+		/* Keep the current page in the current data block. */
+		file->current_page_number = end_page - 1;
+	}
+
+	return TEFS_ERR_OK;
+}
+
+#if defined(TEFS_CONTINUOUS_SUPPORT)
+int8_t
+tefs_read_continuous_start(
+	file_t 		*file,
+	uint32_t 	start_file_page_address
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (is_read_write_continuous)
+	{
+		return TEFS_ERR_READ;
+	}
+
+	/* Update file size if necessary. */
+	if (file->consistency_policy == TEFS_CONSISTENCY_PAGE && !file->is_file_size_consistent)
+	{
+		int8_t response;
+		if ((response = tefs_update_file_size(file)))
+		{
+			return response;
+		}
+	}
+
+	if (start_file_page_address > file->eof_page)
+	{
+		return TEFS_ERR_EOF;
+	}
+
+	/* Write out the buffer so that the card has the latest data. */
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	is_read_write_continuous = 2;
+	is_continuous_block_open = 0;
+	continuous_page_address = start_file_page_address;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_read_continuous(
+	file_t 		*file,
+	void 		*buffer,
+	uint16_t 	number_of_bytes,
+	uint16_t 	byte_offset
+)
+{
+	int8_t response;
+
+	if (is_read_write_continuous != 2)
+	{
+		return TEFS_ERR_READ;
+	}
+
+	if (continuous_page_address == file->eof_page)
+	{
+		if (byte_offset + number_of_bytes > file->eof_byte)
+		{
+			return TEFS_ERR_EOF;
+		}
+	}
+	else if (continuous_page_address > file->eof_page)
+	{
+		return TEFS_ERR_EOF;
+	}
+
+	if (!is_continuous_block_open && (response = tefs_open_continuous_block(file)))
+	{
+		return response;
+	}
+
+	if (sd_spi_read_continuous(buffer, number_of_bytes, byte_offset))
+	{
+		return TEFS_ERR_READ;
+	}
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_read_continuous_next(
+	file_t *file
+)
+{
+	if (is_read_write_continuous != 2)
+	{
+		return TEFS_ERR_READ;
+	}
+
+	if (is_continuous_block_open)
+	{
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+		uint32_t start_time = TEFS_TRACE_TIME();
+#endif
+
+		if (sd_spi_read_continuous_next())
+		{
+			return TEFS_ERR_READ;
+		}
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+		/* The page is counted once the sequence has moved past it. */
+		tefs_record_device_op(TEFS_TRACE_READ, TEFS_FILE_REGION(file),
+							  file->data_block_address + MOD_BY_POW_2(continuous_page_address, volume->block_size),
+							  volume->page_size, TEFS_ERR_OK, start_time);
+#endif
+
+		file->current_page_number = continuous_page_address;
+	}
+
+	continuous_page_address++;
+
+	/* The index blocks are read before the sequence for the next data block
+	   is started. */
+	if (is_continuous_block_open && MOD_BY_POW_2(continuous_page_address, volume->block_size) == 0)
+	{
+		is_continuous_block_open = 0;
+
+		if (sd_spi_read_continuous_stop())
+		{
+			return TEFS_ERR_READ;
+		}
+	}
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_read_continuous_stop(
+	file_t *file
+)
+{
+	if (is_read_write_continuous != 2)
+	{
+		return TEFS_ERR_READ;
+	}
+
+	is_read_write_continuous = 0;
+
+	if (is_continuous_block_open)
+	{
+		is_continuous_block_open = 0;
+
+		if (sd_spi_read_continuous_stop())
+		{
+			return TEFS_ERR_READ;
+		}
+	}
+
+	return TEFS_ERR_OK;
+}
+#endif
+
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+int8_t
+tefs_map_page(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint8_t		**page_data
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	/* The page can only be mapped if it fits in the page cache. One slot is
+	   always left unmapped for the other pages that are accessed. */
+	if (volume->page_size > TEFS_PAGE_CACHE_PAGE_SIZE || page_cache_mapped_count >= TEFS_PAGE_CACHE_SIZE - 1)
+	{
+		return TEFS_ERR_PAGE_NOT_MAPPED;
+	}
+
+	if (file_page_address > file->eof_page)
+	{
+		return TEFS_ERR_WRITE_PAST_END;
+	}
+
+	/* The data block is allocated when the first page of a new block is
+	   mapped (unless it was allocated when the page was mapped before or it
+	   was preallocated). */
+	uint8_t is_new_block = file_page_address == file->eof_page && file->eof_byte == 0 &&
+						   file_page_address > 0 && MOD_BY_POW_2(file_page_address, volume->block_size) == 0 &&
+						   DIV_BY_POW_2_EXP(file_page_address, volume->block_size_exponent) >= file->number_of_allocated_blocks;
+
+	int8_t response;
+	if ((response = tefs_find_data_block(file, file_page_address, is_new_block)))
+	{
+		return response;
+	}
+
+	/* The last page of the file does not need to be read from the card if
+	   nothing has been written to it yet. */
+	uint8_t slot;
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+	uint32_t start_time = TEFS_TRACE_TIME();
+#endif
+
+	if ((response = tefs_cache_load_page(file->data_block_address + MOD_BY_POW_2(file_page_address, volume->block_size),
+										 file_page_address == file->eof_page && file->eof_byte == 0, &slot)))
+	{
+		return response;
+	}
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+	/* Mapping a page is counted as a read of the whole page. */
+	tefs_record_device_op(TEFS_TRACE_READ, TEFS_FILE_REGION(file),
+						  file->data_block_address + MOD_BY_POW_2(file_page_address, volume->block_size),
+						  volume->page_size, TEFS_ERR_OK, start_time);
+#endif
+
+	if (!page_cache_is_mapped[slot])
+	{
+		page_cache_is_mapped[slot] = 1;
+		page_cache_mapped_count++;
+	}
+
+	file->current_page_number = file_page_address;
+	*page_data = page_cache[slot];
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_commit_page(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (file_page_address == file->eof_page && byte_offset > file->eof_byte)
+	{
+		return TEFS_ERR_WRITE_PAST_END;
+	}
+
+	int8_t response;
+	uint8_t slot;
+
+	if ((response = tefs_cache_find_mapped_page(file, file_page_address, &slot)))
+	{
+		return response;
+	}
+
+	if (number_of_bytes > 0)
+	{
+		page_cache_is_dirty[slot] = 1;
+
+		if (file_page_address == file->eof_page && (response = tefs_extend_file(file, byte_offset + number_of_bytes)))
+		{
+			return response;
+		}
+	}
+
+	page_cache_is_mapped[slot] = 0;
+	page_cache_mapped_count--;
+
+	if (number_of_bytes > 0)
+	{
+		return tefs_apply_consistency_policy(file, file_page_address);
+	}
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_unmap_page(
+	file_t		*file,
+	uint32_t	file_page_address
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	int8_t response;
+	uint8_t slot;
+
+	if ((response = tefs_cache_find_mapped_page(file, file_page_address, &slot)))
+	{
+		return response;
+	}
+
+	page_cache_is_mapped[slot] = 0;
+	page_cache_mapped_count--;
+
+	return TEFS_ERR_OK;
+}
+#endif
+
+#if defined(TEFS_ASYNC_QUEUE_SIZE)
+int8_t
+tefs_write_async(
+	file_t		*file,
+	uint32_t	file_page_address,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset,
+	uint8_t		*request
+)
+{
+	return tefs_queue_async(file, file_page_address, data, number_of_bytes, byte_offset, 1, request);
+}
+
+int8_t
+tefs_read_async(
+	file_t		*file,
+	uint32_t	file_page_address,
+	void		*buffer,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset,
+	uint8_t		*request
+)
+{
+	return tefs_queue_async(file, file_page_address, buffer, number_of_bytes, byte_offset, 0, request);
+}
+
+uint8_t
+tefs_process_async(
+	void
+)
+{
+	TEFS_LOCK_QUEUE();
+
+	/* Only one request is carried out at a time so that they are done in
+	   order. */
+	if (is_async_processing || async_state[async_head] != TEFS_ASYNC_QUEUED)
+	{
+		TEFS_UNLOCK_QUEUE();
+		return 0;
+	}
+
+	uint8_t slot = async_head;
+	is_async_processing = 1;
+
+	TEFS_UNLOCK_QUEUE();
+
+	/* The queue is not locked while the device is used so that requests can
+	   be added in the meantime. */
+	int8_t response;
+
+	TEFS_LOCK_DEVICE();
+
+	if (async_is_write[slot])
+	{
+		response = tefs_write(async_file[slot], async_page[slot], async_data[slot],
+							  async_number_of_bytes[slot], async_byte_offset[slot]);
+	}
+	else
+	{
+		response = tefs_read(async_file[slot], async_page[slot], async_data[slot],
+							 async_number_of_bytes[slot], async_byte_offset[slot]);
+	}
+
+	TEFS_UNLOCK_DEVICE();
+
+	TEFS_LOCK_QUEUE();
+
+	async_response[slot] = response;
+	async_state[slot] = TEFS_ASYNC_COMPLETE;
+	async_head = (async_head + 1) % TEFS_ASYNC_QUEUE_SIZE;
+	is_async_processing = 0;
+
+	TEFS_UNLOCK_QUEUE();
+
+	return 1;
+}
+
+uint8_t
+tefs_poll_async(
+	uint8_t request
+)
+{
+	return async_state[request] == TEFS_ASYNC_COMPLETE;
+}
+
+int8_t
+tefs_complete_async(
+	uint8_t request
+)
+{
+	/* Carry out the requests up to this one if nothing else is (a request
+	   that is being carried out by another thread is waited for). */
+	while (async_state[request] == TEFS_ASYNC_QUEUED)
+	{
+		tefs_process_async();
+	}
+
+	TEFS_LOCK_QUEUE();
+
+	int8_t response = async_response[request];
+	async_state[request] = TEFS_ASYNC_FREE;
+
+	TEFS_UNLOCK_QUEUE();
+
+	return response;
+}
+#endif
+
+int8_t
+tefs_set_consistency(
+	file_t 		*file,
+	uint8_t		policy,
+	uint16_t	group_pages,
+	uint32_t	group_milliseconds
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (!file->is_file_size_consistent)
+	{
+		int8_t response;
+		if ((response = tefs_update_file_size(file)))
+		{
+			return response;
+		}
+	}
+
+	file->consistency_policy = policy;
+	file->group_commit_pages = group_pages;
+	file->group_commit_interval = group_milliseconds;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_fallocate(
+	file_t 		*file,
+	uint32_t 	number_of_pages,
+	uint8_t		erase_blocks
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	uint32_t number_of_blocks = DIV_BY_POW_2_EXP(number_of_pages + volume->block_size - 1, volume->block_size_exponent);
+
+	/* The blocks past the first child index block can only be added once the
+	   root index block has been created. */
+	if (file->eof_page < MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent) &&
+		number_of_blocks > volume->addresses_per_block)
+	{
+		number_of_blocks = volume->addresses_per_block;
+	}
+
+	/* The current data block is restored after the new blocks are added. */
+	uint32_t data_block_address = file->data_block_address;
+	uint32_t data_block_number = file->data_block_number;
+	uint32_t child_index_block_address = file->child_index_block_address;
+	int8_t response = TEFS_ERR_OK;
+
+	/* Contiguous new blocks are erased together as one run. */
+	uint32_t erase_address = 0;
+	uint32_t erase_length = 0;
+
+	while (file->number_of_allocated_blocks < number_of_blocks)
+	{
+		if ((response = tefs_find_data_block(file, MULT_BY_POW_2_EXP(file->number_of_allocated_blocks, volume->block_size_exponent), 1)))
+		{
+			break;
+		}
+
+		if (!erase_blocks)
+		{
+			continue;
+		}
+
+		if (erase_length > 0 &&
+			file->data_block_address != erase_address + MULT_BY_POW_2_EXP(erase_length, volume->block_size_exponent))
+		{
+			if ((response = tefs_erase_block(erase_address, erase_length)))
+			{
+				break;
+			}
+
+			erase_length = 0;
+		}
+
+		if (erase_length == 0)
+		{
+			erase_address = file->data_block_address;
+		}
+
+		erase_length++;
+	}
+
+	if (response == TEFS_ERR_OK && erase_length > 0)
+	{
+		response = tefs_erase_block(erase_address, erase_length);
+	}
+
+	file->data_block_address = data_block_address;
+	file->data_block_number = data_block_number;
+	file->child_index_block_address = child_index_block_address;
+
+	return response;
+}
+
+int8_t
+tefs_truncate(
+	file_t 		*file,
+	uint32_t 	eof_page,
+	uint16_t	eof_byte
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (eof_byte >= volume->page_size || eof_page > file->eof_page ||
+		(eof_page == file->eof_page && eof_byte > file->eof_byte))
+	{
+		return TEFS_ERR_EOF;
+	}
+
+	uint32_t number_of_blocks = tefs_count_file_blocks(eof_page, eof_byte);
+
+	if (number_of_blocks < file->first_block_number)
+	{
+		return TEFS_ERR_PAGE_RELEASED;
+	}
+
+	int8_t response;
+
+#if defined(TEFS_INDEX_CACHE_SIZE)
+	/* The cached addresses may be in child index blocks that are released. */
+	if ((response = tefs_write_index_cache(file)))
+	{
+		return response;
+	}
+
+	file->index_cache_page = 0;
+#endif
+
+	if ((response = tefs_release_blocks_past(file, number_of_blocks)))
+	{
+		return response;
+	}
+
+#if defined(TEFS_INDEX_CACHE_SIZE)
+	file->index_cache_page = 0;
+#endif
+
+	/* The root index block is released if the file fits in its first child
+	   index block again. The child index block then takes its place. */
+	uint32_t root_index_page = MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent);
+
+	if (file->eof_page >= root_index_page && eof_page < root_index_page)
+	{
+		uint32_t child_index_block_address = 0;
+		if (device_read(file->root_index_block_address, &child_index_block_address, volume->address_size, 0))
+		{
+			return TEFS_ERR_READ;
+		}
+
+		if ((response = tefs_release_device_block(file->root_index_block_address)))
+		{
+			return response;
+		}
+
+		file->root_index_block_address = child_index_block_address;
+
+		if (file->directory_page != 0xFFFFFFFF &&
+			(response = tefs_write(&volume->metadata, file->directory_page, &(file->root_index_block_address), volume->address_size,
+								   file->directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE + TEFS_DIR_EOF_BYTE_SIZE)))
+		{
+			return response;
+		}
+	}
+
+	file->eof_page = eof_page;
+	file->eof_byte = eof_byte;
+
+	if ((response = tefs_find_last_data_block(file)))
+	{
+		return response;
+	}
+
+	return tefs_update_file_size(file);
+}
+
+int8_t
+tefs_drop_head(
+	file_t 		*file,
+	uint32_t 	file_page_address
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (file_page_address > file->eof_page)
+	{
+		return TEFS_ERR_EOF;
+	}
+
+	/* Only the whole blocks before the page are released. */
+	uint32_t end_block_number = DIV_BY_POW_2_EXP(file_page_address, volume->block_size_exponent);
+
+	if (end_block_number <= file->first_block_number)
+	{
+		return TEFS_ERR_OK;
+	}
+
+	int8_t response;
+
+#if defined(TEFS_INDEX_CACHE_SIZE)
+	/* The child index blocks are changed on the device directly. */
+	if ((response = tefs_write_index_cache(file)))
+	{
+		return response;
+	}
+
+	file->index_cache_page = 0;
+#endif
+
+	uint8_t has_root_index = file->eof_page >= MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent);
+	uint32_t deleted_address = TEFS_DELETED;
+	uint32_t block_number = file->first_block_number;
+	uint8_t index_buffer[TEFS_SCAN_BUFFER_SIZE];
+
+	while (block_number < end_block_number)
+	{
+		uint16_t page_in_root_index;
+		uint16_t byte_in_root_index_page;
+		tefs_map_page_to_root_index_address(MULT_BY_POW_2_EXP(block_number, volume->block_size_exponent),
+											&page_in_root_index, &byte_in_root_index_page);
+
+		uint32_t child_index_block_address = file->root_index_block_address;
+
+		if (has_root_index && device_read(file->root_index_block_address + page_in_root_index,
+										  &child_index_block_address, volume->address_size,
+										  byte_in_root_index_page))
+		{
+			return TEFS_ERR_READ;
+		}
+
+		/* A child index block is released once all of its blocks are (unless
+		   the file has no root index and it is stored in its place). */
+		uint32_t child_end_block_number = MULT_BY_POW_2_EXP(DIV_BY_POW_2_EXP(block_number, volume->addresses_per_block_exponent) + 1,
+															volume->addresses_per_block_exponent);
+		uint8_t is_child_released = has_root_index && child_end_block_number <= end_block_number;
+
+		if (child_end_block_number > end_block_number)
+		{
+			child_end_block_number = end_block_number;
+		}
+
+		/* Release the data blocks and mark their addresses as deleted. The
+		   addresses are read in pieces of up to a page. Child index blocks
+		   that have already been released are skipped. */
+		while (child_index_block_address != TEFS_DELETED && block_number < child_end_block_number)
+		{
+			uint16_t page_in_child_index;
+			uint16_t byte_in_child_index_page;
+			tefs_map_page_to_child_index_address(MULT_BY_POW_2_EXP(block_number, volume->block_size_exponent),
+												 &page_in_child_index, &byte_in_child_index_page);
+
+			uint32_t number_of_bytes = volume->page_size - byte_in_child_index_page;
+
+			if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+			{
+				number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+			}
+
+			if (number_of_bytes > MULT_BY_POW_2_EXP(child_end_block_number - block_number, volume->address_size_exponent))
+			{
+				number_of_bytes = MULT_BY_POW_2_EXP(child_end_block_number - block_number, volume->address_size_exponent);
+			}
+
+			if (device_read(child_index_block_address + page_in_child_index,
+							index_buffer, (uint16_t) number_of_bytes, byte_in_child_index_page))
+			{
+				return TEFS_ERR_READ;
+			}
+
+			uint16_t i;
+			for (i = 0; i < number_of_bytes; i += volume->address_size)
+			{
+				uint32_t data_block_address = 0;
+				memcpy(&data_block_address, index_buffer + i, volume->address_size);
+
+				if ((response = tefs_queue_block_release(data_block_address)))
+				{
+					return response;
+				}
+
+				memcpy(index_buffer + i, &deleted_address, volume->address_size);
+			}
+
+			if (!is_child_released && device_write(child_index_block_address + page_in_child_index,
+												   index_buffer, (uint16_t) number_of_bytes, byte_in_child_index_page))
+			{
+				return TEFS_ERR_WRITE;
+			}
+
+			block_number += DIV_BY_POW_2_EXP(number_of_bytes, volume->address_size_exponent);
+		}
+
+		if (is_child_released && child_index_block_address != TEFS_DELETED)
+		{
+			if ((response = tefs_queue_block_release(child_index_block_address)))
+			{
+				return response;
+			}
+
+			if (device_write(file->root_index_block_address + page_in_root_index,
+							 &deleted_address, volume->address_size, byte_in_root_index_page))
+			{
+				return TEFS_ERR_WRITE;
+			}
+		}
+
+		block_number = child_end_block_number;
+	}
+
+	file->first_block_number = end_block_number;
+
+#if defined(TEFS_EXTENT_SUPPORT)
+	/* The extent starts at the first block of the file. */
+	file->extent_length = 0;
+	file->is_extent_ended = 1;
+#endif
+
+	if ((response = tefs_release_queued_blocks()))
+	{
+		return response;
+	}
+
+	/* Find the current data block again if it was released. */
+	if (file->data_block_number < end_block_number || file->data_block_number == 0xFFFFFFFF)
+	{
+		return tefs_find_last_data_block(file);
+	}
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_release_block(
+	file_t 		*file,
+	uint32_t 	file_block_address
+)
+{
+	/* Switch to the volume that the file is on. */
+	if (file->volume != volume && tefs_use_volume(file->volume))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	uint16_t child_block_number = (uint16_t) DIV_BY_POW_2_EXP(file_block_address, volume->addresses_per_block_exponent);
+	uint16_t page_in_root_index = DIV_BY_POW_2_EXP(child_block_number, volume->page_size_exponent - volume->address_size_exponent);
+	uint16_t byte_in_root_index_page = (uint16_t) (MULT_BY_POW_2_EXP(child_block_number, volume->address_size_exponent) & (volume->page_size - 1));
+
+	uint32_t block_in_child_index = DIV_BY_POW_2_EXP(file_block_address, volume->block_size_exponent) & (volume->addresses_per_block - 1);
+	uint16_t page_in_child_index = (uint16_t) DIV_BY_POW_2_EXP(block_in_child_index, volume->page_size_exponent - volume->address_size_exponent);
+	uint16_t byte_in_child_index_page = (uint16_t) (MULT_BY_POW_2_EXP(block_in_child_index, volume->address_size_exponent) & (volume->page_size - 1));
+
+#if defined(TEFS_INDEX_CACHE_SIZE)
+	/* The child index block is changed on the device directly. */
+	int8_t cache_response;
+	if ((cache_response = tefs_write_index_cache(file)))
+	{
+		return cache_response;
+	}
+
+	file->index_cache_page = 0;
+#endif
+
+#if defined(TEFS_EXTENT_SUPPORT)
+	/* The extent ends before the block that is released. */
+	if (file_block_address < file->extent_length)
+	{
+		file->extent_length = file_block_address;
+		file->is_extent_ended = 1;
+	}
+#endif
+
+	if (file_block_address != file->data_block_number || file->child_index_block_address == 0)
+	{
+		/* Check if the block is in the same child index block. If not, get the
+		   address from the root index block. */
+		if (DIV_BY_POW_2_EXP(file->data_block_number, volume->addresses_per_block_exponent) !=
+			child_block_number || file->child_index_block_address == 0)
+		{
+			if (device_read(file->root_index_block_address + page_in_root_index,
+							&(file->child_index_block_address), volume->address_size,
+							byte_in_root_index_page))
+			{
+				return TEFS_ERR_READ;
+			}
+
+			if (file->child_index_block_address == TEFS_EMPTY ||
+				file->child_index_block_address == TEFS_DELETED)
+			{
+				return TEFS_ERR_UNRELEASED_BLOCK;
+			}
+		}
+
+		/* Get the data block from the child index block. */
+		if (device_read(file->child_index_block_address + page_in_child_index,
+						&(file->data_block_address), volume->address_size,
+						byte_in_child_index_page))
+		{
+			return TEFS_ERR_READ;
+		}
+
+		if (file->data_block_address == TEFS_EMPTY ||
+			file->data_block_address == TEFS_DELETED)
+		{
+			return TEFS_ERR_UNRELEASED_BLOCK;
+		}
+
+		file->data_block_number = file_block_address;
+	}
+
+	/* Release block. */
+	int8_t response;
+
+	if ((response = tefs_release_device_block(file->data_block_address)))
+	{
+		return response;
+	}
+
+	/* Remove the address from the child index block. */
+	uint8_t byte_buffer = TEFS_DELETED;
+
+	if (device_write(file->child_index_block_address + page_in_child_index,
+					 &byte_buffer, 1, byte_in_child_index_page))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	byte_buffer = 0;
+	uint8_t current_byte = 1;
+
+	while (current_byte < volume->address_size)
+	{
+		if (device_write(file->child_index_block_address + page_in_child_index,
+						 &byte_buffer, 1,
+						 byte_in_child_index_page + current_byte))
+		{
+			return TEFS_ERR_WRITE;
+		}
+
+		current_byte++;
+	}
+
+	uint8_t contains_blocks = 0;
+
+	/* Scan child index block to see if it's tefs_empty. */
+	for (page_in_child_index = 0;
+		 page_in_child_index < volume->block_size && !contains_blocks;
+		 page_in_child_index++)
+	{
+		for (byte_in_child_index_page = 0;
+			 byte_in_child_index_page < volume->page_size && !contains_blocks;
+			 byte_in_child_index_page++)
+		{
+			if (device_read(file->child_index_block_address + page_in_child_index,
+							&byte_buffer, 1, byte_in_child_index_page))
+			{
+				return TEFS_ERR_READ;
+			}
+
+			if (byte_buffer != TEFS_DELETED && byte_buffer != TEFS_EMPTY)
+			{
+				contains_blocks = 1;
+			}
+		}
+	}
+
+	/* Remove child index block from root index block if it's tefs_empty. */
+	if (!contains_blocks)
+	{
+		byte_buffer = TEFS_DELETED;
+
+		if (device_write(file->root_index_block_address + page_in_root_index, &byte_buffer,
+						 1, byte_in_root_index_page))
+		{
+			return TEFS_ERR_WRITE;
+		}
+
+		byte_buffer = 0;
+		current_byte = 1;
+
+		while (current_byte < volume->address_size)
+		{
+			if (device_write(file->root_index_block_address + page_in_root_index,
+							 &byte_buffer, 1, byte_in_root_index_page + current_byte))
+			{
+				return TEFS_ERR_WRITE;
+			}
+
+			current_byte++;
+		}
+
+		if ((response = tefs_release_device_block(file->child_index_block_address)))
+		{
+			return response;
+		}
+	}
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_find_file_directory_entry(
+	char 		*file_name,
+	uint32_t 	*dir_page_address,
+	uint16_t 	*dir_byte_in_page,
+	uint8_t 	file_operation
+)
+{
+	uint32_t name_hash_value = hash_string(file_name);
+	uint16_t small_name_hash = (uint16_t) name_hash_value;
+
+	uint8_t hash_size_exponent = volume->hash_size_exponent;
+	uint32_t number_of_entries = DIV_BY_POW_2_EXP(MULT_BY_POW_2_EXP(volume->hash_entries.eof_page, volume->page_size_exponent) +
+												  volume->hash_entries.eof_byte, hash_size_exponent);
+	uint32_t deleted_entry_number = 0xFFFFFFFF;
+	uint32_t entry_number = 0;
+
+	uint16_t hash_page_address;
+	uint16_t hash_byte_in_page;
+
+	*dir_page_address = 0;
+	*dir_byte_in_page = 0;
+
+	int8_t response;
+
+#if defined(TEFS_HASH_INDEX_SIZE)
+	/* Look through the hashes that are in memory before scanning the rest of
+	   the hash entries file on the device. */
+	for (entry_number = 0; entry_number < volume->hash_index_count; entry_number++)
+	{
+		if (volume->hash_index[entry_number] == name_hash_value)
+		{
+			if ((response = tefs_check_directory_entry(file_name, entry_number, file_operation, dir_page_address,
+													   dir_byte_in_page)) != TEFS_ERR_FILE_NOT_FOUND)
+			{
+				TEFS_RECORD_LOOKUP(entry_number + 1);
+				return response;
+			}
+		}
+		else if (file_operation == 1 && volume->hash_index[entry_number] == 0 && deleted_entry_number == 0xFFFFFFFF)
+		{
+			/* Found a deleted entry. */
+			deleted_entry_number = entry_number;
+		}
+	}
+#endif
+
+	/* Scan the rest of the hash entries file. As many hashes as fit into the
+	   buffer are read from a page at once and then compared in memory. */
+	uint32_t hash_buffer[TEFS_SCAN_BUFFER_SIZE / 4];
+
+	while (entry_number < number_of_entries)
+	{
+		tefs_map_directory_entry(entry_number, &hash_page_address, &hash_byte_in_page, dir_page_address, dir_byte_in_page);
+
+		uint16_t number_of_hashes = DIV_BY_POW_2_EXP(volume->page_size - hash_byte_in_page, hash_size_exponent);
+
+		if (number_of_hashes > DIV_BY_POW_2_EXP(TEFS_SCAN_BUFFER_SIZE, hash_size_exponent))
+		{
+			number_of_hashes = DIV_BY_POW_2_EXP(TEFS_SCAN_BUFFER_SIZE, hash_size_exponent);
+		}
+
+		if (number_of_hashes > number_of_entries - entry_number)
+		{
+			number_of_hashes = (uint16_t) (number_of_entries - entry_number);
+		}
+
+		if ((response = tefs_read(&volume->hash_entries, hash_page_address, hash_buffer,
+								  MULT_BY_POW_2_EXP(number_of_hashes, hash_size_exponent), hash_byte_in_page)))
+		{
+			return response;
+		}
+
+		uint16_t current_hash = 0;
+
+		while ((current_hash = tefs_scan_hashes(hash_buffer, current_hash, number_of_hashes, name_hash_value,
+												file_operation == 1 && deleted_entry_number == 0xFFFFFFFF)) < number_of_hashes)
+		{
+			uint32_t entry_hash_value = (volume->hash_size == 4) ? hash_buffer[current_hash] :
+														   ((uint16_t *) hash_buffer)[current_hash];
+
+			if (entry_hash_value == name_hash_value)	/* Found file hash */
+			{
+				if ((response = tefs_check_directory_entry(file_name, entry_number + current_hash, file_operation,
+														   dir_page_address, dir_byte_in_page)) != TEFS_ERR_FILE_NOT_FOUND)
+				{
+					TEFS_RECORD_LOOKUP(entry_number + current_hash + 1);
+					return response;
+				}
+			}
+			else	/* Found a deleted entry. */
+			{
+				deleted_entry_number = entry_number + current_hash;
+			}
+
+			current_hash++;
+		}
+
+		entry_number += number_of_hashes;
+	}
+
+	/* Reached the end of the hash entries file. */
+	TEFS_RECORD_LOOKUP(number_of_entries);
+
+	if (file_operation == 1)    /* Create file */
+	{
+		if (deleted_entry_number != 0xFFFFFFFF)
+		{
+			entry_number = deleted_entry_number;
+		}
+
+		tefs_map_directory_entry(entry_number, &hash_page_address, &hash_byte_in_page, dir_page_address, dir_byte_in_page);
+
+		/* Write out hash value to hash entries file. */
+		if ((response = tefs_write(&volume->hash_entries, hash_page_address,
+								   (volume->hash_size == 4) ? (void *) &name_hash_value : (void *) &small_name_hash, volume->hash_size,
+								   hash_byte_in_page)))
+		{
+			return response;
+		}
+
+#if defined(TEFS_HASH_INDEX_SIZE)
+		/* Add the hash to the index. */
+		if (entry_number < TEFS_HASH_INDEX_SIZE && entry_number <= volume->hash_index_count)
+		{
+			volume->hash_index[entry_number] = name_hash_value;
+
+			if (entry_number == volume->hash_index_count)
+			{
+				volume->hash_index_count++;
+			}
+		}
+#endif
+
+		return TEFS_NEW_FILE;
+	}
+
+	return TEFS_ERR_FILE_NOT_FOUND;
+}
+
+static int8_t
+tefs_check_directory_entry(
+	char		*file_name,
+	uint32_t	entry_number,
+	uint8_t		file_operation,
+	uint32_t	*dir_page_address,
+	uint16_t	*dir_byte_in_page
+)
+{
+	int8_t response;
+	uint16_t hash_page_address;
+	uint16_t hash_byte_in_page;
+
+	tefs_map_directory_entry(entry_number, &hash_page_address, &hash_byte_in_page, dir_page_address, dir_byte_in_page);
+
+#if defined(TEFS_STATS)
+	volume->stats.lookup_name_compares++;
+#endif
+
+	/* Check if it is the actual file by comparing file names. */
+	if ((response = tefs_compare_file_name(file_name, *dir_page_address, *dir_byte_in_page)))
+	{
+		return response;
+	}
+
+	if (file_operation == 2)	/* Remove file */
+	{
+		uint32_t entry_hash_value = 0;
+		if ((response = tefs_write(&volume->hash_entries, hash_page_address, &entry_hash_value, volume->hash_size, hash_byte_in_page)))
+		{
+			return response;
+		}
+
+#if defined(TEFS_HASH_INDEX_SIZE)
+		if (entry_number < volume->hash_index_count)
+		{
+			volume->hash_index[entry_number] = 0;
+		}
+#endif
+	}
+
+	return TEFS_ERR_OK;
+}
+
+static uint16_t
+tefs_scan_hashes(
+	void		*hashes,
+	uint16_t	start,
+	uint16_t	number_of_hashes,
+	uint32_t	hash,
+	uint8_t		find_empty
+)
+{
+	uint16_t current_hash = start;
+
+	if (volume->hash_size == 4)
+	{
+		uint32_t *hashes_32 = (uint32_t *) hashes;
+
+#if defined(__SSE2__)
+		/* Compare four hashes at a time. */
+		__m128i hash_vector = _mm_set1_epi32((int32_t) hash);
+		__m128i empty_vector = find_empty ? _mm_setzero_si128() : hash_vector;
+
+		for (; current_hash + 4 <= number_of_hashes; current_hash += 4)
+		{
+			__m128i entries = _mm_loadu_si128((__m128i *) (hashes_32 + current_hash));
+
+			if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi32(entries, hash_vector),
+											   _mm_cmpeq_epi32(entries, empty_vector))))
+			{
+				break;
+			}
+		}
+#endif
+
+		for (; current_hash < number_of_hashes; current_hash++)
+		{
+			if (hashes_32[current_hash] == hash || (find_empty && hashes_32[current_hash] == 0))
+			{
+				break;
+			}
+		}
+	}
+	else
+	{
+		uint16_t *hashes_16 = (uint16_t *) hashes;
+
+#if defined(__SSE2__)
+		/* Compare eight hashes at a time. */
+		__m128i hash_vector = _mm_set1_epi16((int16_t) hash);
+		__m128i empty_vector = find_empty ? _mm_setzero_si128() : hash_vector;
+
+		for (; current_hash + 8 <= number_of_hashes; current_hash += 8)
+		{
+			__m128i entries = _mm_loadu_si128((__m128i *) (hashes_16 + current_hash));
+
+			if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(entries, hash_vector),
+											   _mm_cmpeq_epi16(entries, empty_vector))))
+			{
+				break;
+			}
+		}
+#endif
+
+		for (; current_hash < number_of_hashes; current_hash++)
+		{
+			if (hashes_16[current_hash] == hash || (find_empty && hashes_16[current_hash] == 0))
+			{
+				break;
+			}
+		}
+	}
+
+	return current_hash;
+}
+
+static int8_t
+tefs_compare_file_name(
+	char		*file_name,
+	uint32_t	dir_page_address,
+	uint16_t	dir_byte_in_page
+)
+{
+	int8_t response;
+	char name_buffer[16];
+	uint16_t current_char = 0;
+
+	/* Read the name from the directory entry in pieces and compare it with
+	   the given name. The stored name is padded with null chars. */
+	while (current_char < volume->max_file_name_size)
+	{
+		uint16_t chunk_size = volume->max_file_name_size - current_char;
+
+		if (chunk_size > sizeof(name_buffer))
+		{
+			chunk_size = sizeof(name_buffer);
+		}
+
+		if ((response = tefs_read(&volume->metadata, dir_page_address, name_buffer, chunk_size,
+								  dir_byte_in_page + TEFS_DIR_STATIC_DATA_SIZE + current_char)))
+		{
+			return response;
+		}
+
+		uint16_t i;
+		for (i = 0; i < chunk_size; i++, current_char++)
+		{
+			if (name_buffer[i] != file_name[current_char])
+			{
+				return TEFS_ERR_FILE_NOT_FOUND;
+			}
+
+			if (file_name[current_char] == '\0')
+			{
+				return TEFS_ERR_OK;
+			}
+		}
+	}
+
+	return (file_name[current_char] == '\0') ? TEFS_ERR_OK : TEFS_ERR_FILE_NOT_FOUND;
+}
+
+static void
+tefs_map_directory_entry(
+	uint32_t	entry_number,
+	uint16_t	*hash_page_address,
+	uint16_t	*hash_byte_in_page,
+	uint32_t	*dir_page_address,
+	uint16_t	*dir_byte_in_page
+)
+{
+	uint32_t hash_byte = entry_number * volume->hash_size;
+	uint32_t dir_byte = entry_number * volume->metadata_size;
+
+	*hash_page_address = (uint16_t) DIV_BY_POW_2_EXP(hash_byte, volume->page_size_exponent);
+	*hash_byte_in_page = (uint16_t) MOD_BY_POW_2(hash_byte, volume->page_size);
+	*dir_page_address = DIV_BY_POW_2_EXP(dir_byte, volume->page_size_exponent);
+	*dir_byte_in_page = (uint16_t) MOD_BY_POW_2(dir_byte, volume->page_size);
+}
+
+#if defined(TEFS_HASH_INDEX_SIZE)
+static int8_t
+tefs_build_hash_index(
+	void
+)
+{
+	int8_t response;
+	uint8_t hash_size_exponent = volume->hash_size_exponent;
+	uint32_t number_of_entries = DIV_BY_POW_2_EXP(MULT_BY_POW_2_EXP(volume->hash_entries.eof_page, volume->page_size_exponent) +
+												  volume->hash_entries.eof_byte, hash_size_exponent);
+	uint32_t hash_buffer[TEFS_SCAN_BUFFER_SIZE / 4];
+
+	if (number_of_entries > TEFS_HASH_INDEX_SIZE)
+	{
+		number_of_entries = TEFS_HASH_INDEX_SIZE;
+	}
+
+	volume->hash_index_count = 0;
+
+	while (volume->hash_index_count < number_of_entries)
+	{
+		uint16_t hash_page_address;
+		uint16_t hash_byte_in_page;
+		uint32_t dir_page_address;
+		uint16_t dir_byte_in_page;
+
+		tefs_map_directory_entry(volume->hash_index_count, &hash_page_address, &hash_byte_in_page, &dir_page_address,
+								 &dir_byte_in_page);
+
+		uint16_t number_of_hashes = DIV_BY_POW_2_EXP(volume->page_size - hash_byte_in_page, hash_size_exponent);
+
+		if (number_of_hashes > DIV_BY_POW_2_EXP(TEFS_SCAN_BUFFER_SIZE, hash_size_exponent))
+		{
+			number_of_hashes = DIV_BY_POW_2_EXP(TEFS_SCAN_BUFFER_SIZE, hash_size_exponent);
+		}
+
+		if (number_of_hashes > number_of_entries - volume->hash_index_count)
+		{
+			number_of_hashes = (uint16_t) (number_of_entries - volume->hash_index_count);
+		}
+
+		if ((response = tefs_read(&volume->hash_entries, hash_page_address, hash_buffer,
+								  MULT_BY_POW_2_EXP(number_of_hashes, hash_size_exponent), hash_byte_in_page)))
+		{
+			return response;
+		}
+
+		uint16_t current_hash;
+		for (current_hash = 0; current_hash < number_of_hashes; current_hash++)
+		{
+			volume->hash_index[volume->hash_index_count++] = (volume->hash_size == 4) ? hash_buffer[current_hash] :
+																((uint16_t *) hash_buffer)[current_hash];
+		}
+	}
+
+	return TEFS_ERR_OK;
+}
+#endif
+
+static int8_t
+tefs_write_metadata(
+	file_t		file,
+	void		*data,
+	uint16_t 	number_of_byte
+)
+{
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_reserve_device_blocks(
+	uint32_t	*block_addresses,
+	uint8_t		number_of_blocks,
+	uint32_t	near_block,
+	uint8_t		*number_reserved
+)
+{
+	*number_reserved = 0;
+
+#if defined(USE_SD)
+	int8_t response;
+
+#if defined(TEFS_LAZY_FREE_QUEUE_SIZE)
+	/* Release the blocks of removed files before running out of blocks. */
+	if (volume->is_block_pool_empty && volume->lazy_free_count > 0)
+	{
+		if ((response = tefs_idle()))
+		{
+			return response;
+		}
+	}
+#endif
+
+	if (volume->is_block_pool_empty)
+	{
+		return TEFS_ERR_DEVICE_FULL;
+	}
+
+	uint8_t policy = (volume->allocation_policy == TEFS_ALLOCATE_DEFAULT) ? TEFS_DEFAULT_ALLOCATION_POLICY :
+					 volume->allocation_policy;
+
+	if (policy != TEFS_ALLOCATE_LOWEST)
+	{
+		uint32_t first_block_address = 1 + volume->state_section_size;
+		uint32_t search_bit = volume->allocation_cursor;
+
+		if (policy == TEFS_ALLOCATE_NEAR_FILE && near_block >= first_block_address)
+		{
+			search_bit = DIV_BY_POW_2_EXP(near_block - first_block_address, volume->block_size_exponent) + 1;
+		}
+
+		while (*number_reserved < number_of_blocks)
+		{
+			uint32_t state_bit;
+			uint32_t length;
+
+			if ((response = tefs_find_free_run(search_bit, number_of_blocks - *number_reserved,
+											   policy != TEFS_ALLOCATE_ROUND_ROBIN, &state_bit, &length)))
+			{
+				return response;
+			}
+
+			/* The device is full. */
+			if (length == 0)
+			{
+				break;
+			}
+
+			/* Toggle the state bits of the blocks from 1 to 0. */
+			if ((response = tefs_set_state_bits(state_bit, length, 0)))
+			{
+				return response;
+			}
+
+			tefs_remove_free_extent(state_bit, length);
+
+			search_bit = state_bit + length;
+			volume->allocation_cursor = search_bit;
+
+			for (; length > 0; length--, state_bit++)
+			{
+				block_addresses[(*number_reserved)++] = MULT_BY_POW_2_EXP(state_bit, volume->block_size_exponent) + first_block_address;
+			}
+		}
+	}
+
+	while (*number_reserved < number_of_blocks)
+	{
+		if (volume->free_extent_count == 0)
+		{
+			if ((response = tefs_scan_state_section()))
+			{
+				return response;
+			}
+
+			if (volume->free_extent_count == 0)
+			{
+				break;
+			}
+		}
+
+		/* Take the blocks from the lowest extent that has room for all of the
+		   remaining blocks or from the lowest extent if none of them do. */
+		uint8_t number_remaining = number_of_blocks - *number_reserved;
+		uint8_t position = 0;
+
+		while (position < volume->free_extent_count && volume->free_extent_length[position] < number_remaining)
+		{
+			position++;
+		}
+
+		if (position == volume->free_extent_count)
+		{
+			position = 0;
+		}
+
+		uint32_t state_bit = volume->free_extent_start[position];
+		uint32_t length = volume->free_extent_length[position];
+
+		if (length > number_remaining)
+		{
+			length = number_remaining;
+		}
+
+		/* Toggle the state bits of the blocks from 1 to 0. */
+		if ((response = tefs_set_state_bits(state_bit, length, 0)))
+		{
+			return response;
+		}
+
+		volume->free_extent_start[position] += length;
+		volume->free_extent_length[position] -= length;
+
+		if (volume->free_extent_length[position] == 0)
+		{
+			volume->free_extent_count--;
+
+			for (; position < volume->free_extent_count; position++)
+			{
+				volume->free_extent_start[position] = volume->free_extent_start[position + 1];
+				volume->free_extent_length[position] = volume->free_extent_length[position + 1];
+			}
+		}
+
+		for (; length > 0; length--, state_bit++)
+		{
+			block_addresses[(*number_reserved)++] =
+				MULT_BY_POW_2_EXP(state_bit, volume->block_size_exponent) + (1 + volume->state_section_size);
+		}
+	}
+
+	/* Find the next unreserved block. */
+	if ((response = tefs_find_next_empty_block(&volume->state_section_bit)))
+	{
+		return response;
+	}
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (*number_reserved == 0)
+	{
+		return TEFS_ERR_DEVICE_FULL;
+	}
+#elif defined(USE_DATAFLASH) && defined(USE_FTL)
+	/* Reserve pages on FTL. */
+	for (; *number_reserved < number_of_blocks; (*number_reserved)++)
+	{
+		if (volume->block_size == 1)
+		{
+			flare_logical_page_t p;
+			flare_GetPage(&ftl, &p);
+		}
+		else if (volume->block_size == 2)
+		{
+
+		}
+	}
+#endif
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_reserve_file_block(
+	file_t		*file,
+	uint32_t	*block_address
+)
+{
+	if (file->number_of_reserved_blocks == 0)
+	{
+		int8_t response;
+		uint8_t number_of_blocks = (file->directory_page == 0xFFFFFFFF) ? 1 : TEFS_RESERVE_AHEAD_SIZE;
+
+		/* The blocks are reserved near the current data block of the file (or
+		   its index block if it has no data blocks yet). */
+		uint32_t near_block = (file->data_block_address > TEFS_DELETED) ? file->data_block_address :
+							  file->child_index_block_address;
+
+		if ((response = tefs_reserve_device_blocks(file->reserved_blocks, number_of_blocks, near_block,
+												   &(file->number_of_reserved_blocks))))
+		{
+			return response;
+		}
+
+		file->next_reserved_block = 0;
+	}
+
+	*block_address = file->reserved_blocks[file->next_reserved_block++];
+	file->number_of_reserved_blocks--;
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_release_reserved_blocks(
+	file_t *file
+)
+{
+	if (file->number_of_reserved_blocks == 0)
+	{
+		return TEFS_ERR_OK;
+	}
+
+	while (file->number_of_reserved_blocks > 0)
+	{
+		int8_t response;
+		if ((response = tefs_queue_block_release(file->reserved_blocks[file->next_reserved_block])))
+		{
+			return response;
+		}
+
+		file->next_reserved_block++;
+		file->number_of_reserved_blocks--;
+	}
+
+	return tefs_release_queued_blocks();
+}
+
+static int8_t
+tefs_release_blocks_past(
+	file_t		*file,
+	uint32_t	number_of_blocks
+)
+{
+	if (file->number_of_allocated_blocks <= number_of_blocks)
+	{
+		return TEFS_ERR_OK;
+	}
+
+#if defined(TEFS_EXTENT_SUPPORT)
+	/* The blocks are looked up in the index since the child index blocks
+	   that they are in are needed as well. The blocks after the file are not
+	   allocated once they are released. */
+	uint8_t is_extent_ended = file->is_extent_ended && file->extent_length < number_of_blocks;
+
+	if (file->extent_length > number_of_blocks)
+	{
+		file->extent_length = number_of_blocks;
+	}
+
+	file->is_extent_ended = 1;
+#endif
+
+	/* The current page is not kept in the current data block. */
+	file->current_page_number = 0xFFFFFFFF;
+
+	uint32_t block_number;
+
+	for (block_number = number_of_blocks; block_number < file->number_of_allocated_blocks; block_number++)
+	{
+		int8_t response;
+		if ((response = tefs_find_data_block(file, MULT_BY_POW_2_EXP(block_number, volume->block_size_exponent), 0)))
+		{
+			return response;
+		}
+
+		if ((response = tefs_queue_block_release(file->data_block_address)))
+		{
+			return response;
+		}
+
+		/* The child index blocks that start past the blocks that are kept are
+		   not needed anymore. */
+		if (MOD_BY_POW_2(block_number, volume->addresses_per_block) == 0)
+		{
+			if ((response = tefs_queue_block_release(file->child_index_block_address)))
+			{
+				return response;
+			}
+		}
+	}
+
+	file->number_of_allocated_blocks = number_of_blocks;
+#if defined(TEFS_EXTENT_SUPPORT)
+	file->is_extent_ended = is_extent_ended;
+#endif
+
+	return tefs_release_queued_blocks();
+}
+
+static int8_t
+tefs_release_device_block(
+	uint32_t block_address
+)
+{
+	int8_t response;
+
+	if ((response = tefs_queue_block_release(block_address)))
+	{
+		return response;
+	}
+
+	return tefs_release_queued_blocks();
+}
+
+static int8_t
+tefs_queue_block_release(
+	uint32_t block_address
+)
+{
+#if defined(USE_SD)
+	/* Skip addresses that are not data blocks. These are in the index blocks
+	   of a file for blocks that were released with tefs_release_block. */
+	if (block_address < 1 + volume->state_section_size)
+	{
+		return TEFS_ERR_OK;
+	}
+
+	/* Bit in the state section that is correlated to the block address. */
+	uint32_t state_bit = DIV_BY_POW_2_EXP(block_address - (1 + volume->state_section_size), volume->block_size_exponent);
+
+	if (state_bit >= MULT_BY_POW_2_EXP(volume->state_section_size, volume->page_size_exponent + 3))
+	{
+		return TEFS_ERR_OK;
+	}
+
+	/* Add the block to the last run if it comes right after it. */
+	if (volume->release_run_count > 0 &&
+		volume->release_run_start[volume->release_run_count - 1] + volume->release_run_length[volume->release_run_count - 1] == state_bit)
+	{
+		volume->release_run_length[volume->release_run_count - 1]++;
+		return TEFS_ERR_OK;
+	}
+
+	if (volume->release_run_count == TEFS_RELEASE_BUFFER_SIZE)
+	{
+		int8_t response;
+		if ((response = tefs_write_released_blocks()))
+		{
+			return response;
+		}
+	}
+
+	volume->release_run_start[volume->release_run_count] = state_bit;
+	volume->release_run_length[volume->release_run_count] = 1;
+	volume->release_run_count++;
+#elif defined(USE_DATAFLASH) && defined(USE_FTL)
+	/* Release block from FTL. */
+	if (volume->block_size == 1)
+	{
+		flare_ReturnPage(&ftl, block_address);
+	}
+	else if (volume->block_size == 8)
+	{
+
+	}
+#endif
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_release_queued_blocks(
+	void
+)
+{
+#if defined(USE_SD)
+	int8_t response;
+
+	if ((response = tefs_write_released_blocks()))
+	{
+		return response;
+	}
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+#endif
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_release_file_blocks(
+	uint32_t	root_index_block_address,
+	uint32_t	eof_page,
+	uint16_t	eof_byte
+)
+{
+	int8_t response;
+
+	/* The last data block is the one with the last byte of the file. An empty
+	   file still has its first data block. */
+	uint32_t number_of_data_blocks = DIV_BY_POW_2_EXP((eof_byte == 0 && eof_page > 0) ? eof_page - 1 : eof_page,
+													  volume->block_size_exponent) + 1;
+	uint8_t has_root_index = eof_page >= MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent);
+	uint32_t child_block_number = 0;
+	uint32_t data_block_number = 0;
+	uint8_t index_buffer[TEFS_SCAN_BUFFER_SIZE];
+
+	while (data_block_number < number_of_data_blocks)
+	{
+		uint32_t child_index_block_address = 0;
+
+		if (has_root_index)
+		{
+			if (device_read(root_index_block_address + DIV_BY_POW_2_EXP(child_block_number, volume->page_size_exponent - volume->address_size_exponent),
+							&child_index_block_address, volume->address_size,
+							(uint16_t) MOD_BY_POW_2(MULT_BY_POW_2_EXP(child_block_number, volume->address_size_exponent), volume->page_size)))
+			{
+				return TEFS_ERR_READ;
+			}
+		}
+		else
+		{
+			child_index_block_address = root_index_block_address;
+		}
+
+		uint32_t number_of_addresses = number_of_data_blocks - data_block_number;
+
+		if (number_of_addresses > volume->addresses_per_block)
+		{
+			number_of_addresses = volume->addresses_per_block;
+		}
+
+		/* Release the data blocks in the child index block. The addresses are
+		   read in pieces of up to a page. */
+		uint32_t current_address = 0;
+
+		while (current_address < number_of_addresses &&
+			   child_index_block_address != TEFS_EMPTY && child_index_block_address != TEFS_DELETED)
+		{
+			uint32_t byte_in_block = MULT_BY_POW_2_EXP(current_address, volume->address_size_exponent);
+			uint16_t current_byte = (uint16_t) MOD_BY_POW_2(byte_in_block, volume->page_size);
+			uint32_t number_of_bytes = volume->page_size - current_byte;
+
+			if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+			{
+				number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+			}
+
+			if (number_of_bytes > MULT_BY_POW_2_EXP(number_of_addresses - current_address, volume->address_size_exponent))
+			{
+				number_of_bytes = MULT_BY_POW_2_EXP(number_of_addresses - current_address, volume->address_size_exponent);
+			}
+
+			if (device_read(child_index_block_address + DIV_BY_POW_2_EXP(byte_in_block, volume->page_size_exponent),
+							index_buffer, (uint16_t) number_of_bytes, current_byte))
+			{
+				return TEFS_ERR_READ;
+			}
+
+			uint16_t i;
+			for (i = 0; i < number_of_bytes; i += volume->address_size)
+			{
+				uint32_t data_block_address = 0;
+				memcpy(&data_block_address, index_buffer + i, volume->address_size);
+
+				if ((response = tefs_queue_block_release(data_block_address)))
+				{
+					return response;
+				}
+			}
+
+			current_address += DIV_BY_POW_2_EXP(number_of_bytes, volume->address_size_exponent);
+		}
+
+		/* Release child index block. */
+		if ((response = tefs_queue_block_release(child_index_block_address)))
+		{
+			return response;
+		}
+
+		data_block_number += number_of_addresses;
+		child_block_number++;
+	}
+
+	if (has_root_index)
+	{
+		/* Release root index block. */
+		if ((response = tefs_queue_block_release(root_index_block_address)))
+		{
+			return response;
+		}
+	}
+
+	return tefs_release_queued_blocks();
+}
+
+static int8_t
+tefs_fill_pages(
+	uint32_t	start_page,
+	uint32_t	number_of_pages,
+	uint8_t		value
+)
+{
+	uint8_t fill_buffer[TEFS_SCAN_BUFFER_SIZE];
+	uint32_t current_page;
+
+	memset(fill_buffer, value, TEFS_SCAN_BUFFER_SIZE);
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+	/* The region that the caller set is used for every page. */
+	uint8_t region = device_region;
+#endif
+
+#if defined(TEFS_PAGE_CACHE_SIZE)
+	/* The pages are written without going through the cache. */
+	tefs_cache_invalidate(start_page, start_page + number_of_pages);
+#endif
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+#if defined(USE_SD) && !defined(TEFS_DEVICE_BACKEND)
+	if (sd_spi_write_continuous_start(start_page, number_of_pages))
+	{
+		return TEFS_ERR_WRITE;
+	}
+#endif
+
+	for (current_page = start_page;
+		 current_page < start_page + number_of_pages;
+		 current_page++)
+	{
+		uint16_t current_byte;
+#if (defined(TEFS_STATS) || defined(TEFS_TRACE)) && defined(USE_SD)
+		uint32_t start_time = TEFS_TRACE_TIME();
+#endif
+
+		for (current_byte = 0;
+			 current_byte < volume->page_size;
+			 current_byte += TEFS_SCAN_BUFFER_SIZE)
+		{
+			uint16_t number_of_bytes = volume->page_size - current_byte;
+
+			if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+			{
+				number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+			}
+
+#if defined(TEFS_DEVICE_BACKEND)
+			/* The page is not read in since all of it is filled. */
+			sd_spi_dirty_write = 1;
+			int8_t response = device_raw_write(current_page, fill_buffer, number_of_bytes, current_byte);
+			sd_spi_dirty_write = 0;
+
+			if (response)
+			{
+				return response;
+			}
+#elif defined(USE_SD)
+			if (sd_spi_write_continuous(fill_buffer, number_of_bytes, current_byte))
+			{
+				return TEFS_ERR_WRITE;
+			}
+#else
+			TEFS_SET_DEVICE_REGION(region);
+
+			if (device_write(current_page, fill_buffer, number_of_bytes, current_byte))
+			{
+				return TEFS_ERR_WRITE;
+			}
+#endif
+		}
+
+#if defined(USE_SD) && !defined(TEFS_DEVICE_BACKEND)
+		if (sd_spi_write_continuous_next())
+		{
+			return TEFS_ERR_WRITE;
+		}
+#endif
+
+#if (defined(TEFS_STATS) || defined(TEFS_TRACE)) && defined(USE_SD)
+		/* Each page that is filled is counted as one write. */
+		tefs_record_device_op(TEFS_TRACE_WRITE, region, current_page, volume->page_size, TEFS_ERR_OK, start_time);
+#endif
+	}
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+	device_region = TEFS_REGION_INDEX;
+#endif
+
+#if defined(USE_SD) && !defined(TEFS_DEVICE_BACKEND)
+	if (sd_spi_write_continuous_stop())
+	{
+		return TEFS_ERR_WRITE;
+	}
+#endif
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_erase_block(
+	uint32_t block_address,
+	uint32_t number_of_blocks
+)
+{
+	uint32_t number_of_pages = MULT_BY_POW_2_EXP(number_of_blocks, volume->block_size_exponent);
+
+#if defined(USE_SD) && defined(TEFS_NATIVE_ERASE)
+#if defined(TEFS_PAGE_CACHE_SIZE)
+	/* The pages are erased without going through the cache. */
+	tefs_cache_invalidate(block_address, block_address + number_of_pages);
+#endif
+
+	if (device_flush())
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	if (device_raw_erase(block_address, block_address + number_of_pages - 1))
+	{
+		return TEFS_ERR_ERASE;
+	}
+
+	return TEFS_ERR_OK;
+#else
+	TEFS_SET_DEVICE_REGION(TEFS_REGION_DATA);
+
+	return tefs_fill_pages(block_address, number_of_pages, TEFS_EMPTY);
+#endif
+}
+
+#if defined(USE_SD)
+static int8_t
+tefs_find_next_empty_block(
+	uint32_t *state_section_bit
+)
+{
+	if (volume->free_extent_count == 0)
+	{
+		int8_t response;
+		if ((response = tefs_scan_state_section()))
+		{
+			return response;
+		}
+
+		if (volume->free_extent_count == 0)
+		{
+			volume->is_block_pool_empty = 1;
+			return TEFS_ERR_OK;
+		}
+	}
+
+	*state_section_bit = volume->free_extent_start[0];
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_scan_state_section(
+	void
+)
+{
+	uint32_t number_of_bits = MULT_BY_POW_2_EXP(volume->state_section_size, volume->page_size_exponent + 3);
+	uint8_t state_buffer[TEFS_SCAN_BUFFER_SIZE];
+
+	while (volume->free_extent_scan_bit < number_of_bits)
+	{
+		/* Read from the word that has the scan bit up to the end of the page
+		   or until the buffer is full. */
+		uint32_t start_byte = DIV_BY_POW_2_EXP(volume->free_extent_scan_bit, 3) & ~((uint32_t) 3);
+		uint32_t current_page = DIV_BY_POW_2_EXP(start_byte, volume->page_size_exponent);
+		uint16_t current_byte = (uint16_t) MOD_BY_POW_2(start_byte, volume->page_size);
+		uint16_t number_of_bytes = volume->page_size - current_byte;
+
+		if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+		{
+			number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+		}
+
+		if (device_read(current_page + TEFS_INFO_SECTION_SIZE, state_buffer, number_of_bytes, current_byte))
+		{
+			return TEFS_ERR_READ;
+		}
+
+		uint16_t current_word;
+		for (current_word = 0; current_word < number_of_bytes; current_word += 4)
+		{
+			/* The first block of a byte is its most significant bit. */
+			uint32_t word = ((uint32_t) state_buffer[current_word] << 24) |
+							((uint32_t) state_buffer[current_word + 1] << 16) |
+							((uint32_t) state_buffer[current_word + 2] << 8) |
+							(uint32_t) state_buffer[current_word + 3];
+			uint32_t word_bit = MULT_BY_POW_2_EXP(start_byte + current_word, 3);
+
+			/* Ignore the bits that have already been scanned. */
+			if (volume->free_extent_scan_bit > word_bit)
+			{
+				word &= 0xFFFFFFFF >> (volume->free_extent_scan_bit - word_bit);
+			}
+
+			while (word)
+			{
+				uint8_t free_bit = tefs_count_leading_zeros(word);
+				uint32_t inverted_word = ~(word << free_bit);
+				uint8_t run_length = (inverted_word == 0) ? 32 : tefs_count_leading_zeros(inverted_word);
 
-#if defined(USE_SD)
-	/* Calculate the state section size. */
-	/* TODO: Get the number of bits instead of bytes */
-	//uint32_t state_section_size_in_bits = ((format_info->number_of_pages - info_section_size) - 1) / (format_info->block_size) + 1;
-	uint32_t state_section_size_in_bytes =
-		DIV_BY_POW_2_EXP(num_pages - TEFS_INFO_SECTION_SIZE, block_size_exponent + 3);
+				if (!tefs_add_free_extent(word_bit + free_bit, run_length))
+				{
+					volume->free_extent_scan_bit = word_bit + free_bit;
+					return TEFS_ERR_OK;
+				}
 
-	state_section_size = DIV_BY_POW_2_EXP(state_section_size_in_bytes - 1, page_size_exponent) + 1;
-#endif
+				word = (free_bit + run_length >= 32) ? 0 : word & (0xFFFFFFFF >> (free_bit + run_length));
+			}
+		}
 
-#if defined(USE_DATAFLASH) && defined(USE_FTL)
-	/* Reserve the pages required for the info page, and directory. */
-	uint32_t i;
-	for (i = 0; i < TEFS_INFO_SECTION_SIZE + directory_size; i++)
+		volume->free_extent_scan_bit = MULT_BY_POW_2_EXP(start_byte + number_of_bytes, 3);
+
+		if (volume->free_extent_count > 0)
+		{
+			break;
+		}
+	}
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_find_free_run(
+	uint32_t	start_bit,
+	uint32_t	number_of_blocks,
+	uint8_t		is_fit,
+	uint32_t	*run_start,
+	uint32_t	*run_length
+)
+{
+	uint32_t number_of_bits = MULT_BY_POW_2_EXP(volume->state_section_size, volume->page_size_exponent + 3);
+	uint8_t state_buffer[TEFS_SCAN_BUFFER_SIZE];
+
+	/* The run that is being measured and the first run that was too short. */
+	uint32_t current_start = 0;
+	uint32_t current_length = 0;
+	uint32_t short_start = 0;
+	uint32_t short_length = 0;
+	uint32_t short_scanned_bits = 0;
+	uint32_t scanned_bits = 0;
+
+	if (start_bit >= number_of_bits)
 	{
-		flare_logical_page_t p;
-		flare_GetPage(&ftl, &p);
+		start_bit = 0;
 	}
-#endif
 
-	uint16_t current_byte = 0;
-	uint8_t data = 0;
+	/* The bits from the start bit to the end are searched first and then the
+	   bits before the start bit. */
+	uint32_t current_bit = start_bit;
+	uint32_t end_bit = number_of_bits;
+	uint8_t has_wrapped = 0;
 
-	/* Fill the info block with zeros first. */
-	for (current_byte = 0; current_byte < physical_page_size; current_byte++)
+	for (;;)
 	{
-		if (device_write(0, &data, 1, current_byte))
+		if (current_bit >= end_bit)
 		{
-			return TEFS_ERR_WRITE;
+			/* A run does not continue from the end of the state section to
+			   its start. */
+			if (current_length > 0)
+			{
+				if (!is_fit)
+				{
+					break;
+				}
+
+				if (short_length == 0)
+				{
+					short_start = current_start;
+					short_length = current_length;
+					short_scanned_bits = scanned_bits;
+				}
+
+				current_length = 0;
+			}
+
+			if (has_wrapped || start_bit == 0)
+			{
+				break;
+			}
+
+			has_wrapped = 1;
+			current_bit = 0;
+			end_bit = start_bit;
+		}
+
+		/* Use the short run if no run with room for all of the blocks is
+		   close to it. */
+		if (short_length > 0 && scanned_bits - short_scanned_bits >= MULT_BY_POW_2_EXP(TEFS_SCAN_BUFFER_SIZE, 3))
+		{
+			break;
+		}
+
+		/* Read from the word that has the current bit up to the end of the
+		   page or until the buffer is full. */
+		uint32_t start_byte = DIV_BY_POW_2_EXP(current_bit, 3) & ~((uint32_t) 3);
+		uint32_t current_page = DIV_BY_POW_2_EXP(start_byte, volume->page_size_exponent);
+		uint16_t current_byte = (uint16_t) MOD_BY_POW_2(start_byte, volume->page_size);
+		uint16_t number_of_bytes = volume->page_size - current_byte;
+
+		if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+		{
+			number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+		}
+
+		if (device_read(current_page + TEFS_INFO_SECTION_SIZE, state_buffer, number_of_bytes, current_byte))
+		{
+			return TEFS_ERR_READ;
+		}
+
+		uint16_t current_word;
+		for (current_word = 0; current_word < number_of_bytes; current_word += 4)
+		{
+			uint32_t word = ((uint32_t) state_buffer[current_word] << 24) |
+							((uint32_t) state_buffer[current_word + 1] << 16) |
+							((uint32_t) state_buffer[current_word + 2] << 8) |
+							(uint32_t) state_buffer[current_word + 3];
+			uint32_t word_bit = MULT_BY_POW_2_EXP(start_byte + current_word, 3);
+
+			if (word_bit >= end_bit)
+			{
+				break;
+			}
+
+			/* Ignore the bits before the current bit and from the end bit. */
+			if (current_bit > word_bit)
+			{
+				word &= 0xFFFFFFFF >> (current_bit - word_bit);
+			}
+
+			if (end_bit < word_bit + 32)
+			{
+				word &= ~(0xFFFFFFFF >> (end_bit - word_bit));
+			}
+
+			while (word)
+			{
+				uint8_t free_bit = tefs_count_leading_zeros(word);
+				uint32_t inverted_word = ~(word << free_bit);
+				uint8_t length_in_word = (inverted_word == 0) ? 32 : tefs_count_leading_zeros(inverted_word);
+
+				if (current_length > 0 && current_start + current_length != word_bit + free_bit)
+				{
+					/* The run that was being measured has ended. */
+					if (!is_fit)
+					{
+						*run_start = current_start;
+						*run_length = current_length;
+
+						return TEFS_ERR_OK;
+					}
+
+					if (short_length == 0)
+					{
+						short_start = current_start;
+						short_length = current_length;
+						short_scanned_bits = scanned_bits;
+					}
+
+					current_length = 0;
+				}
+
+				if (current_length == 0)
+				{
+					current_start = word_bit + free_bit;
+				}
+
+				current_length += length_in_word;
+
+				if (current_length >= number_of_blocks)
+				{
+					*run_start = current_start;
+					*run_length = number_of_blocks;
+
+					return TEFS_ERR_OK;
+				}
+
+				word = (free_bit + length_in_word >= 32) ? 0 : word & (0xFFFFFFFF >> (free_bit + length_in_word));
+			}
 		}
+
+		uint32_t next_bit = MULT_BY_POW_2_EXP(start_byte + number_of_bytes, 3);
+		scanned_bits += next_bit - current_bit;
+		current_bit = next_bit;
+	}
+
+	if (current_length > 0 && !is_fit)
+	{
+		*run_start = current_start;
+		*run_length = current_length;
+	}
+	else
+	{
+		*run_start = short_start;
+		*run_length = short_length;
 	}
 
-	data = TEFS_CHECK_FLAG;
+	return TEFS_ERR_OK;
+}
 
-	/* Write the check flag. */
-	for (current_byte = 0; current_byte < 4; current_byte++)
+static void
+tefs_remove_free_extent(
+	uint32_t state_bit,
+	uint32_t length
+)
+{
+	uint32_t end_bit = state_bit + length;
+	uint8_t position = 0;
+
+	while (position < volume->free_extent_count)
 	{
-		if (device_write(0, &data, 1, current_byte))
+		uint32_t extent_start = volume->free_extent_start[position];
+		uint32_t extent_end = extent_start + volume->free_extent_length[position];
+
+		if (extent_end <= state_bit || extent_start >= end_bit)
+		{
+			position++;
+		}
+		else if (extent_start >= state_bit && extent_end <= end_bit)
+		{
+			/* All of the extent has been reserved. */
+			volume->free_extent_count--;
+
+			uint8_t i;
+			for (i = position; i < volume->free_extent_count; i++)
+			{
+				volume->free_extent_start[i] = volume->free_extent_start[i + 1];
+				volume->free_extent_length[i] = volume->free_extent_length[i + 1];
+			}
+		}
+		else if (extent_start >= state_bit)
+		{
+			volume->free_extent_start[position] = end_bit;
+			volume->free_extent_length[position] = extent_end - end_bit;
+			position++;
+		}
+		else if (extent_end <= end_bit)
+		{
+			volume->free_extent_length[position] = state_bit - extent_start;
+			position++;
+		}
+		else
+		{
+			/* The blocks are in the middle of the extent. The blocks after
+			   them are put into their own extent. */
+			volume->free_extent_length[position] = state_bit - extent_start;
+
+			if (!tefs_add_free_extent(end_bit, extent_end - end_bit))
+			{
+				if (position == volume->free_extent_count - 1)
+				{
+					volume->free_extent_scan_bit = end_bit;
+				}
+				else
+				{
+					volume->free_extent_count--;
+					volume->free_extent_scan_bit = volume->free_extent_start[volume->free_extent_count];
+					tefs_add_free_extent(end_bit, extent_end - end_bit);
+				}
+			}
+
+			return;
+		}
+	}
+}
+
+static int8_t
+tefs_set_state_bits(
+	uint32_t	state_bit,
+	uint32_t	length,
+	uint8_t		is_free
+)
+{
+	uint8_t state_buffer[TEFS_SCAN_BUFFER_SIZE];
+
+	/* Clear the free block hint and the used block count on the device before
+	   the first change to the state section since they were written out. The
+	   state section is counted again if power is lost before they are written
+	   out again. */
+	if (volume->is_free_space_written)
+	{
+		uint32_t free_space[2] = {0, 0};
+		if (device_write(0, free_space, 8, TEFS_INFO_FREE_SPACE_BYTE) || device_flush())
 		{
 			return TEFS_ERR_WRITE;
 		}
+
+		volume->is_free_space_written = 0;
 	}
 
-	/* Write the number of pages that the device has. */
-	if (device_write(0, &num_pages, 4, current_byte))
+	while (length > 0)
 	{
-		return TEFS_ERR_WRITE;
+		/* Read from the byte that has the first bit up to the byte that has the
+		   last bit, the end of the page, or until the buffer is full. */
+		uint32_t start_byte = DIV_BY_POW_2_EXP(state_bit, 3);
+		uint32_t current_page = DIV_BY_POW_2_EXP(start_byte, volume->page_size_exponent);
+		uint16_t current_byte = (uint16_t) MOD_BY_POW_2(start_byte, volume->page_size);
+		uint32_t number_of_bytes = DIV_BY_POW_2_EXP(state_bit + length - 1, 3) + 1 - start_byte;
+
+		if (number_of_bytes > (uint32_t) (volume->page_size - current_byte))
+		{
+			number_of_bytes = volume->page_size - current_byte;
+		}
+
+		if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+		{
+			number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+		}
+
+		if (device_read(current_page + TEFS_INFO_SECTION_SIZE, state_buffer, (uint16_t) number_of_bytes, current_byte))
+		{
+			return TEFS_ERR_READ;
+		}
+
+		uint32_t end_bit = MULT_BY_POW_2_EXP(start_byte + number_of_bytes, 3);
+
+		while (state_bit < end_bit && length > 0)
+		{
+			uint8_t *byte_buffer = &state_buffer[DIV_BY_POW_2_EXP(state_bit, 3) - start_byte];
+			uint8_t previous_byte = *byte_buffer;
+
+			if (MOD_BY_POW_2(state_bit, 8) == 0 && length >= 8)
+			{
+				*byte_buffer = is_free ? 0xFF : 0;
+				state_bit += 8;
+				length -= 8;
+			}
+			else
+			{
+				if (is_free)
+				{
+					*byte_buffer |= (uint8_t) POW_2_TO(7 - MOD_BY_POW_2(state_bit, 8));
+				}
+				else
+				{
+					*byte_buffer &= (uint8_t) ~POW_2_TO(7 - MOD_BY_POW_2(state_bit, 8));
+				}
+
+				state_bit++;
+				length--;
+			}
+
+			/* Only the bits that change are counted. */
+			if (volume->used_block_count != 0)
+			{
+				uint8_t changed_bits = previous_byte ^ *byte_buffer;
+
+				for (; changed_bits; changed_bits &= changed_bits - 1)
+				{
+					if (is_free)
+					{
+						volume->used_block_count--;
+					}
+					else
+					{
+						volume->used_block_count++;
+					}
+				}
+			}
+
+#if defined(TEFS_STATS)
+			uint8_t changed_stat_bits = previous_byte ^ *byte_buffer;
+
+			for (; changed_stat_bits; changed_stat_bits &= changed_stat_bits - 1)
+			{
+				if (is_free)
+				{
+					volume->stats.blocks_released++;
+				}
+				else
+				{
+					volume->stats.blocks_reserved++;
+				}
+			}
+#endif
+		}
+
+		if (device_write(current_page + TEFS_INFO_SECTION_SIZE, state_buffer, (uint16_t) number_of_bytes, current_byte))
+		{
+			return TEFS_ERR_WRITE;
+		}
 	}
 
-	current_byte += 4;
+	return TEFS_ERR_OK;
+}
 
-	/* Write the physical page size. */
-	if (device_write(0, &page_size_exponent, 1, current_byte))
+static int8_t
+tefs_write_released_blocks(
+	void
+)
+{
+	uint8_t i;
+	for (i = 0; i < volume->release_run_count; i++)
 	{
-		return TEFS_ERR_WRITE;
+		uint32_t state_bit = volume->release_run_start[i];
+		uint32_t length = volume->release_run_length[i];
+
+		/* Toggle the state bits of the blocks from 0 to 1. */
+		int8_t response;
+		if ((response = tefs_set_state_bits(state_bit, length, 1)))
+		{
+			return response;
+		}
+
+		/* Blocks past the scan bit are found by the next scan of the state
+		   section. */
+		if (state_bit >= volume->free_extent_scan_bit)
+		{
+			continue;
+		}
+
+		if (state_bit + length > volume->free_extent_scan_bit)
+		{
+			length = volume->free_extent_scan_bit - state_bit;
+		}
+
+		if (!tefs_add_free_extent(state_bit, length))
+		{
+			/* Make room by dropping the extent with the highest blocks from the
+			   cache. Its blocks are found again by the next scan. */
+			if (volume->free_extent_start[volume->free_extent_count - 1] > state_bit)
+			{
+				volume->free_extent_count--;
+				volume->free_extent_scan_bit = volume->free_extent_start[volume->free_extent_count];
+				tefs_add_free_extent(state_bit, length);
+			}
+			else
+			{
+				volume->free_extent_scan_bit = state_bit;
+			}
+		}
 	}
 
-	current_byte += 1;
+	if (volume->release_run_count > 0)
+	{
+		if (volume->free_extent_count > 0)
+		{
+			volume->state_section_bit = volume->free_extent_start[0];
+		}
 
-	/* Write the block size. */
-	if (device_write(0, &block_size_exponent, 1, current_byte))
+		volume->is_block_pool_empty = 0;
+		volume->release_run_count = 0;
+	}
+
+	return TEFS_ERR_OK;
+}
+
+static uint8_t
+tefs_add_free_extent(
+	uint32_t state_bit,
+	uint32_t length
+)
+{
+	/* Find the first extent that starts after the new extent. */
+	uint8_t position = 0;
+	while (position < volume->free_extent_count && volume->free_extent_start[position] < state_bit)
 	{
-		return TEFS_ERR_WRITE;
+		position++;
 	}
 
-	current_byte += 1;
+	uint8_t merge_before = position > 0 &&
+						   volume->free_extent_start[position - 1] + volume->free_extent_length[position - 1] == state_bit;
+	uint8_t merge_after = position < volume->free_extent_count && state_bit + length == volume->free_extent_start[position];
 
-	/* Write the address size. */
-	if (device_write(0, &address_size_exponent, 1, current_byte))
+	if (merge_before)
 	{
-		return TEFS_ERR_WRITE;
+		volume->free_extent_length[position - 1] += length;
+
+		if (merge_after)
+		{
+			volume->free_extent_length[position - 1] += volume->free_extent_length[position];
+			volume->free_extent_count--;
+
+			for (; position < volume->free_extent_count; position++)
+			{
+				volume->free_extent_start[position] = volume->free_extent_start[position + 1];
+				volume->free_extent_length[position] = volume->free_extent_length[position + 1];
+			}
+		}
+	}
+	else if (merge_after)
+	{
+		volume->free_extent_start[position] = state_bit;
+		volume->free_extent_length[position] += length;
 	}
+	else
+	{
+		if (volume->free_extent_count == TEFS_FREE_EXTENT_CACHE_SIZE)
+		{
+			return 0;
+		}
 
-	current_byte += 1;
+		uint8_t i;
+		for (i = volume->free_extent_count; i > position; i--)
+		{
+			volume->free_extent_start[i] = volume->free_extent_start[i - 1];
+			volume->free_extent_length[i] = volume->free_extent_length[i - 1];
+		}
 
-	/* Write the size of a hash value. */
-	if (device_write(0, &hash_size, 1, current_byte))
-	{
-		return TEFS_ERR_WRITE;
+		volume->free_extent_start[position] = state_bit;
+		volume->free_extent_length[position] = length;
+		volume->free_extent_count++;
 	}
 
-	current_byte += 1;
+	return 1;
+}
 
-	/* Write the size of a metadata record. */
-	if (device_write(0, &metadata_size, 2, current_byte))
-	{
-		return TEFS_ERR_WRITE;
-	}
+static uint8_t
+tefs_count_leading_zeros(
+	uint32_t word
+)
+{
+#if defined(__GNUC__) && __SIZEOF_INT__ == 4
+	return (uint8_t) __builtin_clz(word);
+#elif defined(__GNUC__) && __SIZEOF_LONG__ == 4
+	return (uint8_t) __builtin_clzl(word);
+#else
+	uint8_t count = 0;
 
-	current_byte += 2;
+	if (!(word & 0xFFFF0000)) { count += 16; word <<= 16; }
+	if (!(word & 0xFF000000)) { count += 8; word <<= 8; }
+	if (!(word & 0xF0000000)) { count += 4; word <<= 4; }
+	if (!(word & 0xC0000000)) { count += 2; word <<= 2; }
+	if (!(word & 0x80000000)) { count += 1; }
 
-	/* Write the max size for a file name. */
-	if (device_write(0, &max_file_name_size, 2, current_byte))
+	return count;
+#endif
+}
+
+static int8_t
+tefs_write_free_space(
+	void
+)
+{
+	if (volume->is_free_space_written || volume->used_block_count == 0)
 	{
-		return TEFS_ERR_WRITE;
+		return TEFS_ERR_OK;
 	}
 
-	current_byte += 2;
+	/* Every block before the hint is reserved. */
+	uint32_t free_space[3];
+	free_space[0] = (volume->free_extent_count > 0) ? volume->free_extent_start[0] : volume->free_extent_scan_bit;
+	free_space[1] = volume->used_block_count;
+	free_space[2] = volume->allocation_cursor;
 
-#if defined(USE_SD)
-	/* Write the state section size. */
-	if (device_write(0, &state_section_size, 4, current_byte))
+	if (device_flush() || device_write(0, free_space, 12, TEFS_INFO_FREE_SPACE_BYTE) || device_flush())
 	{
 		return TEFS_ERR_WRITE;
 	}
 
-	current_byte += 4;
-#endif
-
-	/* Write out the metadata for the hash entries file and meta data file. */
-	uint8_t i;
-	for (i = 0; i < 2; i++) {
-		int8_t response;
+	volume->is_free_space_written = 1;
 
-		/* Get the child index block address and the data block address for the file. */
-		uint32_t child_index_block_address = MULT_BY_POW_2_EXP((uint32_t) (i * 2), block_size_exponent) +
-												(1 + state_section_size);
-		uint32_t data_block_address = MULT_BY_POW_2_EXP((uint32_t) (i * 2 + 1), block_size_exponent) +
-										(1 + state_section_size);
+	return TEFS_ERR_OK;
+}
 
-		/* Set file size to 0 for hash file directory entry. */
-		uint32_t zero = 0;
-		if (device_write(0, &zero, TEFS_DIR_EOF_PAGE_SIZE, current_byte))
-		{
-			return TEFS_ERR_WRITE;
-		}
+static int8_t
+tefs_count_used_blocks(
+	void
+)
+{
+	uint8_t state_buffer[TEFS_SCAN_BUFFER_SIZE];
+	uint32_t number_of_bytes = DIV_BY_POW_2_EXP(volume->number_of_blocks, 3);
+	uint32_t number_of_free_blocks = 0;
+	uint32_t current_byte;
 
-		current_byte += TEFS_DIR_EOF_PAGE_SIZE;
+	for (current_byte = 0; current_byte < number_of_bytes; current_byte += TEFS_SCAN_BUFFER_SIZE)
+	{
+		/* Read up to the end of the page or until the buffer is full. */
+		uint16_t byte_in_page = (uint16_t) MOD_BY_POW_2(current_byte, volume->page_size);
+		uint16_t number_to_read = volume->page_size - byte_in_page;
 
-		if (device_write(0, &zero, TEFS_DIR_EOF_BYTE_SIZE, current_byte))
+		if (number_to_read > TEFS_SCAN_BUFFER_SIZE)
 		{
-			return TEFS_ERR_WRITE;
+			number_to_read = TEFS_SCAN_BUFFER_SIZE;
 		}
 
-		current_byte += TEFS_DIR_EOF_BYTE_SIZE;
-
-		/* Write root index block address to the information page. */
-		if (device_write(0, &child_index_block_address, address_size, current_byte))
+		if (number_to_read > number_of_bytes - current_byte)
 		{
-			return TEFS_ERR_WRITE;
+			number_to_read = (uint16_t) (number_of_bytes - current_byte);
 		}
 
-		current_byte += 4;
-
-		/* Write the first data block address to the beginning of the root index. */
-		if (device_write(child_index_block_address, &data_block_address, address_size, 0))
+		if (device_read(DIV_BY_POW_2_EXP(current_byte, volume->page_size_exponent) + TEFS_INFO_SECTION_SIZE,
+						state_buffer, number_to_read, byte_in_page))
 		{
-			return TEFS_ERR_WRITE;
+			return TEFS_ERR_READ;
 		}
-	}
 
-	/* Write out the state section. Set the first four bits as 0 since the */
-#if defined(USE_SD)
-	uint32_t current_page;
-	data = 0xFF;
-
-	for (current_page = TEFS_INFO_SECTION_SIZE;
-		 current_page < state_section_size + TEFS_INFO_SECTION_SIZE;
-		 current_page++)
-	{
-		for (current_byte = 0; 
-			 current_byte < physical_page_size;
-			 current_byte++)
+		uint16_t i;
+		for (i = 0; i < number_to_read; i++)
 		{
-			if (current_page == state_section_size && current_byte ==
-				MOD_BY_POW_2(state_section_size_in_bytes, POW_2_TO(page_size_exponent)))
-			{
-				data = 0;
-			}
+			uint8_t free_bits = state_buffer[i];
 
-			if (sd_spi_write(current_page, &data, 1, current_byte))
+			for (; free_bits; free_bits &= free_bits - 1)
 			{
-				return TEFS_ERR_WRITE;
+				number_of_free_blocks++;
 			}
 		}
 	}
 
-	data = 0x0F;
-	if (sd_spi_write(1, &data, 1, 0))
-	{
-		return TEFS_ERR_WRITE;
-	}
+	volume->used_block_count = volume->number_of_blocks - number_of_free_blocks;
+
+	return TEFS_ERR_OK;
+}
 #endif
 
-	if (device_flush())
-	{
-		return TEFS_ERR_WRITE;
-	}
+static void
+tefs_map_page_to_root_index_address(
+	uint32_t 	page,
+	uint16_t 	*page_in_root_index,
+	uint16_t 	*byte_in_root_index_page
+)
+{
+	uint32_t child_block_number = DIV_BY_POW_2_EXP(DIV_BY_POW_2_EXP(page, volume->block_size_exponent), volume->addresses_per_block_exponent);
 
-	/* Address size is set to 0 so that the data is loaded from the card into memory. */
-	address_size = 0;
+	*page_in_root_index = (uint16_t) DIV_BY_POW_2_EXP(child_block_number, volume->page_size_exponent - volume->address_size_exponent);
 
-	return TEFS_ERR_OK;
+	*byte_in_root_index_page = (uint16_t) MOD_BY_POW_2(MULT_BY_POW_2_EXP(child_block_number, volume->address_size_exponent), volume->page_size);
 }
 
-int8_t
-tefs_open(
-	file_t 		*file,
-	char 		*file_name
+static void
+tefs_map_page_to_child_index_address(
+	uint32_t 	page,
+	uint16_t 	*page_in_child_index,
+	uint16_t 	*byte_in_child_index_page
 )
 {
-	int8_t response;
-
-	/* Load the data from the information page if it has not been previously loaded. */
-	if (address_size == 0)
-	{
-		if ((response = tefs_load_card_data()))
-		{
-			return response;
-		}
-	}
+	uint32_t block_in_child_index = MOD_BY_POW_2(DIV_BY_POW_2_EXP(page, volume->block_size_exponent), volume->addresses_per_block);
 
-	/* Get the size of the file name. Return an error if it exceeds the max length. */
-	uint16_t file_name_size = 0;
-	while (file_name[file_name_size] != '\0')
-	{
-		file_name_size++;
-	}
+	*page_in_child_index = (uint16_t) DIV_BY_POW_2_EXP(block_in_child_index, volume->page_size_exponent - volume->address_size_exponent);
 
-	if (file_name_size > max_file_name_size)
-	{
-		return TEFS_ERR_FILE_NAME_TOO_LONG;
-	}
+	*byte_in_child_index_page = (uint16_t) MOD_BY_POW_2(MULT_BY_POW_2_EXP(block_in_child_index, volume->address_size_exponent), volume->page_size);
+}
 
-	if ((response = tefs_find_file_directory_entry(file_name, &(file->directory_page), &(file->directory_byte), 1)) !=
-		TEFS_NEW_FILE && response != TEFS_ERR_OK)
+static int8_t
+tefs_find_data_block(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint8_t		is_new_block
+)
+{
+	/* Check if page address is in the same block as the current data block. */
+	if (!is_new_block && (file_page_address == file->current_page_number ||
+		DIV_BY_POW_2_EXP(file_page_address, volume->block_size_exponent) == file->data_block_number))
 	{
-		return response;
+		return TEFS_ERR_OK;
 	}
 
-	file->root_index_block_address		= 0;
-	file->child_index_block_address		= 0;
-	file->data_block_address			= 0;
-
-	uint16_t meta_entry_byte = file->directory_byte;
+	uint32_t block_number = DIV_BY_POW_2_EXP(file_page_address, volume->block_size_exponent);
+	uint16_t child_block_number = (uint16_t) DIV_BY_POW_2_EXP(block_number, volume->addresses_per_block_exponent);
 
-	if (response == TEFS_NEW_FILE) /* Create a new file */
+#if defined(TEFS_EXTENT_SUPPORT)
+	/* The data blocks in the extent are found without the index. */
+	if (!is_new_block)
 	{
-		uint8_t zero = 0;
-
-		/* Write out zero to the status for now to avoid writing past the end of the file. */
-		if ((response = tefs_write(&metadata, file->directory_page, &zero, 1, meta_entry_byte)))
+		if (block_number >= file->extent_length && !file->is_extent_ended)
 		{
-			return response;
+			int8_t response;
+			if ((response = tefs_extend_extent(file, block_number)))
+			{
+				return response;
+			}
 		}
 
-		meta_entry_byte++;
-
-		/* Set file size to 0 for directory entry. */
-		file->eof_page = 0;
-		file->eof_byte = 0;
-		if ((response = tefs_write(&metadata, file->directory_page, &(file->eof_page),
-								   TEFS_DIR_EOF_PAGE_SIZE, meta_entry_byte)))
+		if (block_number < file->extent_length)
 		{
-			return response;
-		}
+			/* The child index block is looked up again when it is needed. */
+			if (DIV_BY_POW_2_EXP(file->data_block_number, volume->addresses_per_block_exponent) != child_block_number)
+			{
+				file->child_index_block_address = 0;
+			}
 
-		meta_entry_byte += TEFS_DIR_EOF_PAGE_SIZE;
+			file->data_block_address = file->extent_address + MULT_BY_POW_2_EXP(block_number, volume->block_size_exponent);
+			file->data_block_number = block_number;
 
-		if ((response = tefs_write(&metadata, file->directory_page, &(file->eof_byte),
-								   TEFS_DIR_EOF_BYTE_SIZE, meta_entry_byte)))
-		{
-			return response;
+			return TEFS_ERR_OK;
 		}
+	}
+#endif
 
-		meta_entry_byte += TEFS_DIR_EOF_BYTE_SIZE;
-
-		/* Write root index block address to directory for file ID. */
-		if ((response = tefs_reserve_device_block(&(file->child_index_block_address))))
-		{
-			return response;
-		}
+	/* Check if the page is in the same child index block. If not, get the
+	   address from the root index block or create a new child index block if it
+	   does not exist. */
+	if (DIV_BY_POW_2_EXP(file->data_block_number, volume->addresses_per_block_exponent) != child_block_number ||
+		file->child_index_block_address == 0)
+	{
+		uint16_t page_in_root_index;
+		uint16_t byte_in_root_index_page;
+		tefs_map_page_to_root_index_address(file_page_address, &page_in_root_index, &byte_in_root_index_page);
 
-		if ((response = tefs_write(&metadata, file->directory_page, &(file->child_index_block_address),
-								   4, meta_entry_byte)))
+		/* Make sure that the file has not reached its max capacity. */
+		if (page_in_root_index >= volume->block_size)
 		{
-			return response;
+			return TEFS_ERR_FILE_FULL;
 		}
 
-		meta_entry_byte += TEFS_DIR_ROOT_INDEX_ADDRESS_SIZE;
+		file->child_index_block_address = 0;
 
-		/* Write file name to directory entry and pad with null chars. */
-		if ((response = tefs_write(&metadata, file->directory_page, file_name, file_name_size, meta_entry_byte)))
+		/* A new child index block is needed when the new data block is the
+		   first one that it points to. */
+		if (file->eof_page < MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent))
 		{
-			return response;
+			/* The child index block of a file without a root index is stored
+			   in its place. */
+			file->child_index_block_address = file->root_index_block_address;
 		}
+		else if (!is_new_block || MOD_BY_POW_2(block_number, volume->addresses_per_block) != 0)
+		{
+			if (device_read(file->root_index_block_address + page_in_root_index,
+							&(file->child_index_block_address), volume->address_size,
+							byte_in_root_index_page))
+			{
+				return TEFS_ERR_READ;
+			}
 
-		meta_entry_byte += file_name_size;
+			/* The child index block was released by tefs_drop_head(). */
+			if (file->child_index_block_address == TEFS_DELETED)
+			{
+				file->child_index_block_address = 0;
+				file->data_block_number = 0xFFFFFFFF;
+				file->current_page_number = 0xFFFFFFFF;
 
-		/* Write out the file name and pad it up until the max length. */
-		uint8_t i;
-		for (i = 0; i < max_file_name_size - file_name_size; i++)
+				return TEFS_ERR_PAGE_RELEASED;
+			}
+		}
+		else
 		{
-			char null_char = '\0';
-			if ((response = tefs_write(&metadata, file->directory_page, &null_char, 1, meta_entry_byte)))
+			int8_t response;
+			if ((response = tefs_reserve_file_block(file, &(file->child_index_block_address))))
 			{
 				return response;
 			}
 
-			meta_entry_byte++;
-		}
-
-		// TODO: Write out metadata
+			if (byte_in_root_index_page == 0)
+			{
+				sd_spi_dirty_write = 1;
+			}
 
-		/* Pad the rest of the metadata entry with 0s. */
-		while (MOD_BY_POW_2(meta_entry_byte, metadata_size) != 0)
-		{
-			if ((response = tefs_write(&metadata, file->directory_page, &zero, 1, meta_entry_byte)))
+			if (device_write(file->root_index_block_address + page_in_root_index,
+							 &(file->child_index_block_address),
+							 volume->address_size, byte_in_root_index_page))
 			{
-				return response;
+				return TEFS_ERR_WRITE;
 			}
 
-			meta_entry_byte++;
+			sd_spi_dirty_write = 0;
 		}
+	}
 
-		/* Change status to IN_USE for directory entry. */
-		uint8_t status = TEFS_IN_USE;
-		if ((response = tefs_write(&metadata, file->directory_page, &status, 1, file->directory_byte)))
-		{
-			return response;
-		}
+	/* Get the data block from the child index block. */
+	uint16_t page_in_child_index;
+	uint16_t byte_in_child_index_page;
+	tefs_map_page_to_child_index_address(file_page_address, &page_in_child_index, &byte_in_child_index_page);
 
-		/* Write first data block address to first child index block. */
-		if ((response = tefs_reserve_device_block(&(file->data_block_address)))
-			 != 0 && response != TEFS_ERR_DEVICE_FULL)
+	file->data_block_address = 0;
+
+	if (!is_new_block)
+	{
+#if defined(TEFS_INDEX_CACHE_SIZE)
+		int8_t response;
+		if ((response = tefs_access_index_cache(file, file->child_index_block_address + page_in_child_index,
+												byte_in_child_index_page, &(file->data_block_address), 0)))
 		{
 			return response;
 		}
-
-		if (device_write(file->child_index_block_address, &(file->data_block_address), address_size, 0))
+#else
+		if (device_read(file->child_index_block_address + page_in_child_index,
+						&(file->data_block_address), volume->address_size,
+						byte_in_child_index_page))
 		{
-			return TEFS_ERR_WRITE;
+			return TEFS_ERR_READ;
 		}
+#endif
 
-		if (device_flush())
+		/* The data block was released by tefs_drop_head(). */
+		if (file->data_block_address == TEFS_DELETED)
 		{
-			return TEFS_ERR_WRITE;
+			file->data_block_number = 0xFFFFFFFF;
+			file->current_page_number = 0xFFFFFFFF;
+
+			return TEFS_ERR_PAGE_RELEASED;
 		}
 	}
-	else /* Open an existing file. */
+	else
 	{
-		meta_entry_byte += TEFS_DIR_STATUS_SIZE;
-
-		/* Read the file size. */
-		if ((response = tefs_read(&metadata, file->directory_page, &(file->eof_page),
-								  TEFS_DIR_EOF_PAGE_SIZE, meta_entry_byte)))
+		int8_t response;
+		if ((response = tefs_reserve_file_block(file, &(file->data_block_address))))
 		{
 			return response;
 		}
 
-		meta_entry_byte += TEFS_DIR_EOF_PAGE_SIZE;
-
-		if ((response = tefs_read(&metadata, file->directory_page, &(file->eof_byte),
-								  TEFS_DIR_EOF_BYTE_SIZE, meta_entry_byte)))
+#if defined(TEFS_INDEX_CACHE_SIZE)
+		if ((response = tefs_access_index_cache(file, file->child_index_block_address + page_in_child_index,
+												byte_in_child_index_page, &(file->data_block_address), 1)))
 		{
 			return response;
 		}
+#else
+		if (byte_in_child_index_page == 0)
+		{
+			sd_spi_dirty_write = 1;
+		}
 
-		meta_entry_byte += TEFS_DIR_EOF_BYTE_SIZE;
-
-		/* Read the file pointer. */
-		if ((response = tefs_read(&metadata, file->directory_page, &(file->root_index_block_address),
-								  address_size, meta_entry_byte)))
+		if (device_write(file->child_index_block_address + page_in_child_index,
+						 &(file->data_block_address), volume->address_size,
+						 byte_in_child_index_page))
 		{
-			return response;
+			return TEFS_ERR_WRITE;
 		}
 
-		if (file->eof_page >= MULT_BY_POW_2_EXP(block_size, page_size_exponent - address_size_exponent))
+		sd_spi_dirty_write = 0;
+#endif
+	}
+
+	file->data_block_number = block_number;
+
+	if (is_new_block)
+	{
+		file->number_of_allocated_blocks = block_number + 1;
+
+#if defined(TEFS_EXTENT_SUPPORT)
+		if (block_number == file->extent_length && !file->is_extent_ended)
 		{
-			/* Read the first child index block address. */
-			if (device_read(file->root_index_block_address, &(file->child_index_block_address), address_size, 0))
+			if (file->data_block_address == file->extent_address + MULT_BY_POW_2_EXP(block_number, volume->block_size_exponent))
 			{
-				return TEFS_ERR_READ;
+				file->extent_length++;
 			}
-
-			/* Read the first data block address. */
-			if (device_read(file->child_index_block_address, &(file->data_block_address), address_size, 0))
+			else
 			{
-				return TEFS_ERR_READ;
+				file->is_extent_ended = 1;
 			}
 		}
-		else
+#endif
+	}
+
+	return TEFS_ERR_OK;
+}
+
+#if defined(TEFS_EXTENT_SUPPORT)
+static int8_t
+tefs_extend_extent(
+	file_t		*file,
+	uint32_t	block_number
+)
+{
+#if defined(TEFS_INDEX_CACHE_SIZE)
+	/* The child index blocks are read on the device directly. */
+	int8_t response;
+	if ((response = tefs_write_index_cache(file)))
+	{
+		return response;
+	}
+#endif
+
+	uint8_t has_root_index = file->eof_page >= MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent);
+	uint8_t index_buffer[TEFS_SCAN_BUFFER_SIZE];
+
+	while (file->extent_length <= block_number && file->extent_length < file->number_of_allocated_blocks &&
+		   !file->is_extent_ended)
+	{
+		uint32_t child_index_block_address = file->root_index_block_address;
+
+		if (has_root_index)
 		{
-			file->child_index_block_address = file->root_index_block_address;
+			uint16_t page_in_root_index;
+			uint16_t byte_in_root_index_page;
+			tefs_map_page_to_root_index_address(MULT_BY_POW_2_EXP(file->extent_length, volume->block_size_exponent),
+												&page_in_root_index, &byte_in_root_index_page);
 
-			/* Read the first data block address. */
-			if (device_read(file->child_index_block_address, &(file->data_block_address), address_size, 0))
+			if (device_read(file->root_index_block_address + page_in_root_index,
+							&child_index_block_address, volume->address_size,
+							byte_in_root_index_page))
 			{
 				return TEFS_ERR_READ;
 			}
 		}
-	}
 
-	file->data_block_number				= 0;
-	file->current_page_number			= 0;
-	file->is_file_size_consistent 		= 1;
+		uint16_t page_in_child_index;
+		uint16_t byte_in_child_index_page;
+		tefs_map_page_to_child_index_address(MULT_BY_POW_2_EXP(file->extent_length, volume->block_size_exponent),
+											 &page_in_child_index, &byte_in_child_index_page);
 
-	return TEFS_ERR_OK;
-}
+		/* Read the addresses up to the end of the page or the allocated
+		   blocks. */
+		uint32_t number_of_bytes = volume->page_size - byte_in_child_index_page;
 
-int8_t
-tefs_exists(
-	char *file_name
-)
-{
-	int8_t response;
+		if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+		{
+			number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+		}
 
-	/* Load the data from the information page if it has not been previously loaded. */
-	if (address_size == 0)
-	{
-		if ((response = tefs_load_card_data()))
+		if (number_of_bytes > MULT_BY_POW_2_EXP(file->number_of_allocated_blocks - file->extent_length, volume->address_size_exponent))
 		{
-			return response;
+			number_of_bytes = MULT_BY_POW_2_EXP(file->number_of_allocated_blocks - file->extent_length, volume->address_size_exponent);
 		}
-	}
 
-	uint32_t directory_page;
-	uint16_t directory_byte;
+		if (device_read(child_index_block_address + page_in_child_index,
+						index_buffer, (uint16_t) number_of_bytes, byte_in_child_index_page))
+		{
+			return TEFS_ERR_READ;
+		}
 
-	if (tefs_find_file_directory_entry(file_name, &directory_page, &directory_byte, 0))
-	{
-		return 0;
-	}
+		uint16_t i;
+		for (i = 0; i < number_of_bytes; i += volume->address_size)
+		{
+			uint32_t data_block_address = 0;
+			memcpy(&data_block_address, index_buffer + i, volume->address_size);
 
-	/* Check if the status for the file's directory entry is set to IN_USE. */
-	uint8_t status;
-	if ((response = tefs_read(&metadata, directory_page, &status, 1, directory_byte)))
-	{
-		return response;
-	}
+			if (data_block_address != file->extent_address + MULT_BY_POW_2_EXP(file->extent_length, volume->block_size_exponent))
+			{
+				file->is_extent_ended = 1;
+				break;
+			}
 
-	if (status == TEFS_IN_USE)
-	{
-		return 1;
+			file->extent_length++;
+		}
 	}
 
-	return 0;
+	return TEFS_ERR_OK;
 }
+#endif
 
-int8_t
-tefs_close(
+static int8_t
+tefs_find_last_data_block(
 	file_t *file
 )
 {
-	if (tefs_flush(file))
-	{
-		return TEFS_ERR_WRITE;
-	}
-
-	return TEFS_ERR_OK;
-}
+	uint32_t last_block_number = tefs_count_file_blocks(file->eof_page, file->eof_byte) - 1;
 
-int8_t
-tefs_remove(
-	char *file_name
-)
-{
-	int8_t response;
+	file->data_block_number = 0xFFFFFFFF;
+	file->current_page_number = 0xFFFFFFFF;
 
-	/* Load the data from the information page if it has not been previously loaded. */
-	if (address_size == 0)
+	if (file->eof_page >= MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent))
 	{
-		if ((response = tefs_load_card_data()))
-		{
-			return response;
-		}
+		file->child_index_block_address = 0;
 	}
-
-	uint32_t directory_page;
-	uint16_t directory_byte;
-
-	if ((response = tefs_find_file_directory_entry(file_name, &directory_page, &directory_byte, 2)))
+	else
 	{
-		return response;
+		file->child_index_block_address = file->root_index_block_address;
 	}
 
-	uint32_t root_index_block_address = 0;
-
-	/* Get the root index block address for the file. */
-	if ((response = tefs_read(&metadata, directory_page, &root_index_block_address, TEFS_DIR_ROOT_INDEX_ADDRESS_SIZE,
-							  directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_BYTE_SIZE + TEFS_DIR_EOF_PAGE_SIZE)))
+	/* There is no data block if all of them have been released. */
+	if (last_block_number < file->first_block_number)
 	{
-		return response;
+		return TEFS_ERR_OK;
 	}
 
-	uint16_t root_index_current_byte;
-	uint16_t root_index_current_page;
+	return tefs_find_data_block(file, MULT_BY_POW_2_EXP(last_block_number, volume->block_size_exponent), 0);
+}
 
-	uint32_t eof_page;
+static int8_t
+tefs_find_first_data_block(
+	file_t *file
+)
+{
+	uint32_t number_of_blocks = tefs_count_file_blocks(file->eof_page, file->eof_byte);
+	uint8_t has_root_index = file->eof_page >= MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent);
+	uint32_t block_number = 0;
+	uint8_t index_buffer[TEFS_SCAN_BUFFER_SIZE];
 
-	/* Read the file size. */
-	if ((response = tefs_read(&metadata, directory_page, &(eof_page), TEFS_DIR_EOF_PAGE_SIZE, directory_byte + TEFS_DIR_STATUS_SIZE)))
+	while (block_number < number_of_blocks)
 	{
-		return response;
-	}
-
-	uint16_t page_in_root_index;
-	uint16_t byte_in_root_index_page;
-	tefs_map_page_to_root_index_address(eof_page, &page_in_root_index, &byte_in_root_index_page);
-
-	uint16_t page_in_child_index;
-	uint16_t byte_in_child_index_page;
-	tefs_map_page_to_child_index_address(eof_page, &page_in_child_index, &byte_in_child_index_page);
+		uint32_t child_index_block_address = file->root_index_block_address;
+		uint32_t child_end_block_number = MULT_BY_POW_2_EXP(DIV_BY_POW_2_EXP(block_number, volume->addresses_per_block_exponent) + 1,
+															volume->addresses_per_block_exponent);
 
-	int8_t past_end = 0;
+		if (child_end_block_number > number_of_blocks)
+		{
+			child_end_block_number = number_of_blocks;
+		}
 
-	/* Release all blocks that are in the file. */
-	for (root_index_current_page = 0;
-		 root_index_current_page <= page_in_root_index && !past_end;
-		 root_index_current_page++)
-	{
-		for (root_index_current_byte = 0;
-			 root_index_current_byte < page_size && !past_end;
-			 root_index_current_byte += address_size)
+		if (has_root_index)
 		{
-			uint32_t child_index_block_address = 0;
+			uint16_t page_in_root_index;
+			uint16_t byte_in_root_index_page;
+			tefs_map_page_to_root_index_address(MULT_BY_POW_2_EXP(block_number, volume->block_size_exponent),
+												&page_in_root_index, &byte_in_root_index_page);
 
-			if (eof_page >= MULT_BY_POW_2_EXP(block_size, page_size_exponent - address_size_exponent))
+			if (device_read(file->root_index_block_address + page_in_root_index,
+							&child_index_block_address, volume->address_size, byte_in_root_index_page))
 			{
-				if (device_read(root_index_block_address + root_index_current_page, &child_index_block_address,
-								address_size, root_index_current_byte))
-				{
-					return TEFS_ERR_READ;
-				}
+				return TEFS_ERR_READ;
 			}
-			else
+
+			/* All of the blocks of a released child index block are gone. */
+			if (child_index_block_address == TEFS_DELETED)
 			{
-				child_index_block_address = root_index_block_address;
+				block_number = child_end_block_number;
+				continue;
 			}
+		}
 
-			uint16_t child_index_current_page;
-			
-			for (child_index_current_page = 0;
-				 child_index_current_page < block_size && !past_end;
-				 child_index_current_page++)
-			{
-				uint16_t child_index_current_byte;
+		/* The addresses are read in pieces of up to a page. */
+		uint16_t page_in_child_index;
+		uint16_t byte_in_child_index_page;
+		tefs_map_page_to_child_index_address(MULT_BY_POW_2_EXP(block_number, volume->block_size_exponent),
+											 &page_in_child_index, &byte_in_child_index_page);
 
-				for (child_index_current_byte = 0;
-					 child_index_current_byte < page_size && !past_end;
-					 child_index_current_byte += address_size)
-				{
-					uint32_t data_block_address = 0;
+		uint32_t number_of_bytes = volume->page_size - byte_in_child_index_page;
 
-					if (device_read(child_index_block_address + child_index_current_page,
-									&data_block_address, address_size,
-									child_index_current_byte))
-					{
-						return TEFS_ERR_READ;
-					}
+		if (number_of_bytes > TEFS_SCAN_BUFFER_SIZE)
+		{
+			number_of_bytes = TEFS_SCAN_BUFFER_SIZE;
+		}
 
-					/* Release data block. */
-					if ((response = tefs_release_device_block(data_block_address)))
-					{
-						return response;
-					}
+		if (number_of_bytes > MULT_BY_POW_2_EXP(child_end_block_number - block_number, volume->address_size_exponent))
+		{
+			number_of_bytes = MULT_BY_POW_2_EXP(child_end_block_number - block_number, volume->address_size_exponent);
+		}
 
-					if (root_index_current_page == page_in_root_index && root_index_current_byte == byte_in_root_index_page &&
-						child_index_current_page == page_in_child_index && child_index_current_byte == byte_in_child_index_page)
-					{
-						past_end = 1;
-					}
-				}
-			}
+		if (device_read(child_index_block_address + page_in_child_index,
+						index_buffer, (uint16_t) number_of_bytes, byte_in_child_index_page))
+		{
+			return TEFS_ERR_READ;
+		}
+
+		uint16_t i;
+		for (i = 0; i < number_of_bytes; i += volume->address_size)
+		{
+			uint32_t data_block_address = 0;
+			memcpy(&data_block_address, index_buffer + i, volume->address_size);
 
-			/* Release child index block. */
-			if ((response = tefs_release_device_block(child_index_block_address)))
+			if (data_block_address != TEFS_DELETED)
 			{
-				return response;
+				file->first_block_number = block_number;
+
+				return TEFS_ERR_OK;
 			}
+
+			block_number++;
 		}
 	}
 
-	if (eof_page >= MULT_BY_POW_2_EXP(block_size, page_size_exponent - address_size_exponent))
+	/* Every block has been released, so the file is empty from the block
+	   after them on. */
+	file->first_block_number = number_of_blocks;
+
+	if (file->eof_page != MULT_BY_POW_2_EXP(number_of_blocks, volume->block_size_exponent) || file->eof_byte != 0)
 	{
-		/* Release root index block. */
-		if ((response = tefs_release_device_block(root_index_block_address)))
+		file->eof_page = MULT_BY_POW_2_EXP(number_of_blocks, volume->block_size_exponent);
+		file->eof_byte = 0;
+		file->is_file_size_consistent = 0;
+
+		/* The end of the file can move past the pages that its only child
+		   index block points to. */
+		if (!has_root_index &&
+			file->eof_page == MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent))
 		{
-			return response;
+			return tefs_create_root_index(file);
 		}
 	}
 
-	/* Change file status to deleted. */
-	uint8_t status = TEFS_DELETED;
+	return TEFS_ERR_OK;
+}
 
-	if ((response = tefs_write(&metadata, directory_page, &status, 1, directory_byte)))
-	{
-		return response;
-	}
+static uint32_t
+tefs_count_file_blocks(
+	uint32_t	eof_page,
+	uint16_t	eof_byte
+)
+{
+	uint32_t number_of_pages = eof_page + (eof_byte > 0);
 
-	if (device_flush())
+	if (number_of_pages == 0)
 	{
-		return TEFS_ERR_WRITE;
+		return 1;
 	}
 
-	return TEFS_ERR_OK;
+	return DIV_BY_POW_2_EXP(number_of_pages + volume->block_size - 1, volume->block_size_exponent);
 }
 
-int8_t
-tefs_write(
-	file_t 		*file,
-	uint32_t	file_page_address,
-	void	 	*data,
-	uint16_t 	number_of_bytes,
-	uint16_t 	byte_offset
+static int8_t
+tefs_extend_file(
+	file_t		*file,
+	uint16_t	end_byte
 )
 {
-	uint8_t is_new_page = 0;
-
-	if (file_page_address == file->eof_page)
+	if (end_byte > file->eof_byte)
 	{
-		if (byte_offset > file->eof_byte)
-		{
-			return TEFS_ERR_WRITE_PAST_END;
-		}
-		else if (byte_offset + number_of_bytes > file->eof_byte)
-		{
-			if (file->eof_byte == 0 || sd_spi_current_buffered_block() == file->data_block_address +
-																		  MOD_BY_POW_2(file_page_address, block_size))
-			{
-				is_new_page = 1;
-			}
+		file->eof_byte = end_byte;
+	}
 
-			file->eof_byte = byte_offset + number_of_bytes;
-		}
+	file->is_file_size_consistent = 0;
 
-		file->is_file_size_consistent = 0;
+	if (file->eof_byte == volume->page_size)
+	{
+		file->eof_byte = 0;
+		file->eof_page++;
 
-		if (file->eof_byte == page_size)
+		if (file->eof_page == MULT_BY_POW_2_EXP(volume->block_size, volume->page_size_exponent - volume->address_size_exponent + volume->block_size_exponent))
 		{
-			file->eof_byte = 0;
-			file->eof_page++;
-
-			if (file->eof_page == MULT_BY_POW_2_EXP(block_size, page_size_exponent - address_size_exponent + block_size_exponent))
-			{
-				int8_t response;
+			return tefs_create_root_index(file);
+		}
+	}
 
-				/* Write first child index block address to root index block. */
-				if ((response = tefs_reserve_device_block(&(file->root_index_block_address))))
-				{
-					return response;
-				}
+	return TEFS_ERR_OK;
+}
 
-				if (device_write(file->root_index_block_address, &(file->child_index_block_address), address_size, 0))
-				{
-					return TEFS_ERR_WRITE;
-				}
+static int8_t
+tefs_create_root_index(
+	file_t *file
+)
+{
+	int8_t response;
 
-				if (file->directory_page == 0xFFFFFFFF)
-				{
-					if (device_write(0, &(file->root_index_block_address), address_size, file->directory_byte + max_file_name_size + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE + TEFS_DIR_EOF_BYTE_SIZE))
-					{
-						return TEFS_ERR_WRITE;
-					}
-				}
-				else
-				{
-					if ((response = tefs_write(&metadata, file->directory_page, &(file->root_index_block_address), address_size, file->directory_byte + max_file_name_size + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE + TEFS_DIR_EOF_BYTE_SIZE)))
-					{
-						return response;
-					}
-				}
-			}
-		}
-	}
-	else if (file_page_address > file->eof_page)
+	/* Write first child index block address to root index block. */
+	if ((response = tefs_reserve_file_block(file, &(file->root_index_block_address))))
 	{
-		return TEFS_ERR_WRITE_PAST_END;
+		return response;
 	}
 
-	/* Check if page address is in the same block as the current data block. 
-	   If it is, write the data. Otherwise, get the new data block address
-	   from the root index block and then write to the page in that new data block. */
-	if (file_page_address == file->current_page_number ||
-		DIV_BY_POW_2_EXP(file_page_address, block_size_exponent) ==
-		file->data_block_number)
+	if (device_write(file->root_index_block_address, &(file->child_index_block_address), volume->address_size, 0))
 	{
-		sd_spi_dirty_write = is_new_page;
+		return TEFS_ERR_WRITE;
+	}
 
-		if (device_write(file->data_block_address +
-						 MOD_BY_POW_2(file_page_address, block_size), data,
-						 number_of_bytes, byte_offset))
+	if (file->directory_page == 0xFFFFFFFF)
+	{
+		if (device_write(0, &(file->root_index_block_address), volume->address_size, file->directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE + TEFS_DIR_EOF_BYTE_SIZE))
 		{
 			return TEFS_ERR_WRITE;
 		}
-
-		sd_spi_dirty_write = 0;
 	}
 	else
 	{
-		/* Check if the page is in the same child index block. If not, get the
-		   address from the root index block or create a new child index block if it
-		   does not exist. */
-		uint16_t child_block_number = (uint16_t) DIV_BY_POW_2_EXP(file_page_address, block_size_exponent + addresses_per_block_exponent);
-
-		if (DIV_BY_POW_2_EXP(file->data_block_number, addresses_per_block_exponent) != child_block_number)
-		{ 
-			uint16_t page_in_root_index;
-			uint16_t byte_in_root_index_page;
-			tefs_map_page_to_root_index_address(file_page_address, &page_in_root_index, &byte_in_root_index_page);
-
-			/* Make sure that the file has not reached its max capacity. */
-			if (page_in_root_index >= block_size)
-			{
-				return TEFS_ERR_FILE_FULL;
-			}
-
-			file->child_index_block_address = 0;
-
-			if (file->is_file_size_consistent)
-			{
-				if (device_read(file->root_index_block_address + page_in_root_index,
-								&(file->child_index_block_address), address_size,
-								byte_in_root_index_page))
-				{
-					return TEFS_ERR_READ;
-				}
-			}
-			else
-			{
-				int8_t response;
-				if ((response = tefs_reserve_device_block(&(file->child_index_block_address))))
-				{
-					return response;
-				}
-
-				if (byte_in_root_index_page == 0)
-				{
-					sd_spi_dirty_write = 1;
-				}
-
-				if (device_write(file->root_index_block_address + page_in_root_index,
-								 &(file->child_index_block_address),
-								 address_size, byte_in_root_index_page))
-				{
-					return TEFS_ERR_WRITE;
-				}
-
-				sd_spi_dirty_write = 0;
-			}
+		if ((response = tefs_write(&volume->metadata, file->directory_page, &(file->root_index_block_address), volume->address_size, file->directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE + TEFS_DIR_EOF_BYTE_SIZE)))
+		{
+			return response;
 		}
+	}
 
-		/* Get the data block from the child index block. */
-		uint16_t page_in_child_index;
-		uint16_t byte_in_child_index_page;
-		tefs_map_page_to_child_index_address(file_page_address, &page_in_child_index, &byte_in_child_index_page);
+	return TEFS_ERR_OK;
+}
+
+#if defined(TEFS_INDEX_CACHE_SIZE)
+static int8_t
+tefs_access_index_cache(
+	file_t		*file,
+	uint32_t	index_page,
+	uint16_t	byte_in_index_page,
+	uint32_t	*address,
+	uint8_t		is_write
+)
+{
+	int8_t response;
 
-		file->data_block_address = 0;
+	/* The cache holds an aligned part of the page (or all of it if the page
+	   is smaller than the cache). */
+	uint16_t cache_size = (volume->page_size < TEFS_INDEX_CACHE_SIZE) ? volume->page_size : TEFS_INDEX_CACHE_SIZE;
+	uint16_t cache_byte = byte_in_index_page & ~(cache_size - 1);
 
-		if (file->is_file_size_consistent)
+	if (file->index_cache_page != index_page || file->index_cache_byte != cache_byte)
+	{
+		if ((response = tefs_write_index_cache(file)))
 		{
-			if (device_read(file->child_index_block_address + page_in_child_index,
-							&(file->data_block_address), address_size,
-							byte_in_child_index_page))
-			{
-				return TEFS_ERR_READ;
-			}
+			return response;
 		}
-		else
-		{
-			int8_t response;
-			if ((response = tefs_reserve_device_block(&(file->data_block_address))))
-			{
-				return response;
-			}
 
-			if (byte_in_child_index_page == 0)
-			{
-				sd_spi_dirty_write = 1;
-			}
+		/* The addresses after a new address have not been allocated yet so
+		   they do not need to be read. */
+		if (is_write && byte_in_index_page == cache_byte)
+		{
+			memset(file->index_cache, 0, cache_size);
 
-			if (device_write(file->child_index_block_address + page_in_child_index,
-							 &(file->data_block_address), address_size,
-							 byte_in_child_index_page))
+			if (byte_in_index_page == 0)
 			{
-				return TEFS_ERR_WRITE;
+				file->is_index_cache_dirty = 2;
 			}
-
-			sd_spi_dirty_write = 0;
 		}
-
-		sd_spi_dirty_write = is_new_page;
-
-		if (device_write(file->data_block_address, data, number_of_bytes,
-						 byte_offset))
+		else if (device_read(index_page, file->index_cache, cache_size, cache_byte))
 		{
-			return TEFS_ERR_WRITE;
+			file->index_cache_page = 0;
+			return TEFS_ERR_READ;
 		}
 
-		sd_spi_dirty_write = 0;
-		file->data_block_number = DIV_BY_POW_2_EXP(file_page_address, block_size_exponent);
+		file->index_cache_page = index_page;
+		file->index_cache_byte = cache_byte;
 	}
 
-#if defined(UPDATE_FS_PAGE_CONSISTENCY)
-	/* Update file size. */
-	if (!file->is_file_size_consistent && file_page_address != file->current_page_number)
+	if (is_write)
 	{
-		int8_t err;
-		if (err = tefs_update_file_size(file))
+		memcpy(file->index_cache + (byte_in_index_page - cache_byte), address, volume->address_size);
+
+		if (!file->is_index_cache_dirty)
 		{
-			return err;
+			file->is_index_cache_dirty = 1;
 		}
 
-		file->is_file_size_consistent = 1;
-	}
-#elif defined(UPDATE_FS_RECORD_CONSISTENCY)
-	if (!file->is_file_size_consistent)
-	{
-		int8_t err;
-		if (err = tefs_update_file_size(file))
+		/* The directory files are never flushed with tefs_flush. */
+		if (file->directory_page == 0xFFFFFFFF)
 		{
-			return err;
+			return tefs_write_index_cache(file);
 		}
-
-		file->is_file_size_consistent = 1;
 	}
-#endif
-
-	file->current_page_number = file_page_address;
+	else
+	{
+		*address = 0;
+		memcpy(address, file->index_cache + (byte_in_index_page - cache_byte), volume->address_size);
+	}
 
 	return TEFS_ERR_OK;
 }
 
-int8_t
-tefs_flush(
+static int8_t
+tefs_write_index_cache(
 	file_t *file
 )
 {
-	if (device_flush())
+	if (!file->is_index_cache_dirty)
 	{
-		return TEFS_ERR_WRITE;
+		return TEFS_ERR_OK;
 	}
 
-	/* Update file size. */
-	if (!file->is_file_size_consistent)
+	uint16_t cache_size = (volume->page_size < TEFS_INDEX_CACHE_SIZE) ? volume->page_size : TEFS_INDEX_CACHE_SIZE;
+
+	/* The page does not need to be read in if it was empty. */
+	sd_spi_dirty_write = file->is_index_cache_dirty == 2;
+
+	if (device_write(file->index_cache_page, file->index_cache, cache_size, file->index_cache_byte))
 	{
-		int8_t err;
-		if ((err = tefs_update_file_size(file)))
-		{
-			return err;
-		}
+		sd_spi_dirty_write = 0;
+		return TEFS_ERR_WRITE;
 	}
 
+	sd_spi_dirty_write = 0;
+	file->is_index_cache_dirty = 0;
+
 	return TEFS_ERR_OK;
 }
+#endif
 
-int8_t
-tefs_read(
-	file_t 		*file,
-	uint32_t 	file_page_address,
-	void		*buffer,
-	uint16_t 	number_of_bytes,
-	uint16_t 	byte_offset
+#if defined(TEFS_CONTINUOUS_SUPPORT)
+static int8_t
+tefs_open_continuous_block(
+	file_t *file
 )
 {
-#if defined(UPDATE_FS_PAGE_CONSISTENCY)
-	/* Update file size if necessary. */
-	if (!file->is_file_size_consistent && file_page_address != file->current_page_number)
+	int8_t response;
+	uint32_t page = continuous_page_address;
+
+	/* The data block is allocated by the first write to it (unless it was
+	   preallocated). */
+	uint8_t is_new_block = is_read_write_continuous == 1 && page == file->eof_page && file->eof_byte == 0 &&
+						   page > 0 && MOD_BY_POW_2(page, volume->block_size) == 0 &&
+						   DIV_BY_POW_2_EXP(page, volume->block_size_exponent) >= file->number_of_allocated_blocks;
+
+	if ((response = tefs_find_data_block(file, page, is_new_block)))
 	{
-		int8_t err;
-		if ((err = tefs_update_file_size(file)))
-		{
-			return err;
-		}
+		return response;
 	}
-#endif
 
-	if (file_page_address == file->eof_page)
+	/* Write out the index blocks before the sequence is started. */
+	if (device_flush())
 	{
-		if (byte_offset > file->eof_byte)
+		return TEFS_ERR_WRITE;
+	}
+
+	uint32_t device_page = file->data_block_address + MOD_BY_POW_2(page, volume->block_size);
+
+	if (is_read_write_continuous == 1)
+	{
+#if defined(TEFS_PAGE_CACHE_SIZE)
+		/* The pages are written without going through the cache. */
+		tefs_cache_invalidate(device_page, device_page + volume->block_size - MOD_BY_POW_2(page, volume->block_size));
+#endif
+
+		if (sd_spi_write_continuous_start(device_page, volume->block_size - MOD_BY_POW_2(page, volume->block_size)))
 		{
-			return TEFS_ERR_EOF;
+			return TEFS_ERR_WRITE;
 		}
-		else if (byte_offset + number_of_bytes > file->eof_byte)
+	}
+	else
+	{
+		if (sd_spi_read_continuous_start(device_page))
 		{
-			return TEFS_ERR_EOF;
+			return TEFS_ERR_READ;
 		}
 	}
-	else if (file_page_address > file->eof_page)
+
+	file->current_page_number = page;
+	is_continuous_block_open = 1;
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_write_continuous_page(
+	file_t *file
+)
+{
+	int8_t response;
+	uint8_t is_root_index_needed = 0;
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+	uint32_t start_time = TEFS_TRACE_TIME();
+#endif
+
+	if (sd_spi_write_continuous_next())
 	{
-		return TEFS_ERR_EOF;
+		return TEFS_ERR_WRITE;
 	}
 
-	/* Check if page address is in the same block as the current data block. 
-	   If it is, read the data. Otherwise, get the new data block address
-	   from the root index block and then read to the page in that new data block. */
-	if (file_page_address == file->current_page_number ||
-		DIV_BY_POW_2_EXP(file_page_address, block_size_exponent) == file->data_block_number)
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+	/* The page is counted once it has been sent to the card. */
+	tefs_record_device_op(TEFS_TRACE_WRITE, TEFS_FILE_REGION(file),
+						  file->data_block_address + MOD_BY_POW_2(continuous_page_address, volume->block_size),
+						  volume->page_size, TEFS_ERR_OK, start_time);
+#endif
+
+	if (continuous_page_address == file->eof_page && continuous_page_bytes > file->eof_byte)
 	{
-		if (device_read(file->data_block_address + MOD_BY_POW_2(file_page_address, block_size),
-						buffer, number_of_bytes, byte_offset))
+		file->eof_byte = continuous_page_bytes;
+		file->is_file_size_consistent = 0;
+
+		if (file->eof_byte == volume->page_size)
 		{
-			return TEFS_ERR_READ;
+			file->eof_byte = 0;
+			file->eof_page++;
+
+			is_root_index_needed = file->eof_page == MULT_BY_POW_2_EXP(volume->block_size, volume->page_size_exponent - volume->address_size_exponent + volume->block_size_exponent);
 		}
 	}
-	else
-	{
-		/* Check if the page is in the same child index block. If not, get the
-		   address from the root index block or throw an error if it does not
-		   exist. */
-		uint16_t child_block_number = (uint16_t) DIV_BY_POW_2_EXP(file_page_address, block_size_exponent + addresses_per_block_exponent);
 
-		if (DIV_BY_POW_2_EXP(file->data_block_number, addresses_per_block_exponent) != child_block_number)
-		{
-			uint16_t page_in_root_index;
-			uint16_t byte_in_root_index_page;
-			tefs_map_page_to_root_index_address(file_page_address, &page_in_root_index, &byte_in_root_index_page);
+	file->current_page_number = continuous_page_address;
+	continuous_page_address++;
+	continuous_page_bytes = 0;
 
-			/* Make sure that the file has not reached its max capacity. */
-			if (page_in_root_index >= block_size)
-			{
-				return TEFS_ERR_FILE_FULL;
-			}
+	if (MOD_BY_POW_2(continuous_page_address, volume->block_size) == 0)
+	{
+		is_continuous_block_open = 0;
 
-			file->child_index_block_address = 0;
+		if (sd_spi_write_continuous_stop())
+		{
+			return TEFS_ERR_WRITE;
+		}
 
-			if (device_read(file->root_index_block_address + page_in_root_index,
-							&(file->child_index_block_address), address_size,
-							byte_in_root_index_page))
-			{
-				return TEFS_ERR_READ;
-			}
+		/* The last page of the first child index block has been written. */
+		if (is_root_index_needed && (response = tefs_create_root_index(file)))
+		{
+			return response;
 		}
+	}
 
-		/* Get the data block from the child index block. */
-		uint16_t page_in_child_index;
-		uint16_t byte_in_child_index_page;
-		tefs_map_page_to_child_index_address(file_page_address, &page_in_child_index, &byte_in_child_index_page);
+	return TEFS_ERR_OK;
+}
+#endif
 
-		file->data_block_address = 0;
+static int8_t
+tefs_update_file_size(
+	file_t *file
+)
+{
+	int8_t response;
 
-		if (device_read(file->child_index_block_address + page_in_child_index,
-						&(file->data_block_address), address_size,
-						byte_in_child_index_page))
+	if (file->directory_page == 0xFFFFFFFF)
+	{
+		if (device_write(0, &(file->eof_page), TEFS_DIR_EOF_PAGE_SIZE, file->directory_byte + TEFS_DIR_STATUS_SIZE))
 		{
-			return TEFS_ERR_READ;
+			return TEFS_ERR_WRITE;
 		}
 
-		if (device_read(file->data_block_address, buffer, number_of_bytes,
-						byte_offset))
+		if (device_write(0, &(file->eof_byte), TEFS_DIR_EOF_BYTE_SIZE, file->directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE))
 		{
-			return TEFS_ERR_READ;
+			return TEFS_ERR_WRITE;
+		}
+	}
+	else
+	{
+		if ((response = tefs_write(&volume->metadata, file->directory_page, &(file->eof_page), TEFS_DIR_EOF_PAGE_SIZE, file->directory_byte + TEFS_DIR_STATUS_SIZE)))
+		{
+			return response;
 		}
 
-		file->data_block_number = DIV_BY_POW_2_EXP(file_page_address, block_size_exponent);
+		if ((response = tefs_write(&volume->metadata, file->directory_page, &(file->eof_byte), TEFS_DIR_EOF_BYTE_SIZE, file->directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE)))
+		{
+			return response;
+		}
 	}
 
-	file->current_page_number = file_page_address;
+	file->is_file_size_consistent = 1;
+	file->committed_eof_page = file->eof_page;
+#if defined(TEFS_MILLISECONDS)
+	file->committed_time = TEFS_MILLISECONDS();
+#endif
 
 	return TEFS_ERR_OK;
 }
 
-int8_t
-tefs_release_block(
-	file_t 		*file,
-	uint32_t 	file_block_address
+static int8_t
+tefs_apply_consistency_policy(
+	file_t		*file,
+	uint32_t	file_page_address
 )
 {
-	uint16_t child_block_number = (uint16_t) DIV_BY_POW_2_EXP(file_block_address, addresses_per_block_exponent);
-	uint16_t page_in_root_index = DIV_BY_POW_2_EXP(child_block_number, page_size_exponent - address_size_exponent);
-	uint16_t byte_in_root_index_page = (uint16_t) (MULT_BY_POW_2_EXP(child_block_number, address_size_exponent) & (addresses_per_block - 1));
+	if (file->is_file_size_consistent)
+	{
+		return TEFS_ERR_OK;
+	}
 
-	uint32_t block_in_child_index = DIV_BY_POW_2_EXP(file_block_address, block_size_exponent) & (addresses_per_block - 1);
-	uint16_t page_in_child_index = (uint16_t) DIV_BY_POW_2_EXP(block_in_child_index, page_size_exponent - address_size_exponent);
-	uint16_t byte_in_child_index_page = (uint16_t) (MULT_BY_POW_2_EXP(block_in_child_index, address_size_exponent) & (page_size - 1));
+	uint8_t is_commit_needed = 0;
 
-	if (file_block_address != file->data_block_number)
+	switch (file->consistency_policy)
 	{
-		/* Check if the block is in the same child index block. If not, get the
-		   address from the root index block. */
-		if (DIV_BY_POW_2_EXP(file->data_block_number, addresses_per_block_exponent) !=
-			child_block_number)
-		{
-			if (device_read(file->root_index_block_address + page_in_root_index,
-							&(file->child_index_block_address), address_size,
-							byte_in_root_index_page))
-			{
-				return TEFS_ERR_READ;
-			}
+		case TEFS_CONSISTENCY_PAGE:
+			is_commit_needed = file_page_address != file->current_page_number;
+			break;
+		case TEFS_CONSISTENCY_RECORD:
+			is_commit_needed = 1;
+			break;
+		case TEFS_CONSISTENCY_GROUP:
+			is_commit_needed = file->group_commit_pages > 0 &&
+							   file->eof_page - file->committed_eof_page >= file->group_commit_pages;
+#if defined(TEFS_MILLISECONDS)
+			is_commit_needed = is_commit_needed || (file->group_commit_interval > 0 &&
+							   (uint32_t) (TEFS_MILLISECONDS() - file->committed_time) >= file->group_commit_interval);
+#endif
+			break;
+	}
 
-			if (file->child_index_block_address == TEFS_EMPTY ||
-				file->child_index_block_address == TEFS_DELETED)
-			{
-				return TEFS_ERR_UNRELEASED_BLOCK;
-			}
-		}
+	if (is_commit_needed)
+	{
+		return tefs_update_file_size(file);
+	}
 
-		/* Get the data block from the child index block. */
-		if (device_read(file->child_index_block_address + page_in_child_index,
-						&(file->data_block_address), address_size,
-						byte_in_child_index_page))
-		{
-			return TEFS_ERR_READ;
-		}
+	return TEFS_ERR_OK;
+}
 
-		if (file->data_block_address == TEFS_EMPTY ||
-			file->data_block_address == TEFS_DELETED)
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+static int8_t
+tefs_cache_load_page(
+	uint32_t	page,
+	uint8_t		is_new_page,
+	uint8_t		*slot
+)
+{
+	int8_t response;
+	uint8_t i;
+
+	for (i = 0; i < TEFS_PAGE_CACHE_SIZE; i++)
+	{
+		if (page_cache_address[i] == page)
 		{
-			return TEFS_ERR_UNRELEASED_BLOCK;
+			page_cache_is_referenced[i] = 1;
+			*slot = i;
+#if defined(TEFS_STATS)
+			volume->stats.buffer_hits++;
+#endif
+
+			return TEFS_ERR_OK;
 		}
+	}
 
-		file->data_block_number = file_block_address;
+#if defined(TEFS_STATS)
+	volume->stats.buffer_misses++;
+#endif
+
+	/* Advance the clock hand to the first slot that is empty or has not been
+	   accessed since the hand last passed it. Mapped pages are skipped. */
+	while (page_cache_address[page_cache_hand] != 0xFFFFFFFF &&
+		   (page_cache_is_referenced[page_cache_hand] || page_cache_is_mapped[page_cache_hand]))
+	{
+		page_cache_is_referenced[page_cache_hand] = 0;
+		page_cache_hand = (page_cache_hand + 1) % TEFS_PAGE_CACHE_SIZE;
 	}
 
-	/* Release block. */
-	int8_t response;
+	i = page_cache_hand;
+	page_cache_hand = (page_cache_hand + 1) % TEFS_PAGE_CACHE_SIZE;
 
-	if ((response = tefs_release_device_block(file->data_block_address)))
+	if ((response = tefs_cache_write_page(i)))
 	{
 		return response;
 	}
 
-	/* Remove the address from the child index block. */
-	uint8_t byte_buffer = TEFS_DELETED;
+	page_cache_address[i] = 0xFFFFFFFF;
 
-	if (device_write(file->child_index_block_address + page_in_child_index,
-					 &byte_buffer, 1, byte_in_child_index_page))
+	if (is_new_page)
 	{
-		return TEFS_ERR_WRITE;
+		memset(page_cache[i], 0, volume->page_size);
+	}
+	else if (device_raw_read(page, page_cache[i], volume->page_size, 0))
+	{
+		return TEFS_ERR_READ;
 	}
 
-	byte_buffer = 0;
-	uint8_t current_byte = 1;
+	page_cache_address[i] = page;
+	page_cache_is_referenced[i] = 1;
+	*slot = i;
+
+	return TEFS_ERR_OK;
+}
 
-	while (current_byte < address_size)
+static int8_t
+tefs_cache_write_page(
+	uint8_t slot
+)
+{
+	if (page_cache_address[slot] == 0xFFFFFFFF || !page_cache_is_dirty[slot])
 	{
-		if (device_write(file->child_index_block_address + page_in_child_index,
-						 &byte_buffer, 1,
-						 byte_in_child_index_page + current_byte))
-		{
-			return TEFS_ERR_WRITE;
-		}
+		return TEFS_ERR_OK;
+	}
 
-		current_byte++;
+	/* The whole page is written so it does not need to be read by the card. */
+	uint8_t is_dirty_write = sd_spi_dirty_write;
+	sd_spi_dirty_write = 1;
+
+	if (device_raw_write(page_cache_address[slot], page_cache[slot], volume->page_size, 0))
+	{
+		sd_spi_dirty_write = is_dirty_write;
+		return TEFS_ERR_WRITE;
 	}
 
-	uint8_t contains_blocks = 0;
+	sd_spi_dirty_write = is_dirty_write;
+	page_cache_is_dirty[slot] = 0;
 
-	/* Scan child index block to see if it's tefs_empty. */
-	for (page_in_child_index = 0;
-		 page_in_child_index < block_size && !contains_blocks;
-		 page_in_child_index++)
+	return TEFS_ERR_OK;
+}
+
+static void
+tefs_cache_invalidate(
+	uint32_t	start_page,
+	uint32_t	end_page
+)
+{
+	uint8_t slot;
+
+	for (slot = 0; slot < TEFS_PAGE_CACHE_SIZE; slot++)
 	{
-		for (byte_in_child_index_page = 0;
-			 byte_in_child_index_page < page_size && !contains_blocks;
-			 byte_in_child_index_page++)
+		if (page_cache_address[slot] >= start_page && page_cache_address[slot] < end_page)
 		{
-			if (device_read(file->child_index_block_address + page_in_child_index,
-							&byte_buffer, 1, byte_in_child_index_page))
-			{
-				return TEFS_ERR_READ;
-			}
+			page_cache_address[slot] = 0xFFFFFFFF;
+			page_cache_is_dirty[slot] = 0;
 
-			if (byte_buffer != TEFS_DELETED && byte_buffer != TEFS_EMPTY)
+			if (page_cache_is_mapped[slot])
 			{
-				contains_blocks = 1;
+				page_cache_is_mapped[slot] = 0;
+				page_cache_mapped_count--;
 			}
 		}
 	}
+}
 
-	/* Remove child index block from root index block if it's tefs_empty. */
-	if (!contains_blocks)
+static int8_t
+tefs_cache_find_mapped_page(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint8_t		*slot
+)
+{
+	int8_t response;
+	if ((response = tefs_find_data_block(file, file_page_address, 0)))
 	{
-		byte_buffer = TEFS_DELETED;
+		return response;
+	}
 
-		if (device_write(file->root_index_block_address + page_in_root_index, &byte_buffer,
-						 1, byte_in_root_index_page))
+	uint32_t page = file->data_block_address + MOD_BY_POW_2(file_page_address, volume->block_size);
+	uint8_t i;
+
+	for (i = 0; i < TEFS_PAGE_CACHE_SIZE; i++)
+	{
+		if (page_cache_address[i] == page && page_cache_is_mapped[i])
 		{
-			return TEFS_ERR_WRITE;
+			*slot = i;
+			return TEFS_ERR_OK;
 		}
+	}
 
-		byte_buffer = 0;
-		current_byte = 1;
-
-		while (current_byte < address_size)
-		{
-			if (device_write(file->root_index_block_address + page_in_root_index,
-							 &byte_buffer, 1, byte_in_root_index_page + current_byte))
-			{
-				return TEFS_ERR_WRITE;
-			}
+	return TEFS_ERR_PAGE_NOT_MAPPED;
+}
+#endif
 
-			current_byte++;
-		}
+#if defined(TEFS_ASYNC_QUEUE_SIZE)
+static int8_t
+tefs_queue_async(
+	file_t		*file,
+	uint32_t	file_page_address,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset,
+	uint8_t		is_write,
+	uint8_t		*request
+)
+{
+	TEFS_LOCK_QUEUE();
 
-		if ((response = tefs_release_device_block(file->child_index_block_address)))
-		{
-			return response;
-		}
+	/* The slot at the end of the queue is still in use if every slot has a
+	   request that has not been completed. */
+	if (async_state[async_tail] != TEFS_ASYNC_FREE)
+	{
+		TEFS_UNLOCK_QUEUE();
+		return TEFS_ERR_QUEUE_FULL;
 	}
 
-	if (device_flush())
+	uint8_t slot = async_tail;
+	async_tail = (async_tail + 1) % TEFS_ASYNC_QUEUE_SIZE;
+
+	async_file[slot] 				= file;
+	async_page[slot] 				= file_page_address;
+	async_data[slot] 				= data;
+	async_number_of_bytes[slot] 	= number_of_bytes;
+	async_byte_offset[slot] 		= byte_offset;
+	async_is_write[slot] 			= is_write;
+	async_state[slot] 				= TEFS_ASYNC_QUEUED;
+
+	TEFS_UNLOCK_QUEUE();
+
+	*request = slot;
+
+	return TEFS_ERR_OK;
+}
+#endif
+
+static uint8_t
+tefs_power_of_two_exponent(
+	uint32_t number
+)
+{
+	uint8_t position = 0;
+
+	while (((number & 1) == 0) && number > 1)
 	{
-		return TEFS_ERR_WRITE;
+		number >>= 1;
+		position++;
 	}
 
-	return TEFS_ERR_OK;
+	return position;
 }
 
 static int8_t
-tefs_find_file_directory_entry(
-	char 		*file_name,
-	uint32_t 	*dir_page_address,
-	uint16_t 	*dir_byte_in_page,
-	uint8_t 	file_operation
+tefs_load_card_data(
+	void
 )
 {
-	uint32_t name_hash_value = hash_string(file_name);
-	uint16_t small_name_hash = (uint16_t) name_hash_value;
+	uint8_t		info_buffer[TEFS_INFO_HEADER_SIZE];
+	uint16_t 	current_byte 	= 0;
 
-	uint16_t deleted_hash_page = 0xFFFF;
-	uint16_t deleted_hash_byte = 0;
-	uint32_t deleted_dir_page_address = 0;
-	uint16_t deleted_dir_byte_in_page = 0;
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+	/* Nothing has been cached from the device yet. */
+	tefs_cache_invalidate(0, 0xFFFFFFFF);
+#endif
 
-	*dir_page_address = 0;
-	*dir_byte_in_page = 0;
+	/* Read the fields of the information page with a single read and parse
+	   them from the buffer. */
+	if (device_read(0, info_buffer, TEFS_INFO_HEADER_SIZE, 0))
+	{
+		return TEFS_ERR_READ;
+	}
 
-	int8_t response;
-	uint16_t current_page = 0;
-	uint16_t current_byte = 0;
-	while (1)
+	/* Verify the check flag. */
+	for (current_byte = 0; current_byte < 4; current_byte++)
 	{
-		uint32_t entry_hash_value = 0;
-		if ((response = tefs_read(&hash_entries, current_page, &entry_hash_value, hash_size, current_byte)) != TEFS_ERR_EOF && response != TEFS_ERR_OK)
+		if (info_buffer[current_byte] != TEFS_CHECK_FLAG)
 		{
-			return response;
+			return TEFS_ERR_NOT_FORMATTED;
 		}
+	}
 
-		if (response == TEFS_ERR_EOF)	/* Reached the end of the hash entries file. */
-		{
-			if (file_operation == 1)    /* Create file */
-			{
-				if (deleted_hash_page <= current_page)
-				{
-					current_page = deleted_hash_page;
-					current_byte = deleted_hash_byte;
+	/* The number of pages that the device has. */
+	memcpy(&volume->number_of_pages, info_buffer + current_byte, 4);
+	current_byte += 4;
 
-					*dir_page_address = deleted_dir_page_address;
-					*dir_byte_in_page = deleted_dir_byte_in_page;
-				}
+	/* The physical page size. */
+	volume->page_size_exponent = info_buffer[current_byte];
+	current_byte += 1;
 
-				/* Write out hash value to hash entries file. */
-				if ((response = tefs_write(&hash_entries, current_page,
-										   (hash_size == 4) ? &name_hash_value : &small_name_hash, hash_size,
-										   current_byte)))
-				{
-					return response;
-				}
+#if defined(TEFS_DEVICE_BACKEND)
+	/* A volume that was formatted with pages of another size cannot be
+	   accessed through the buffer of the backend. */
+	if (volume->page_size_exponent > 15 || POW_2_TO(volume->page_size_exponent) != TEFS_DEVICE_PAGE_SIZE)
+	{
+		return TEFS_ERR_PAGE_SIZE;
+	}
+#endif
+
+	/* The block size. */
+	volume->block_size_exponent = info_buffer[current_byte];
+	current_byte += 1;
+
+	/* The address size. */
+	volume->address_size_exponent = info_buffer[current_byte];
+	current_byte += 1;
+
+	/* The size of a hash. */
+	volume->hash_size = info_buffer[current_byte];
+	current_byte += 1;
 
-				return TEFS_NEW_FILE;
+	/* The size of a metadata record. */
+	memcpy(&volume->metadata_size, info_buffer + current_byte, 2);
+	current_byte += 2;
+
+	/* The max size for a file name. */
+	memcpy(&volume->max_file_name_size, info_buffer + current_byte, 2);
+	current_byte += 2;
+
+#if defined(USE_SD)
+	/* The state section size. */
+	memcpy(&volume->state_section_size, info_buffer + current_byte, 4);
+	current_byte += 4;
+#endif
+
+	volume->block_size 		= (uint16_t) POW_2_TO(volume->block_size_exponent);
+	volume->page_size 		= (uint16_t) POW_2_TO(volume->page_size_exponent);
+	volume->address_size 	= (uint8_t) POW_2_TO(volume->address_size_exponent);
+
+	/* The hash size is either 2 or 4 bytes so its exponent is half of the size. */
+	volume->hash_size_exponent = volume->hash_size >> 1;
+
+	volume->addresses_per_block = DIV_BY_POW_2_EXP(MULT_BY_POW_2_EXP(volume->page_size, volume->block_size_exponent), volume->address_size_exponent);
+	volume->addresses_per_block_exponent = tefs_power_of_two_exponent(volume->addresses_per_block);
+
+	int8_t response;
+	int8_t i;
+	file_t *temp_file = &volume->hash_entries;
+	for (i = 0; i < 2; i++)
+	{
+		/* The entry in the information page has no status byte, so the byte
+		   of the entry is set to where the status would be. */
+		temp_file->directory_byte = current_byte - TEFS_DIR_STATUS_SIZE;
+
+		/* The size of the file. */
+		memcpy(&(temp_file->eof_page), info_buffer + current_byte, TEFS_DIR_EOF_PAGE_SIZE);
+		current_byte += TEFS_DIR_EOF_PAGE_SIZE;
+
+		memcpy(&(temp_file->eof_byte), info_buffer + current_byte, TEFS_DIR_EOF_BYTE_SIZE);
+		current_byte += TEFS_DIR_EOF_BYTE_SIZE;
+
+		/* The root index block address. */
+		temp_file->root_index_block_address = 0;
+		memcpy(&(temp_file->root_index_block_address), info_buffer + current_byte, volume->address_size);
+		current_byte += TEFS_DIR_ROOT_INDEX_ADDRESS_SIZE;
+
+		if (temp_file->eof_page >= MULT_BY_POW_2_EXP(volume->addresses_per_block, volume->block_size_exponent))
+		{
+			/* Read the first child index block address. */
+			if (device_read(temp_file->root_index_block_address, &(temp_file->child_index_block_address), volume->address_size, 0))
+			{
+				return TEFS_ERR_READ;
 			}
-			else if (response == TEFS_ERR_EOF)
+
+			/* Read the first data block address. */
+			if (device_read(temp_file->child_index_block_address, &(temp_file->data_block_address), volume->address_size, 0))
 			{
-				return TEFS_ERR_FILE_NOT_FOUND;
+				return TEFS_ERR_READ;
 			}
 		}
-		else if (entry_hash_value == name_hash_value)	/* Found file hash */
+		else
 		{
-			int8_t status;
-			if ((response = tefs_read(&metadata, *dir_page_address, &status, 1, *dir_byte_in_page)))
+			temp_file->child_index_block_address = temp_file->root_index_block_address;
+
+			/* Read the first data block address. */
+			if (device_read(temp_file->child_index_block_address, &(temp_file->data_block_address), volume->address_size, 0))
 			{
-				return response;
+				return TEFS_ERR_READ;
 			}
+		}
 
-			if (status != TEFS_EMPTY || status != TEFS_DELETED)
-			{
-				/* Check if it is the actual file by comparing file names. */
-				int16_t count = -1;
-				char c = ' ';
+		temp_file->directory_page 			= 0xFFFFFFFF;
+		temp_file->current_page_number 		= 0;
+		temp_file->data_block_number 		= 0;
+		temp_file->first_block_number 		= 0;
+		temp_file->is_file_size_consistent 	= 1;
+		temp_file->consistency_policy 		= TEFS_CONSISTENCY_FLUSH;
+		temp_file->group_commit_pages 		= 0;
+		temp_file->group_commit_interval 	= 0;
+		temp_file->committed_eof_page 		= temp_file->eof_page;
+		temp_file->committed_time 			= 0;
+		temp_file->number_of_allocated_blocks = tefs_count_file_blocks(temp_file->eof_page, temp_file->eof_byte);
+#if defined(TEFS_EXTENT_SUPPORT)
+		temp_file->extent_address 			= temp_file->data_block_address;
+		temp_file->extent_length 			= 1;
+		temp_file->is_extent_ended 			= 0;
+#endif
+		temp_file->number_of_reserved_blocks = 0;
+		temp_file->next_reserved_block 		= 0;
+#if defined(TEFS_INDEX_CACHE_SIZE)
+		temp_file->index_cache_page 		= 0;
+		temp_file->is_index_cache_dirty 	= 0;
+#endif
+		temp_file->volume 					= volume;
 
-				while (count == -1 || (c != '\0' && file_name[count] != '\0' && c == file_name[count] && count < max_file_name_size))
-				{
-					if ((response = tefs_read(&metadata, *dir_page_address, &c, 1, *dir_byte_in_page + TEFS_DIR_STATIC_DATA_SIZE + (uint16_t) (count + 1))))
-					{
-						return response;
-					}
+		temp_file = &volume->metadata;
+	}
 
-					count++;
-				}
+#if defined(USE_SD)
+	/* The free block hint and the number of used blocks. They are 0 if they
+	   were not written out after the state section was last changed. */
+	uint32_t free_block_hint;
+	memcpy(&free_block_hint, info_buffer + TEFS_INFO_FREE_SPACE_BYTE, 4);
+	memcpy(&volume->used_block_count, info_buffer + TEFS_INFO_FREE_SPACE_BYTE + 4, 4);
 
-				if (c == file_name[count])
-				{
-					if (file_operation == 2)	/* Remove file */
-					{
-						entry_hash_value = 0;
-						if ((response = tefs_write(&hash_entries, current_page, &entry_hash_value, hash_size, current_byte)))
-						{
-							return response;
-						}
-					}
+	volume->number_of_blocks = MULT_BY_POW_2_EXP(DIV_BY_POW_2_EXP(volume->number_of_pages - TEFS_INFO_SECTION_SIZE,
+																  volume->block_size_exponent + 3), 3);
+	volume->is_free_space_written = volume->used_block_count != 0;
 
-					return TEFS_ERR_OK;
-				}
-			}
-		}
-		else if (file_operation == 1 && entry_hash_value == 0 && deleted_hash_page == 0xFFFF) /* Found a deleted entry. */
-		{
-			deleted_hash_page = current_page;
-			deleted_hash_byte = current_byte;
+	if (!volume->is_free_space_written || free_block_hint > volume->number_of_blocks)
+	{
+		free_block_hint = 0;
+		volume->used_block_count = 0;
+	}
 
-			deleted_dir_page_address = *dir_page_address;
-			deleted_dir_byte_in_page = *dir_byte_in_page;
-		}
+	/* The allocation cursor is kept when the state section changes since it
+	   is only where the search for free blocks starts. */
+	memcpy(&volume->allocation_cursor, info_buffer + TEFS_INFO_FREE_SPACE_BYTE + 8, 4);
 
-		if ((uint32_t)*dir_byte_in_page + metadata_size >= page_size)
-		{
-			(*dir_page_address)++;
-			*dir_byte_in_page = 0;
-		}
-		else
-		{
-			*dir_byte_in_page += metadata_size;
-		}
+	if (volume->allocation_cursor >= volume->number_of_blocks)
+	{
+		volume->allocation_cursor = 0;
+	}
+#endif
+
+#if defined(TEFS_HASH_INDEX_SIZE)
+	if ((response = tefs_build_hash_index()))
+	{
+		return response;
+	}
+#endif
 
-		current_byte += hash_size;
+#if defined(TEFS_LAZY_FREE_QUEUE_SIZE)
+	/* Blocks of files that were removed before the device was formatted
+	   are not released. */
+	volume->lazy_free_count = 0;
+#endif
 
-		if (current_byte >= page_size)
-		{
-			current_page++;
-			current_byte = 0;
-		}
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	tefs_open_cache_clear();
+#endif
+
+#if defined(TEFS_CONTINUOUS_SUPPORT)
+	is_read_write_continuous = 0;
+	is_continuous_block_open = 0;
+#endif
+
+#if defined(USE_SD)
+	/* Get first byte in state for a free block. */
+	volume->state_section_bit = free_block_hint;
+	volume->free_extent_count = 0;
+	volume->free_extent_scan_bit = free_block_hint;
+	volume->is_block_pool_empty = 0;
+	volume->release_run_count = 0;
+
+	if ((response = tefs_find_next_empty_block(&volume->state_section_bit)))
+	{
+		return response;
 	}
-}
+#endif
+
+// #if DEBUG == 1
+// #if defined(USE_SD)
+// 	printf("State section bit: %u\n", state_section_bit);
+// 	printf("State section size: %u\n", state_section_size);
+// #endif
+// 	printf("Directory size: %u\n", directory_size);
+// 	printf("Number of pages: %u\n", number_of_pages);
+// 	printf("Page size: %u\n", page_size);
+// 	printf("Page size exponent: %u\n", page_size_exponent);
+// 	printf("Addresses per block: %u\n", addresses_per_block);
+// 	printf("Addresses per block exponent: %u\n", addresses_per_block_exponent);
+// 	printf("Block size: %u\n", block_size);
+// 	printf("Block size exponent: %u\n", block_size_exponent);
+// 	printf("Address size: %u\n", address_size);
+// 	printf("Address size exponent: %u\n", address_size_exponent);
+// #endif
 
-static int8_t
-tefs_write_metadata(
-	file_t		file,
-	void		*data,
-	uint16_t 	number_of_byte
-)
-{
 	return TEFS_ERR_OK;
 }
 
 static int8_t
-tefs_reserve_device_block(
-	uint32_t *block_address
+tefs_use_volume(
+	tefs_volume_t *new_volume
 )
 {
-#if defined(USE_SD)
-	if (is_block_pool_empty)
+	if (new_volume == volume)
 	{
-		return TEFS_ERR_DEVICE_FULL;
+		return TEFS_ERR_OK;
 	}
 
-	uint8_t byte_buffer = 0;
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+	uint32_t start_time = TEFS_TRACE_TIME();
+#endif
 
-	/* Read in byte. */
-	if (device_read(DIV_BY_POW_2_EXP(DIV_BY_POW_2_EXP(state_section_bit, 3), page_size_exponent) + 1, &byte_buffer, 1, (uint16_t) MOD_BY_POW_2(DIV_BY_POW_2_EXP(state_section_bit, 3), page_size)))
+	if (device_base_flush())
 	{
-		return TEFS_ERR_READ;
+		return TEFS_ERR_WRITE;
 	}
 
-	/* Check if the block has already been reserved. */
-	if (!(byte_buffer & POW_2_TO(7 - MOD_BY_POW_2(state_section_bit, 8))))
-	{
-		return TEFS_ERR_OK;
-	}
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+	tefs_cache_invalidate(0, 0xFFFFFFFF);
+#endif
+
+	volume = new_volume;
 
-	/* Toggle state bit in byte from 1 to 0. */
-	byte_buffer &= (uint8_t) ~POW_2_TO(7 - MOD_BY_POW_2(state_section_bit, 8));
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+	/* The flush is counted for the new volume since the previous one may no
+	   longer be in memory. */
+	tefs_record_device_op(TEFS_TRACE_FLUSH, TEFS_REGION_INFO, 0, 0, TEFS_ERR_OK, start_time);
+#endif
+
+	return TEFS_ERR_OK;
+}
 
-	/* Write out the byte */
-	if (device_write(DIV_BY_POW_2_EXP(DIV_BY_POW_2_EXP(state_section_bit, 3), page_size_exponent) + 1, &byte_buffer, 1, (uint16_t) MOD_BY_POW_2(DIV_BY_POW_2_EXP(state_section_bit, 3), page_size)))
+#if defined(TEFS_DEVICE_BACKEND)
+static tefs_device_t *
+tefs_current_device(
+	void
+)
+{
+	if (volume->device != NULL)
 	{
-		return TEFS_ERR_WRITE;
+		return volume->device;
 	}
 
-	*block_address = MULT_BY_POW_2_EXP(state_section_bit, block_size_exponent) + (1 + state_section_size);
-	state_section_bit++;
+	return default_volume.device;
+}
 
-	/* Find the next unreserved block. */
-	int8_t response;
+static int8_t
+tefs_device_load_page(
+	uint32_t	page,
+	uint8_t		is_read
+)
+{
+	tefs_device_t *device = tefs_current_device();
 
-	if ((response = tefs_find_next_empty_block(&state_section_bit)))
+	if (device_buffer_device == device && device_buffer_page == page)
 	{
-		return response;
+		return TEFS_ERR_OK;
 	}
 
-	if (device_flush())
+	if (device_buffer_is_dirty &&
+		device_buffer_device->write_pages(device_buffer_device, device_buffer_page, 1, device_buffer))
 	{
 		return TEFS_ERR_WRITE;
 	}
-#elif defined(USE_DATAFLASH) && defined(USE_FTL)
-	/* Reserve page on FTL. */
 
-	if (block_size == 1)
+	device_buffer_is_dirty = 0;
+	device_buffer_page = 0xFFFFFFFF;
+	device_buffer_device = device;
+
+	if (!is_read)
 	{
-		flare_logical_page_t p;
-		flare_GetPage(&ftl, &p);
+		memset(device_buffer, 0, TEFS_DEVICE_PAGE_SIZE);
 	}
-	else if (block_size == 2)
+	else if (device->read_pages(device, page, 1, device_buffer))
 	{
-
+		return TEFS_ERR_READ;
 	}
-#endif
+
+	device_buffer_page = page;
 
 	return TEFS_ERR_OK;
 }
+#endif
 
-static int8_t
-tefs_release_device_block(
-	uint32_t block_address
+static uint32_t
+hash_string(
+	char *str
 )
 {
-#if defined(USE_SD)
-	/* Start byte for the state section that is correlated to the block
-	   address. */
-	uint32_t state_bit = DIV_BY_POW_2_EXP(block_address - (1 + state_section_size), block_size_exponent);
-	uint8_t byte_buffer = 0;
+	uint32_t hash = 5381;
+	int8_t c;
 
-	/* Read in byte. */
-	if (device_read(DIV_BY_POW_2_EXP(DIV_BY_POW_2_EXP(state_bit, 3), page_size_exponent) + 1, &byte_buffer, 1, (uint16_t) MOD_BY_POW_2(DIV_BY_POW_2_EXP(state_bit, 3), page_size)))
+	while ((c = *str++))
 	{
-		return TEFS_ERR_READ;
+		hash = (uint32_t)((hash << 5) + hash) ^ c; /* hash * 33 ^ c */
 	}
 
-	/* Check if the block has already been released. */
-	if (byte_buffer & POW_2_TO(7 - MOD_BY_POW_2(state_bit, 8)))
+	if (hash == 0)
 	{
-		return TEFS_ERR_OK;
+		hash = 1;
 	}
 
-	/* Toggle state bit in byte from 0 to 1. */
-	byte_buffer |= (uint8_t) POW_2_TO(7 - MOD_BY_POW_2(state_bit, 8));
-
-	/* Write out the byte. */
-	if (device_write(DIV_BY_POW_2_EXP(DIV_BY_POW_2_EXP(state_bit, 3), page_size_exponent) + 1, &byte_buffer, 1, (uint16_t) MOD_BY_POW_2(DIV_BY_POW_2_EXP(state_bit, 3), page_size)))
+	if (volume->hash_size == 4)
 	{
-		return TEFS_ERR_WRITE;
+		return hash;
 	}
-
-	if (device_flush())
+	else
 	{
-		return TEFS_ERR_WRITE;
+		return hash % 65521;
 	}
+}
 
-	if (state_bit < state_section_bit)
+#if defined(TEFS_OPEN_CACHE_SIZE)
+static uint8_t
+tefs_open_cache_find(
+	char		*file_name,
+	uint32_t	name_hash
+)
+{
+	uint8_t slot;
+	for (slot = 0; slot < TEFS_OPEN_CACHE_SIZE; slot++)
 	{
-		state_section_bit = state_bit;
+		if (volume->open_cache_time[slot] != 0 && volume->open_cache_hash[slot] == name_hash &&
+			strcmp(volume->open_cache_name[slot], file_name) == 0)
+		{
+			break;
+		}
 	}
 
-	is_block_pool_empty = 0;
-#elif defined(USE_DATAFLASH) && defined(USE_FTL)
-	/* Release block from FTL. */
-	if (block_size == 1)
+	return slot;
+}
+
+static void
+tefs_open_cache_insert(
+	file_t		*file,
+	char		*file_name,
+	uint32_t	name_hash
+)
+{
+	/* Take a free slot, otherwise the least recently used one that is not
+	   open. */
+	uint8_t victim = TEFS_OPEN_CACHE_SIZE;
+	uint8_t slot;
+
+	for (slot = 0; slot < TEFS_OPEN_CACHE_SIZE; slot++)
 	{
-		flare_ReturnPage(&ftl, block_address);
+		if (volume->open_cache_time[slot] == 0)
+		{
+			victim = slot;
+			break;
+		}
+
+		if (volume->open_cache_count[slot] == 0 &&
+			(victim == TEFS_OPEN_CACHE_SIZE || volume->open_cache_time[slot] < volume->open_cache_time[victim]))
+		{
+			victim = slot;
+		}
 	}
-	else if (block_size == 8)
-	{
 
+	if (victim == TEFS_OPEN_CACHE_SIZE)
+	{
+		return;
 	}
-#endif
 
-	return TEFS_ERR_OK;
+	/* Only the directory entry is kept until the file is closed. */
+	volume->open_cache_file[victim].directory_page = file->directory_page;
+	volume->open_cache_file[victim].directory_byte = file->directory_byte;
+	volume->open_cache_hash[victim] = name_hash;
+	strcpy(volume->open_cache_name[victim], file_name);
+	volume->open_cache_time[victim] = ++volume->open_cache_clock;
+	volume->open_cache_count[victim] = 1;
+	volume->open_cache_is_stale[victim] = 0;
 }
 
-static int8_t
-tefs_erase_block(
-	uint32_t block_address
+static uint8_t
+tefs_open_cache_find_open(
+	file_t *file
 )
 {
-	/* Erase pages in root index block. */
-	uint32_t current_page;
-	uint8_t flag = TEFS_EMPTY;
-
-#if defined(USE_SD)
-	if (sd_spi_write_continuous_start(block_address, block_size))
+	uint8_t slot;
+	for (slot = 0; slot < TEFS_OPEN_CACHE_SIZE; slot++)
 	{
-		return TEFS_ERR_WRITE;
+		if (volume->open_cache_time[slot] != 0 && volume->open_cache_count[slot] != 0 &&
+			volume->open_cache_file[slot].directory_page == file->directory_page &&
+			volume->open_cache_file[slot].directory_byte == file->directory_byte)
+		{
+			break;
+		}
 	}
-#endif
 
-	for (current_page = block_address;
-		 current_page < block_size + block_address;
-		 current_page++)
-	{
-		uint16_t current_byte;
+	return slot;
+}
 
-		for (current_byte = 0;
-			 current_byte < page_size;
-			 current_byte++)
-		{
-#if defined(USE_SD)
-			if (sd_spi_write_continuous(&flag, 1, current_byte))
-			{
-				return TEFS_ERR_WRITE;
-			}
-#else
-			if (device_write(current_page, &flag, 1, current_byte))
-			{
-				return TEFS_ERR_WRITE;
-			}
+static void
+tefs_open_cache_clear(
+	void
+)
+{
+	memset(volume->open_cache_time, 0, sizeof(volume->open_cache_time));
+	volume->open_cache_clock = 0;
+}
 #endif
-		}
 
-#if defined(USE_SD)
-		if (sd_spi_write_continuous_next())
-		{
-			return TEFS_ERR_WRITE;
-		}
-#endif
-	}
+#if defined(TEFS_THREAD_SAFE)
+#undef tefs_format_device
+#undef tefs_mount
+#undef tefs_select_device
+#undef tefs_open
+#undef tefs_exists
+#undef tefs_close
+#undef tefs_remove
+#undef tefs_compact_directory
+#undef tefs_idle
+#undef tefs_statfs
+#undef tefs_set_allocation_policy
+#undef tefs_get_stats
+#undef tefs_reset_stats
+#undef tefs_set_trace_hook
+#undef tefs_opendir
+#undef tefs_readdir
+#undef tefs_closedir
+#undef tefs_release_block
+#undef tefs_set_consistency
+#undef tefs_fallocate
+#undef tefs_truncate
+#undef tefs_drop_head
+#undef tefs_write
+#undef tefs_write_continuous_start
+#undef tefs_write_continuous_stop
+#undef tefs_flush
+#undef tefs_read
+#undef tefs_read_pages
+#undef tefs_read_continuous_start
+#undef tefs_read_continuous_stop
+#undef tefs_map_page
+#undef tefs_commit_page
+#undef tefs_unmap_page
+
+/* Calls one of the functions while the device lock is held. */
+#define TEFS_CALL_LOCKED(call) \
+		int8_t response; \
+		TEFS_LOCK_DEVICE(); \
+		response = (call); \
+		TEFS_UNLOCK_DEVICE(); \
+		return response
 
-#if defined(USE_SD)
-	if (sd_spi_write_continuous_stop())
-	{
-		return TEFS_ERR_WRITE;
-	}
+int8_t
+tefs_format_device(
+	uint32_t 	num_pages,
+	uint16_t 	physical_page_size,
+	uint16_t 	logical_block_size,
+	uint8_t		hash_size,
+	uint16_t	metadata_size,
+	uint16_t 	max_file_name_size,
+	uint8_t		erase_before_format
+)
+{
+	TEFS_CALL_LOCKED(tefs_format_device_unlocked(num_pages, physical_page_size, logical_block_size, hash_size,
+												 metadata_size, max_file_name_size, erase_before_format));
+}
+
+int8_t
+tefs_mount(
+	void
+)
+{
+	TEFS_CALL_LOCKED(tefs_mount_unlocked());
+}
+
+#if defined(TEFS_DEVICE_BACKEND)
+int8_t
+tefs_select_device(
+	tefs_device_t *device
+)
+{
+	TEFS_CALL_LOCKED(tefs_select_device_unlocked(device));
+}
 #endif
 
-	return TEFS_ERR_OK;
+int8_t
+tefs_open(
+	file_t 		*file,
+	char 		*file_name
+)
+{
+	TEFS_CALL_LOCKED(tefs_open_unlocked(file, file_name));
 }
 
-#if defined(USE_SD)
-static int8_t
-tefs_find_next_empty_block(
-	uint32_t *state_section_bit
+int8_t
+tefs_exists(
+	char *file_name
 )
 {
-	uint32_t current_page = DIV_BY_POW_2_EXP(DIV_BY_POW_2_EXP(*state_section_bit, 3), page_size_exponent);
-	uint16_t current_byte = (uint16_t) MOD_BY_POW_2(DIV_BY_POW_2_EXP(*state_section_bit, 3), page_size);
-	uint8_t byte_buffer = 0;
+	TEFS_CALL_LOCKED(tefs_exists_unlocked(file_name));
+}
 
-	while (current_page < state_section_size)
-	{
-		while (current_byte < page_size)
-		{
-			if (sd_spi_read(current_page + 1, &byte_buffer, 1, current_byte))
-			{
-				return TEFS_ERR_READ;
-			}
+int8_t
+tefs_close(
+	file_t *file
+)
+{
+	TEFS_CALL_LOCKED(tefs_close_unlocked(file));
+}
 
-			if (byte_buffer)
-			{
-				uint8_t mask = 0x80;
-				uint8_t count = 0;
+int8_t
+tefs_remove(
+	char *file_name
+)
+{
+	TEFS_CALL_LOCKED(tefs_remove_unlocked(file_name));
+}
 
-				while (mask != 0 && !(byte_buffer & mask))
-				{
-				    mask >>= 1;
-				    count++;
-				}
+int8_t
+tefs_compact_directory(
+	void
+)
+{
+	TEFS_CALL_LOCKED(tefs_compact_directory_unlocked());
+}
 
-				*state_section_bit = MULT_BY_POW_2_EXP(current_page, page_size_exponent + 3) +
-									 MULT_BY_POW_2_EXP(current_byte, 3) + count;
+int8_t
+tefs_idle(
+	void
+)
+{
+	TEFS_CALL_LOCKED(tefs_idle_unlocked());
+}
 
-				return TEFS_ERR_OK;
-			}
+#if defined(USE_SD)
+int8_t
+tefs_statfs(
+	uint32_t	*number_of_blocks,
+	uint32_t	*number_of_free_blocks
+)
+{
+	TEFS_CALL_LOCKED(tefs_statfs_unlocked(number_of_blocks, number_of_free_blocks));
+}
 
-			current_byte++;
-		}
+int8_t
+tefs_set_allocation_policy(
+	uint8_t policy
+)
+{
+	TEFS_CALL_LOCKED(tefs_set_allocation_policy_unlocked(policy));
+}
+#endif
 
-		current_page++;
-		current_byte = 0;
-	}
+#if defined(TEFS_STATS)
+int8_t
+tefs_get_stats(
+	tefs_stats_t *stats
+)
+{
+	TEFS_CALL_LOCKED(tefs_get_stats_unlocked(stats));
+}
 
-	is_block_pool_empty = 1;
-	return TEFS_ERR_OK;
+int8_t
+tefs_reset_stats(
+	void
+)
+{
+	TEFS_CALL_LOCKED(tefs_reset_stats_unlocked());
 }
 #endif
 
-static void
-tefs_map_page_to_root_index_address(
-	uint32_t 	page,
-	uint16_t 	*page_in_root_index,
-	uint16_t 	*byte_in_root_index_page
+#if defined(TEFS_TRACE)
+int8_t
+tefs_set_trace_hook(
+	tefs_trace_hook_t hook
+)
+{
+	TEFS_CALL_LOCKED(tefs_set_trace_hook_unlocked(hook));
+}
+#endif
+
+int8_t
+tefs_opendir(
+	tefs_dir_t *dir
+)
+{
+	TEFS_CALL_LOCKED(tefs_opendir_unlocked(dir));
+}
+
+int8_t
+tefs_readdir(
+	tefs_dir_t	*dir,
+	char		*file_name,
+	uint32_t	*eof_page,
+	uint16_t	*eof_byte,
+	uint32_t	*root_index_block_address
+)
+{
+	TEFS_CALL_LOCKED(tefs_readdir_unlocked(dir, file_name, eof_page, eof_byte, root_index_block_address));
+}
+
+int8_t
+tefs_closedir(
+	tefs_dir_t *dir
+)
+{
+	TEFS_CALL_LOCKED(tefs_closedir_unlocked(dir));
+}
+
+int8_t
+tefs_release_block(
+	file_t 		*file,
+	uint32_t 	file_block_address
+)
+{
+	TEFS_CALL_LOCKED(tefs_release_block_unlocked(file, file_block_address));
+}
+
+int8_t
+tefs_set_consistency(
+	file_t 		*file,
+	uint8_t		policy,
+	uint16_t	group_pages,
+	uint32_t	group_milliseconds
+)
+{
+	TEFS_CALL_LOCKED(tefs_set_consistency_unlocked(file, policy, group_pages, group_milliseconds));
+}
+
+int8_t
+tefs_fallocate(
+	file_t 		*file,
+	uint32_t 	number_of_pages,
+	uint8_t		erase_blocks
+)
+{
+	TEFS_CALL_LOCKED(tefs_fallocate_unlocked(file, number_of_pages, erase_blocks));
+}
+
+int8_t
+tefs_truncate(
+	file_t 		*file,
+	uint32_t 	eof_page,
+	uint16_t	eof_byte
 )
 {
-	uint32_t child_block_number = DIV_BY_POW_2_EXP(DIV_BY_POW_2_EXP(page, block_size_exponent), addresses_per_block_exponent);
-
-	*page_in_root_index = (uint16_t) DIV_BY_POW_2_EXP(child_block_number, page_size_exponent - address_size_exponent);
-
-	*byte_in_root_index_page = (uint16_t) MOD_BY_POW_2(MULT_BY_POW_2_EXP(child_block_number, address_size_exponent), addresses_per_block);
+	TEFS_CALL_LOCKED(tefs_truncate_unlocked(file, eof_page, eof_byte));
 }
 
-static void
-tefs_map_page_to_child_index_address(
-	uint32_t 	page,
-	uint16_t 	*page_in_child_index,
-	uint16_t 	*byte_in_child_index_page
+int8_t
+tefs_drop_head(
+	file_t 		*file,
+	uint32_t 	file_page_address
 )
 {
-	uint32_t block_in_child_index = MOD_BY_POW_2(DIV_BY_POW_2_EXP(page, block_size_exponent), addresses_per_block);
-
-	*page_in_child_index = (uint16_t) DIV_BY_POW_2_EXP(block_in_child_index, page_size_exponent - address_size_exponent);
+	TEFS_CALL_LOCKED(tefs_drop_head_unlocked(file, file_page_address));
+}
 
-	*byte_in_child_index_page = (uint16_t) MOD_BY_POW_2(MULT_BY_POW_2_EXP(block_in_child_index, address_size_exponent), page_size);
+int8_t
+tefs_write(
+	file_t 		*file,
+	uint32_t	file_page_address,
+	void	 	*data,
+	uint16_t 	number_of_bytes,
+	uint16_t 	byte_offset
+)
+{
+	TEFS_CALL_LOCKED(tefs_write_unlocked(file, file_page_address, data, number_of_bytes, byte_offset));
 }
 
-static int8_t
-tefs_update_file_size(
+int8_t
+tefs_flush(
 	file_t *file
 )
 {
-	int8_t response;
-
-	if (file->directory_page == 0xFFFFFFFF)
-	{
-		if (device_write(0, &(file->eof_page), TEFS_DIR_EOF_PAGE_SIZE, file->directory_byte + TEFS_DIR_STATUS_SIZE))
-		{
-			return TEFS_ERR_WRITE;
-		}
-
-		if (device_write(0, &(file->eof_byte), TEFS_DIR_EOF_BYTE_SIZE, file->directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE))
-		{
-			return TEFS_ERR_WRITE;
-		}
-	}
-	else
-	{
-		if ((response = tefs_write(&metadata, file->directory_page, &(file->eof_page), TEFS_DIR_EOF_PAGE_SIZE, file->directory_byte + TEFS_DIR_STATUS_SIZE)))
-		{
-			return response;
-		}
-
-		if ((response = tefs_write(&metadata, file->directory_page, &(file->eof_byte), TEFS_DIR_EOF_BYTE_SIZE, file->directory_byte + TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE)))
-		{
-			return response;
-		}
-	}
-
-	file->is_file_size_consistent = 1;
-	return TEFS_ERR_OK;
+	TEFS_CALL_LOCKED(tefs_flush_unlocked(file));
 }
 
-static uint8_t
-tefs_power_of_two_exponent(
-	uint32_t number
+int8_t
+tefs_read(
+	file_t 		*file,
+	uint32_t 	file_page_address,
+	void		*buffer,
+	uint16_t 	number_of_bytes,
+	uint16_t 	byte_offset
 )
 {
-	uint8_t position = 0;
-
-	while (((number & 1) == 0) && number > 1)
-	{
-		number >>= 1;
-		position++;
-	}
-
-	return position;
+	TEFS_CALL_LOCKED(tefs_read_unlocked(file, file_page_address, buffer, number_of_bytes, byte_offset));
 }
 
-static int8_t
-tefs_load_card_data(
-	void
+int8_t
+tefs_read_pages(
+	file_t		*file,
+	uint32_t	first_file_page_address,
+	uint32_t	number_of_pages,
+	void		*buffer
 )
 {
-	uint16_t 	current_byte 	= 0;
-	uint8_t		buffer 			= 0;
-
-	/* Read and verify the check flag. */
-	for (current_byte = 0; current_byte < 4; current_byte++)
-	{
-		if (device_read(0, &buffer, 1, current_byte))
-		{
-			return TEFS_ERR_READ;
-		}
-
-		if (buffer != TEFS_CHECK_FLAG)
-		{
-			return TEFS_ERR_NOT_FORMATTED;
-		}
-	}
-
-	/* Read the number of pages that the device has. */
-	if (device_read(0, &number_of_pages, 4, current_byte))
-	{
-		return TEFS_ERR_READ;
-	}
-
-	current_byte += 4;
-
-	/* Read the physical page size. */
-	if (device_read(0, &page_size_exponent, 1, current_byte))
-	{
-		return TEFS_ERR_READ;
-	}
-
-	current_byte += 1;
+	TEFS_CALL_LOCKED(tefs_read_pages_unlocked(file, first_file_page_address, number_of_pages, buffer));
+}
 
-	/* Read the block size. */
-	if (device_read(0, &block_size_exponent, 1, current_byte))
-	{
-		return TEFS_ERR_READ;
-	}
+#if defined(TEFS_CONTINUOUS_SUPPORT)
+/* The device lock is held from the start of a sequence until it is stopped,
+   so the functions in between do not take it. */
+int8_t
+tefs_write_continuous_start(
+	file_t 		*file,
+	uint32_t 	start_file_page_address
+)
+{
+	int8_t response;
 
-	current_byte += 1;
+	TEFS_LOCK_DEVICE();
 
-	/* Read the address size. */
-	if (device_read(0, &address_size_exponent, 1, current_byte))
+	if ((response = tefs_write_continuous_start_unlocked(file, start_file_page_address)))
 	{
-		return TEFS_ERR_READ;
+		TEFS_UNLOCK_DEVICE();
 	}
 
-	current_byte += 1;
-
-	/* Read the size of a hash. */
-	if (device_read(0, &hash_size, 1, current_byte))
-	{
-		return TEFS_ERR_READ;
-	}
+	return response;
+}
 
-	current_byte += 1;
+int8_t
+tefs_write_continuous_stop(
+	file_t *file
+)
+{
+	int8_t response = tefs_write_continuous_stop_unlocked(file);
 
-	/* Read the size of a metadata record. */
-	if (device_read(0, &metadata_size, 2, current_byte))
-	{
-		return TEFS_ERR_WRITE;
-	}
+	TEFS_UNLOCK_DEVICE();
 
-	current_byte += 2;
+	return response;
+}
 
-	/* Write the max size for a file name. */
-	if (device_read(0, &max_file_name_size, 2, current_byte))
-	{
-		return TEFS_ERR_WRITE;
-	}
+int8_t
+tefs_read_continuous_start(
+	file_t 		*file,
+	uint32_t 	start_file_page_address
+)
+{
+	int8_t response;
 
-	current_byte += 2;
+	TEFS_LOCK_DEVICE();
 
-#if defined(USE_SD)
-	/* Read the state section size. */
-	if (device_read(0, &state_section_size, 4, current_byte))
+	if ((response = tefs_read_continuous_start_unlocked(file, start_file_page_address)))
 	{
-		return TEFS_ERR_READ;
+		TEFS_UNLOCK_DEVICE();
 	}
 
-	current_byte += 4;
-#endif
-
-	block_size 		= (uint16_t) POW_2_TO(block_size_exponent);
-	page_size 		= (uint16_t) POW_2_TO(page_size_exponent);
-	address_size 	= (uint8_t) POW_2_TO(address_size_exponent);
-
-	addresses_per_block = DIV_BY_POW_2_EXP(MULT_BY_POW_2_EXP(page_size, block_size_exponent), address_size_exponent);
-	addresses_per_block_exponent = tefs_power_of_two_exponent(addresses_per_block);
-
-	int8_t response;
-	int8_t i;
-	file_t *temp_file = &hash_entries;
-	for (i = 0; i < 2; i++)
-	{
-		/* Set file size to 0 for hash file directory entry. */
-		if (device_read(0, &(temp_file->eof_page), TEFS_DIR_EOF_PAGE_SIZE, current_byte))
-		{
-			return TEFS_ERR_READ;
-		}
-
-		current_byte += TEFS_DIR_EOF_PAGE_SIZE;
-
-		if (device_read(0, &(temp_file->eof_byte), TEFS_DIR_EOF_BYTE_SIZE, current_byte))
-		{
-			return TEFS_ERR_READ;
-		}
-
-		current_byte += TEFS_DIR_EOF_BYTE_SIZE;
-
-		/* Read root index block address from the information page. */
-		if (device_read(0, &(temp_file->root_index_block_address), address_size, current_byte))
-		{
-			return TEFS_ERR_WRITE;
-		}
-
-		current_byte += 4;
-
-		if (temp_file->eof_page >= MULT_BY_POW_2_EXP(block_size, page_size_exponent - address_size_exponent))
-		{
-			/* Read the first child index block address. */
-			if (device_read(temp_file->root_index_block_address, &(temp_file->child_index_block_address), address_size, 0))
-			{
-				return TEFS_ERR_READ;
-			}
-
-			/* Read the first data block address. */
-			if (device_read(temp_file->child_index_block_address, &(temp_file->data_block_address), address_size, 0))
-			{
-				return TEFS_ERR_READ;
-			}
-		}
-		else
-		{
-			temp_file->child_index_block_address = temp_file->root_index_block_address;
-
-			/* Read the first data block address. */
-			if (device_read(temp_file->child_index_block_address, &(temp_file->data_block_address), address_size, 0))
-			{
-				return TEFS_ERR_READ;
-			}
-		}
-
-		temp_file->directory_page 			= 0xFFFFFFFF;
-		temp_file->directory_byte 			= current_byte;
-		temp_file->current_page_number 		= 0;
-		temp_file->data_block_number 		= 0;
-		temp_file->is_file_size_consistent 	= 1;
+	return response;
+}
 
-		temp_file = &metadata;
-	}
+int8_t
+tefs_read_continuous_stop(
+	file_t *file
+)
+{
+	int8_t response = tefs_read_continuous_stop_unlocked(file);
 
-#if defined(USE_SD)
-	/* Get first byte in state for a free block. */
-	state_section_bit = 0;
+	TEFS_UNLOCK_DEVICE();
 
-	if ((response = tefs_find_next_empty_block(&state_section_bit)))
-	{
-		return response;
-	}
+	return response;
+}
 #endif
 
-// #if DEBUG == 1
-// #if defined(USE_SD)
-// 	printf("State section bit: %u\n", state_section_bit);
-// 	printf("State section size: %u\n", state_section_size);
-// #endif
-// 	printf("Directory size: %u\n", directory_size);
-// 	printf("Number of pages: %u\n", number_of_pages);
-// 	printf("Page size: %u\n", page_size);
-// 	printf("Page size exponent: %u\n", page_size_exponent);
-// 	printf("Addresses per block: %u\n", addresses_per_block);
-// 	printf("Addresses per block exponent: %u\n", addresses_per_block_exponent);
-// 	printf("Block size: %u\n", block_size);
-// 	printf("Block size exponent: %u\n", block_size_exponent);
-// 	printf("Address size: %u\n", address_size);
-// 	printf("Address size exponent: %u\n", address_size_exponent);
-// #endif
-
-	return TEFS_ERR_OK;
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+int8_t
+tefs_map_page(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint8_t		**page_data
+)
+{
+	TEFS_CALL_LOCKED(tefs_map_page_unlocked(file, file_page_address, page_data));
 }
 
-static uint32_t
-hash_string(
-	char *str
+int8_t
+tefs_commit_page(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
 )
 {
-	uint32_t hash = 5381;
-	int8_t c;
-
-	while ((c = *str++))
-	{
-		hash = (uint32_t)((hash << 5) + hash) ^ c; /* hash * 33 ^ c */
-	}
-
-	if (hash == 0)
-	{
-		hash = 1;
-	}
+	TEFS_CALL_LOCKED(tefs_commit_page_unlocked(file, file_page_address, number_of_bytes, byte_offset));
+}
 
-	if (hash_size == 4)
-	{
-		return hash;
-	}
-	else
-	{
-		return hash % 65521;
-	}
-}
\ No newline at end of file
+int8_t
+tefs_unmap_page(
+	file_t		*file,
+	uint32_t	file_page_address
+)
+{
+	TEFS_CALL_LOCKED(tefs_unmap_page_unlocked(file, file_page_address));
+}
+#endif
+#endif
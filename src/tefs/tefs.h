@@ -10,6 +10,16 @@
 			memory); opening, closing, and removing a file; and formatting the
 			storage device.
 
+			With TEFS_THREAD_SAFE, each function holds a single lock for the
+			device for the whole call. There are no locks for each volume or
+			file, so calls from different threads never overlap, even when
+			they read unrelated files. The buffer of the device, the page
+			cache and the block allocator are shared by every file and almost
+			every call goes through them, so a narrower lock would still
+			serialize the calls. The lock is kept from the start to the stop of
+			a continuous read or write. A file_t must only be used by one
+			thread at a time.
+
 @copyright  Copyright 2015 Wade Penson
 
 		    Licensed under the Apache License, Version 2.0 (the "License");
@@ -45,24 +55,88 @@ extern "C" {
 volatile flare_ftl_t ftl;
 #endif
 
+#if defined(TEFS_DEVICE_BACKEND)
+#if !defined(USE_SD)
+#error "TEFS_DEVICE_BACKEND takes the place of an SD card and requires USE_SD."
+#endif
+#if defined(TEFS_CONTINUOUS_SUPPORT)
+#error "TEFS_CONTINUOUS_SUPPORT requires an SD card and cannot be used with TEFS_DEVICE_BACKEND."
+#endif
+
+#include <stdint.h>
+
+/* Variable to toggle reading before writing to a page of the device buffer. */
+extern uint8_t tefs_device_dirty_write;
+#define sd_spi_dirty_write tefs_device_dirty_write
+#else
 /* Note: SD_BUFFER must be defined in SD SPI. */
 #include "sd_spi/src/sd_spi.h"
 
 /* Variable to toggle reading before writing to a page.  */
 extern uint8_t sd_spi_dirty_write;
+#endif
+
+/* The functions that access the pages of the device directly. */
+#if defined(TEFS_DEVICE_BACKEND)
+#define device_raw_write(page, data, length, offset) \
+		tefs_device_write(page, data, length, offset)
+#define device_raw_read(page, buffer, length, offset) \
+		tefs_device_read(page, buffer, length, offset)
+#define device_raw_flush() tefs_device_flush()
+#define device_raw_erase(start_page, end_page) tefs_device_erase(start_page, end_page)
+#define device_raw_erase_all() tefs_device_erase(0, 0xFFFFFFFF)
+#define device_raw_buffered_page() tefs_device_buffered_page()
+#elif defined(USE_SD)
+#define device_raw_write(page, data, length, offset) \
+		sd_spi_write(page, data, length, offset)
+#define device_raw_read(page, buffer, length, offset) \
+		sd_spi_read(page, buffer, length, offset)
+#define device_raw_flush() sd_spi_flush()
+#define device_raw_erase(start_page, end_page) sd_spi_erase(start_page, end_page)
+#define device_raw_erase_all() sd_spi_erase_all()
+#define device_raw_buffered_page() sd_spi_current_buffered_block()
+#endif
 
 #if defined(USE_DATAFLASH) && defined(USE_FTL)
-#define device_write(page, data, length, offset) \
+#define device_base_write(page, data, length, offset) \
 		flare_WriteBytes(&ftl, page + 16, data, offset, length, 1)
-#define device_read(page, buffer, length, offset) \
+#define device_base_read(page, buffer, length, offset) \
 		flare_ReadBytes(&ftl, page + 16, buffer, offset, length)
-#define device_flush() 1==0//df_flush()
+#define device_base_flush() 1==0//df_flush()
+#define device_is_page_buffered(page) 0
+#elif defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+#define device_base_write(page, data, length, offset) \
+		tefs_cache_write(page, data, length, offset)
+#define device_base_read(page, buffer, length, offset) \
+		tefs_cache_read(page, buffer, length, offset)
+#define device_base_flush() tefs_cache_flush()
+/* A page that is not in the cache is read from the card before it is
+   written to. */
+#define device_is_page_buffered(page) 0
 #elif defined(USE_SD)
+#define device_base_write(page, data, length, offset) \
+		device_raw_write(page, data, length, offset)
+#define device_base_read(page, buffer, length, offset) \
+		device_raw_read(page, buffer, length, offset)
+#define device_base_flush() device_raw_flush()
+#define device_is_page_buffered(page) (device_raw_buffered_page() == (page))
+#endif
+
+/* The functions that TEFS accesses the device with. With TEFS_STATS or
+   TEFS_TRACE, each access goes through a function that counts it and passes it
+   to the trace hook. */
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
 #define device_write(page, data, length, offset) \
-		sd_spi_write(page, data, length, offset)
+		tefs_stats_write(page, data, length, offset)
 #define device_read(page, buffer, length, offset) \
-		sd_spi_read(page, buffer, length, offset)
-#define device_flush() sd_spi_flush()
+		tefs_stats_read(page, buffer, length, offset)
+#define device_flush() tefs_stats_flush()
+#else
+#define device_write(page, data, length, offset) \
+		device_base_write(page, data, length, offset)
+#define device_read(page, buffer, length, offset) \
+		device_base_read(page, buffer, length, offset)
+#define device_flush() device_base_flush()
 #endif
 
 #define POW_2_TO(exponent) 						(((uint32_t) 1) << (exponent))
@@ -70,11 +144,19 @@ extern uint8_t sd_spi_dirty_write;
 #define DIV_BY_POW_2_EXP(expression, exponent) 	((expression) >> (exponent))
 #define MOD_BY_POW_2(expression, constant) 		((expression) & ((constant) - 1))
 
-// TODO: Finish implementing continuous support
-//#define TEFS_CONTINUOUS_SUPPORT
-
 #define TEFS_INFO_SECTION_SIZE				((uint8_t) 1)
 
+/* The fields of the information page followed by the directory entries of
+   the hash entries file and the metadata file. On an SD card, they are
+   followed by the free block hint, the number of used blocks and the
+   allocation cursor. */
+#if defined(USE_SD)
+#define TEFS_INFO_FREE_SPACE_BYTE			((uint8_t) 40)
+#define TEFS_INFO_HEADER_SIZE				((uint8_t) 52)
+#else
+#define TEFS_INFO_HEADER_SIZE				((uint8_t) 36)
+#endif
+
 #define TEFS_DIR_STATUS_SIZE				((uint8_t) 1)
 #define TEFS_DIR_EOF_PAGE_SIZE				((uint8_t) 4)
 #define TEFS_DIR_EOF_BYTE_SIZE				((uint8_t) 2)
@@ -110,11 +192,157 @@ extern uint8_t sd_spi_dirty_write;
 #define TEFS_ERR_WRITE_PAST_END		9
 #define TEFS_ERR_EOF				10
 #define TEFS_ERR_FILE_NAME_TOO_LONG	11
+#define TEFS_ERR_PAGE_NOT_MAPPED	13
+#define TEFS_ERR_QUEUE_FULL			14
+#define TEFS_ERR_PAGE_RELEASED		15
+#define TEFS_ERR_PAGE_SIZE			16
 /** @} End of group tefs_err_codes */
 
+/**
+@defgroup tefs_consistency	Policies for when the size of a file is written
+							out to its directory entry.
+@{
+*/
+/** The size is only written out when the file is flushed or closed. */
+#define TEFS_CONSISTENCY_FLUSH		0
+/** The size is written out when a write or read moves to a different page. */
+#define TEFS_CONSISTENCY_PAGE		1
+/** The size is written out by every write that changes it. */
+#define TEFS_CONSISTENCY_RECORD		2
+/** The size is written out once the file has grown by a number of pages or
+	the time since it was last written out has passed an interval. */
+#define TEFS_CONSISTENCY_GROUP		3
+/** @} End of group tefs_consistency */
+
+/**
+@defgroup tefs_allocation	Policies for where the blocks that files grow
+							into are reserved on an SD card.
+@{
+*/
+/** The policy that is defined as TEFS_DEFAULT_ALLOCATION_POLICY. */
+#define TEFS_ALLOCATE_DEFAULT		0
+/** The free blocks with the lowest addresses are reserved first. */
+#define TEFS_ALLOCATE_LOWEST		1
+/** The search for free blocks starts from where the previously reserved
+	blocks end and it wraps around at the end of the device. The first run of
+	free blocks with room for all of the blocks is used (a shorter run is used
+	if there is none close by). */
+#define TEFS_ALLOCATE_NEXT_FIT		2
+/** Like TEFS_ALLOCATE_NEXT_FIT, but the search starts from the block after
+	the current data block of the file, so the blocks of a file that grows
+	stay together. */
+#define TEFS_ALLOCATE_NEAR_FILE		3
+/** Every free block is reserved in turn from where the previously reserved
+	blocks end, so blocks that are released are only reused once the search
+	has wrapped around the device. This spreads the writes over the device. */
+#define TEFS_ALLOCATE_ROUND_ROBIN	4
+/** @} End of group tefs_allocation */
+
 /* Return code used internally that indicates if a new file has been created. */
 #define TEFS_NEW_FILE	    		12
 
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+/**
+@defgroup tefs_regions	The regions of a volume that device accesses are
+						counted for.
+@{
+*/
+/** The information page. */
+#define TEFS_REGION_INFO			0
+/** The state section. */
+#define TEFS_REGION_STATE			1
+/** The pages of the hash entries file and the metadata file. */
+#define TEFS_REGION_DIRECTORY		2
+/** The index blocks of files (and other pages that are not data). */
+#define TEFS_REGION_INDEX			3
+/** The data pages of files. */
+#define TEFS_REGION_DATA			4
+/** The number of regions. */
+#define TEFS_NUMBER_OF_REGIONS		5
+/** @} End of group tefs_regions */
+
+/**
+@defgroup tefs_trace_operations	The device operations that are passed to the
+								trace hook.
+@{
+*/
+#define TEFS_TRACE_READ				0
+#define TEFS_TRACE_WRITE			1
+#define TEFS_TRACE_FLUSH			2
+/** @} End of group tefs_trace_operations */
+#endif
+
+#if defined(TEFS_STATS)
+/** Counters of the work done on a volume since it was zeroed or the counters
+	were reset with tefs_reset_stats(). The reads and writes are the ones that
+	TEFS makes to the device buffer (or the page cache), so the misses are the
+	ones that reached the device. The pages of a continuous read or write and
+	of tefs_read_pages() are counted one page at a time (a device backend reads
+	the pages of a sequence with one read). */
+typedef struct
+{
+	/** The number of reads from the device in each of the TEFS_REGION_*
+		regions. */
+	uint32_t	device_reads[TEFS_NUMBER_OF_REGIONS];
+	/** The number of writes to the device in each of the TEFS_REGION_*
+		regions. */
+	uint32_t	device_writes[TEFS_NUMBER_OF_REGIONS];
+	/** The number of flushes of the device. */
+	uint32_t	device_flushes;
+	/** The number of reads and writes of a page that was already in the
+		device buffer or the page cache. */
+	uint32_t	buffer_hits;
+	/** The number of reads and writes of a page that had to be loaded into
+		the device buffer or the page cache. */
+	uint32_t	buffer_misses;
+	/** The number of blocks that were marked as reserved in the state
+		section. */
+	uint32_t	blocks_reserved;
+	/** The number of blocks that were marked as free in the state section. */
+	uint32_t	blocks_released;
+	/** The number of directory lookups of a file name. */
+	uint32_t	lookups;
+	/** The total number of hash entries that the lookups looked at. */
+	uint32_t	lookup_probes;
+	/** The most hash entries that a single lookup looked at. */
+	uint32_t	lookup_max_probes;
+	/** The number of metadata entries whose names were compared by the
+		lookups (one for each hash that matched). */
+	uint32_t	lookup_name_compares;
+} tefs_stats_t;
+#endif
+
+#if defined(TEFS_TRACE)
+/** A function that is called after each read, write and flush of the device.
+	It is passed the operation (one of the TEFS_TRACE_* definitions), the
+	region of the page (one of the TEFS_REGION_* definitions), the page and
+	the number of bytes (both 0 for a flush), the error code of the operation
+	and how long it took in microseconds (0 if TEFS_TRACE_MICROSECONDS is not
+	defined). */
+typedef void (*tefs_trace_hook_t)(uint8_t operation, uint8_t region, uint32_t page, uint32_t number_of_bytes, int8_t response, uint32_t elapsed_microseconds);
+#endif
+
+#if defined(TEFS_DEVICE_BACKEND)
+/** A device that a volume is stored on. The device is made up of pages of
+	TEFS_DEVICE_PAGE_SIZE bytes and each function returns 0 if it succeeds.
+	A backend that needs more state puts this structure at the start of its
+	own one. */
+typedef struct tefs_device
+{
+	/** Reads a number of whole pages starting at a page into a buffer. */
+	int8_t		(*read_pages)(struct tefs_device *device, uint32_t page, uint32_t number_of_pages, void *buffer);
+	/** Writes a number of whole pages starting at a page from a buffer. */
+	int8_t		(*write_pages)(struct tefs_device *device, uint32_t page, uint32_t number_of_pages, void *data);
+	/** Makes the pages that have been written persistent (it may be NULL). */
+	int8_t		(*flush)(struct tefs_device *device);
+	/** Erases the pages from a start page to an end page (inclusive) so
+		that they read as zeros. If it is NULL, zeros are written instead. */
+	int8_t		(*erase_range)(struct tefs_device *device, uint32_t start_page, uint32_t end_page);
+	/** The number of pages on the device. */
+	uint32_t	number_of_pages;
+} tefs_device_t;
+#endif
+
 /** File structure. */
 typedef struct file
 {
@@ -132,14 +360,442 @@ typedef struct file
 	uint32_t	directory_page;
 	/** The byte in the page in the metadata file where the metadata is stored for the file. */
 	uint16_t	directory_byte;
+	/** The data blocks before this one have been released by tefs_drop_head() (it is found again when the file is opened). */
+	uint32_t	first_block_number;
 	/** The last page of the file. (For keeping track of the file size) */
 	uint32_t	eof_page;
 	/** The last byte in the last page of the file. (For keeping track of the file size) */
 	uint16_t	eof_byte;
 	/** Keeps track if the file size has been written out to the directory entry after more data is written. */
 	uint8_t 	is_file_size_consistent;
+	/** When the file size is written out to the directory entry (one of the TEFS_CONSISTENCY_* definitions). */
+	uint8_t		consistency_policy;
+	/** The number of pages that the file grows by before its size is written out with TEFS_CONSISTENCY_GROUP
+		(0 for no limit). */
+	uint16_t	group_commit_pages;
+	/** The number of milliseconds after which the size is written out with TEFS_CONSISTENCY_GROUP (0 for no limit). */
+	uint32_t	group_commit_interval;
+	/** The last page of the file when its size was last written out. */
+	uint32_t	committed_eof_page;
+	/** The time in milliseconds when the file size was last written out. */
+	uint32_t	committed_time;
+	/** The number of data blocks that have been allocated for the file (including the ones past the
+		end of the file that were allocated by tefs_fallocate()). */
+	uint32_t	number_of_allocated_blocks;
+	/** Blocks that have been reserved ahead for the file as it grows. */
+	uint32_t	reserved_blocks[TEFS_RESERVE_AHEAD_SIZE];
+	/** The number of blocks in reserved_blocks that have not been used yet. */
+	uint8_t		number_of_reserved_blocks;
+	/** The index in reserved_blocks of the next block to use. */
+	uint8_t		next_reserved_block;
+#if defined(TEFS_EXTENT_SUPPORT)
+	/** The device address of the first data block of the file. */
+	uint32_t	extent_address;
+	/** The number of data blocks from the start of the file that follow extent_address on the device. */
+	uint32_t	extent_length;
+	/** 1 if the data block after the extent is not contiguous with it. */
+	uint8_t		is_extent_ended;
+#endif
+#if defined(TEFS_INDEX_CACHE_SIZE)
+	/** Part of the child index page that was previously read from or written to. */
+	uint8_t		index_cache[TEFS_INDEX_CACHE_SIZE];
+	/** The device page that the cached part of the child index is from (0 if nothing is cached). */
+	uint32_t	index_cache_page;
+	/** The byte in the page where the cached part of the child index starts. */
+	uint16_t	index_cache_byte;
+	/** 1 if the cache has addresses that have not been written out to the device and 2 if the
+		page was also empty before they were added. */
+	uint8_t		is_index_cache_dirty;
+#endif
+	/** The volume that the file is on. */
+	struct tefs_volume	*volume;
 } file_t;
 
+/** The state of a mounted TEFS volume. A volume that is selected with
+	tefs_select_volume() must be zeroed before it is first used and its data
+	is then loaded from the device by the first function that needs it. */
+typedef struct tefs_volume
+{
+#if defined(TEFS_DEVICE_BACKEND)
+	/** The device that the volume is stored on or NULL for the device of the
+		default volume. */
+	tefs_device_t	*device;
+#endif
+#if defined(USE_SD)
+	/** Current bit that represents a free block in the state section. */
+	uint32_t	state_section_bit;
+	/** The size of the state section. */
+	uint32_t	state_section_size;
+	/** Keeps track if the state section is empty or not. */
+	uint8_t		is_block_pool_empty;
+	/** The first bit of each free extent (a run of free blocks) in the cache. The
+		extents are kept in ascending order. */
+	uint32_t	free_extent_start[TEFS_FREE_EXTENT_CACHE_SIZE];
+	/** The number of blocks in each free extent in the cache. */
+	uint32_t	free_extent_length[TEFS_FREE_EXTENT_CACHE_SIZE];
+	/** The number of extents in the free extent cache. */
+	uint8_t		free_extent_count;
+	/** Every free block before this bit in the state section is in the free
+		extent cache. The state section is scanned from here when the cache is
+		empty. */
+	uint32_t	free_extent_scan_bit;
+	/** The first bit of each run of blocks that is waiting to be released. */
+	uint32_t	release_run_start[TEFS_RELEASE_BUFFER_SIZE];
+	/** The number of blocks in each run that is waiting to be released. */
+	uint32_t	release_run_length[TEFS_RELEASE_BUFFER_SIZE];
+	/** The number of runs that are waiting to be released. */
+	uint8_t		release_run_count;
+	/** The number of blocks that the state section has bits for. */
+	uint32_t	number_of_blocks;
+	/** The number of blocks that are marked as reserved in the state section
+		or 0 if it has not been counted. */
+	uint32_t	used_block_count;
+	/** 1 if the free block hint and the used block count in the information
+		page are up to date. They are set to 0 on the device before the state
+		section is changed. */
+	uint8_t		is_free_space_written;
+	/** Where blocks are reserved (one of the TEFS_ALLOCATE_* definitions). */
+	uint8_t		allocation_policy;
+	/** The bit in the state section that the next fit and round robin
+		policies search for free blocks from. It is written out with the free
+		block hint. */
+	uint32_t	allocation_cursor;
+#endif
+#if defined(TEFS_LAZY_FREE_QUEUE_SIZE)
+	/** The root index block address of each removed file that still has its
+		blocks reserved. */
+	uint32_t	lazy_free_root_index_address[TEFS_LAZY_FREE_QUEUE_SIZE];
+	/** The last page of each removed file that still has its blocks reserved. */
+	uint32_t	lazy_free_eof_page[TEFS_LAZY_FREE_QUEUE_SIZE];
+	/** The last byte in the last page of each removed file that still has its
+		blocks reserved. */
+	uint16_t	lazy_free_eof_byte[TEFS_LAZY_FREE_QUEUE_SIZE];
+	/** The number of removed files that still have their blocks reserved. */
+	uint8_t		lazy_free_count;
+#endif
+	/** The number of pages that the device has. */
+	uint32_t	number_of_pages;
+	/** The size of a page in bytes. */
+	uint16_t	page_size;
+	/** The number of addresses that can fit into a block. */
+	uint32_t	addresses_per_block;
+	/** The size of a block in pages. */
+	uint16_t	block_size;
+	/** The size of an address in bytes. */
+	uint8_t		address_size;
+	/** The power of 2 exponent for the size of a page (used to improve
+		performance). */
+	uint8_t		page_size_exponent;
+	/** The power of 2 exponent for the number of addresses that can fit into a
+		block (used to improve performance). */
+	uint8_t		addresses_per_block_exponent;
+	/** The power of 2 exponent for the size of a block (used to improve
+		performance). */
+	uint8_t		block_size_exponent;
+	/** The power of 2 exponent for the size of an address (used to improve
+		performance). */
+	uint8_t		address_size_exponent;
+	/**	The size of a hash value. Either 2 or 4 bytes. */
+	uint8_t		hash_size;
+	/** The power of 2 exponent for the size of a hash value. */
+	uint8_t		hash_size_exponent;
+	/** The size of a metadata entry. */
+	uint16_t	metadata_size;
+	/** The max size for a file name. */
+	uint16_t	max_file_name_size;
+	/** Metadata entries file used by the directory. */
+	file_t		metadata;
+	/** Hash entries file used by the directory. */
+	file_t		hash_entries;
+#if defined(TEFS_HASH_INDEX_SIZE)
+	/** Copy of the first hash entries in the hash entries file. The hash at an
+		index belongs to the directory entry with the same index. */
+	uint32_t	hash_index[TEFS_HASH_INDEX_SIZE];
+	/** The number of hash entries that are in the index. */
+	uint32_t	hash_index_count;
+#endif
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	/** The state of each file in the open cache from when it was last
+		closed. The directory entry is also kept for a file that is open. */
+	file_t		open_cache_file[TEFS_OPEN_CACHE_SIZE];
+	/** The hash of the name of each file in the open cache. */
+	uint32_t	open_cache_hash[TEFS_OPEN_CACHE_SIZE];
+	/** The name of each file in the open cache. */
+	char		open_cache_name[TEFS_OPEN_CACHE_SIZE][TEFS_OPEN_CACHE_NAME_SIZE + 1];
+	/** When each file in the open cache was last opened or 0 if the slot is
+		not used. */
+	uint32_t	open_cache_time[TEFS_OPEN_CACHE_SIZE];
+	/** The number of times that each file in the open cache is open. */
+	uint8_t		open_cache_count[TEFS_OPEN_CACHE_SIZE];
+	/** 1 if a file in the open cache has been opened more than once at a
+		time. Its state is not kept when it is closed. */
+	uint8_t		open_cache_is_stale[TEFS_OPEN_CACHE_SIZE];
+	/** The time of the last open for the least recently used replacement. */
+	uint32_t	open_cache_clock;
+#endif
+#if defined(TEFS_STATS)
+	/** The counters of the volume. */
+	tefs_stats_t	stats;
+#endif
+#if defined(TEFS_TRACE)
+	/** The function that is called for each device operation or NULL. */
+	tefs_trace_hook_t	trace_hook;
+#endif
+} tefs_volume_t;
+
+/** An iterator over the files on a volume that is opened with tefs_opendir().
+	The hash entries and the metadata entries are read into its buffers a
+	piece of a page at a time. */
+typedef struct
+{
+	/** The volume that the directory was opened on. */
+	tefs_volume_t	*volume;
+	/** The next directory entry to look at. */
+	uint32_t		entry_number;
+	/** A piece of the hash entries file. */
+	uint32_t		hash_buffer[TEFS_SCAN_BUFFER_SIZE / 4];
+	/** The directory entry of the first hash in the hash buffer. */
+	uint32_t		hash_entry_number;
+	/** The number of hashes in the hash buffer. */
+	uint16_t		number_of_hashes;
+	/** Consecutive entries of the metadata file. Only the static data and the
+		name of the last entry are read. */
+	uint8_t			metadata_buffer[TEFS_SCAN_BUFFER_SIZE];
+	/** The directory entry of the first entry in the metadata buffer. */
+	uint32_t		metadata_entry_number;
+	/** The number of entries in the metadata buffer. */
+	uint16_t		number_of_metadata_entries;
+} tefs_dir_t;
+
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+/**
+@brief		Writes data to a page through the page cache.
+@details	The page is read into the cache first unless sd_spi_dirty_write is
+			set, in which case the rest of the page is filled with zeros.
+
+@param		page				The address of the page on the device.
+@param[in]	data				An array of data / an address to the data in
+								memory.
+@param		number_of_bytes		The size of the data in bytes.
+@param		byte_offset			The byte offset of where to start writing in the
+								page.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_cache_write(
+	uint32_t	page,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+);
+
+/**
+@brief		Reads data from a page through the page cache.
+
+@param		page				The address of the page on the device.
+@param[out]	buffer				A location in memory to write the data to.
+@param		number_of_bytes		The number of bytes to read.
+@param		byte_offset			The byte offset of where to start reading in the
+								page.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_cache_read(
+	uint32_t	page,
+	void		*buffer,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+);
+
+/**
+@brief		Writes out every page in the page cache that has been changed and
+			flushes the buffer of the card.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_cache_flush(
+	void
+);
+#endif
+
+#if defined(TEFS_DEVICE_BACKEND)
+/**
+@brief		Writes data to a page of the device through the device buffer.
+@details	The page is read into the buffer first unless sd_spi_dirty_write
+			is set, in which case the rest of the page is filled with zeros. A
+			whole page that is not in the buffer is written to the device
+			directly.
+
+@param		page				The address of the page on the device.
+@param[in]	data				An array of data / an address to the data in
+								memory.
+@param		number_of_bytes		The size of the data in bytes.
+@param		byte_offset			The byte offset of where to start writing in the
+								page.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_device_write(
+	uint32_t	page,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+);
+
+/**
+@brief		Reads data from a page of the device through the device buffer.
+			A whole page that is not in the buffer is read from the device
+			directly.
+
+@param		page				The address of the page on the device.
+@param[out]	buffer				A location in memory to write the data to.
+@param		number_of_bytes		The number of bytes to read.
+@param		byte_offset			The byte offset of where to start reading in the
+								page.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_device_read(
+	uint32_t	page,
+	void		*buffer,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+);
+
+/**
+@brief		Writes out the device buffer if it has been changed and flushes
+			the device.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_device_flush(
+	void
+);
+
+/**
+@brief		Erases a range of pages on the device.
+
+@param		start_page	The first page to erase.
+@param		end_page	The last page to erase (past the last page of the
+						device for every page up to the end).
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_device_erase(
+	uint32_t start_page,
+	uint32_t end_page
+);
+
+/**
+@brief		Gets the page of the device that is in the device buffer.
+
+@return		The address of the page or 0xFFFFFFFF if no page is buffered.
+*/
+uint32_t
+tefs_device_buffered_page(
+	void
+);
+#endif
+
+#if defined(TEFS_STATS) || defined(TEFS_TRACE)
+/**
+@brief		Writes data to a page of the device and counts the write for the
+			current volume.
+@details	The write is counted in the region that the page belongs to and
+			passed to the trace hook of the volume.
+
+@param		page				The address of the page on the device.
+@param[in]	data				An array of data / an address to the data in
+								memory.
+@param		number_of_bytes		The size of the data in bytes.
+@param		byte_offset			The byte offset of where to start writing in the
+								page.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_stats_write(
+	uint32_t	page,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+);
+
+/**
+@brief		Reads data from a page of the device and counts the read for the
+			current volume.
+
+@param		page				The address of the page on the device.
+@param[out]	buffer				A location in memory to write the data to.
+@param		number_of_bytes		The number of bytes to read.
+@param		byte_offset			The byte offset of where to start reading in the
+								page.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_stats_read(
+	uint32_t	page,
+	void		*buffer,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+);
+
+/**
+@brief		Flushes the device and counts the flush for the current volume.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_stats_flush(
+	void
+);
+#endif
+
+/**
+@brief		Selects the volume that tefs_format_device(), tefs_open(),
+			tefs_exists(), tefs_remove() and tefs_idle() work with.
+@details	A volume is used until another one is selected (by the same thread
+			if TEFS_THREAD_SAFE is defined). The functions that take a file
+			work with the volume that the file was opened on. The buffer of the
+			device and the page cache are written out when a function works
+			with a different volume than the previous one.
+
+@param		new_volume	A zeroed or previously used tefs_volume_t structure or
+						NULL for the default volume.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_select_volume(
+	tefs_volume_t *new_volume
+);
+
+#if defined(TEFS_DEVICE_BACKEND)
+/**
+@brief		Sets the device that the selected volume is stored on.
+@details	The volume is loaded from the device again by the next function
+			that needs it. A volume without a device (such as a zeroed
+			tefs_volume_t) is stored on the device of the default volume.
+
+@param		device	A device backend or NULL for the device of the default
+					volume.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_select_device(
+	tefs_device_t *device
+);
+#endif
+
 /**
 @brief		Formats the storage device with TEFS.
 
@@ -147,7 +803,8 @@ typedef struct file
 								has.
 @param		physical_page_size	The size of the pages in bytes. The page size 
 								must be a power of two and it can range from
-								2^0 (1) to 2^15 (32768).
+								2^0 (1) to 2^15 (32768). With a device backend,
+								it must be TEFS_DEVICE_PAGE_SIZE.
 @param		block_size			The size of a block in terms of pages (not bytes).
 								The block size must be a power of two and it can
 								range from 2^5 (32) to 2^15 (32768).
@@ -175,9 +832,27 @@ tefs_format_device(
 	uint8_t		erase_before_format
 );
 
+/**
+@brief		Mounts the selected volume.
+@details	The information page is read with a single read, the sizes
+			derived from it are computed, the directory files are set up and
+			the first free block is found. Otherwise, this is done by the first
+			call to tefs_open(), tefs_exists() or tefs_remove(). Nothing is done
+			if the volume has already been mounted.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_mount(
+	void
+);
+
 /**
 @brief		Opens an existing file given the file name. If the file does
 			not exist, a new file with the given name will be created.
+@details	If TEFS_OPEN_CACHE_SIZE is defined and the file was recently
+			closed, it is opened with the state that it was closed with and
+			nothing is read from the device.
 
 @param		file		A file_t structure.
 @param		file_name	File name
@@ -218,6 +893,9 @@ tefs_close(
 
 /**
 @brief		Deletes the file with the given file name.
+@details	If TEFS_LAZY_FREE_QUEUE_SIZE is defined, the blocks of the file
+			are released later by tefs_idle. The file must be closed before
+			it is removed.
 
 @param		file_name	File name
 
@@ -228,6 +906,183 @@ tefs_remove(
 	char *file_name
 );
 
+/**
+@brief		Packs the files of the selected volume into the first entries of the
+			directory and shortens the directory files to them.
+@details	Removing a file only clears its entry, so lookups keep scanning the
+			entries of removed files until the directory is compacted. No file
+			on the volume may be open since the directory entries of the files
+			are moved (for example, call it after tefs_mount()). If power is
+			lost while the directory is compacted, a file may be listed twice.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_compact_directory(
+	void
+);
+
+/**
+@brief		Does the work that has been left for when the device is idle.
+@details	This releases the blocks of files that have been removed when
+			TEFS_LAZY_FREE_QUEUE_SIZE is defined. On an SD card, the free
+			block hint and the number of used blocks are written out to the
+			information page as well if they have changed.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_idle(
+	void
+);
+
+#if defined(USE_SD)
+/**
+@brief		Gets the number of blocks on the selected volume and how many of
+			them are free.
+@details	The number of used blocks is kept with the volume, so the state
+			section is only counted if it was not written out before the
+			device was last used (for example, after a loss of power). Blocks
+			that files have reserved ahead and the blocks of removed files that
+			are still waiting in the lazy free queue are counted as used.
+
+@param[out]	number_of_blocks		The number of blocks that the device has.
+@param[out]	number_of_free_blocks	The number of blocks that are free.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_statfs(
+	uint32_t	*number_of_blocks,
+	uint32_t	*number_of_free_blocks
+);
+
+/**
+@brief		Sets where blocks are reserved on the selected volume.
+@details	A volume uses the TEFS_DEFAULT_ALLOCATION_POLICY policy until
+			another one is set. Blocks that files have already reserved are
+			not moved.
+
+@param		policy	One of the TEFS_ALLOCATE_* definitions.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_set_allocation_policy(
+	uint8_t policy
+);
+#endif
+
+#if defined(TEFS_STATS)
+/**
+@brief		Gets the counters of the selected volume.
+@details	The counters add up from when the volume was zeroed (or its
+			counters were reset) and are kept when it is loaded again.
+
+@param[out]	stats	A tefs_stats_t structure that the counters are copied to.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_get_stats(
+	tefs_stats_t *stats
+);
+
+/**
+@brief		Sets the counters of the selected volume to 0.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_reset_stats(
+	void
+);
+#endif
+
+#if defined(TEFS_TRACE)
+/**
+@brief		Sets the function that is called for each read, write and flush
+			of the device while the selected volume is used.
+@details	The hook is called after the operation and must not call TEFS
+			functions.
+
+@param		hook	A tefs_trace_hook_t function or NULL for none.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_set_trace_hook(
+	tefs_trace_hook_t hook
+);
+#endif
+
+/**
+@brief		Opens the directory of the selected volume to list its files with
+			tefs_readdir().
+
+@param		dir		A tefs_dir_t structure.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_opendir(
+	tefs_dir_t *dir
+);
+
+/**
+@brief		Gets the next file in a directory.
+@details	Empty and deleted directory entries are skipped. The hashes and the
+			metadata entries are read as many at a time as fit into the buffers
+			of the directory (up to the end of a page). A file that is created
+			or removed while the directory is open may or may not be returned.
+			The size is the one in the directory entry, so it does not include
+			pages that an open file has not written out yet.
+
+@param		dir							A directory opened with tefs_opendir().
+@param[out]	file_name					A buffer for the name of the file. It must
+										have room for the max file name size of
+										the volume plus a null char.
+@param[out]	eof_page					The last page of the file.
+@param[out]	eof_byte					The byte after the last byte in the last
+										page of the file.
+@param[out]	root_index_block_address	The address of the root index block (or
+										the only child index block) of the file.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+			TEFS_ERR_EOF is returned once there are no more files.
+*/
+int8_t
+tefs_readdir(
+	tefs_dir_t	*dir,
+	char		*file_name,
+	uint32_t	*eof_page,
+	uint16_t	*eof_byte,
+	uint32_t	*root_index_block_address
+);
+
+/**
+@brief		Closes a directory that was opened with tefs_opendir().
+
+@param		dir		A directory opened with tefs_opendir().
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_closedir(
+	tefs_dir_t *dir
+);
+
+/**
+@brief		Gets the size of the pages on the device.
+@details	The card data must have been loaded (by opening a file) first.
+
+@return		The exponent of the page size (the page size is 2^exponent bytes).
+*/
+uint8_t
+tefs_page_size_exponent(
+	void
+);
+
 /**
 @brief		Releases a block from the file.
 @details	The given block address must be the starting address of a
@@ -244,6 +1099,99 @@ tefs_release_block(
 	uint32_t 	file_block_address
 );
 
+/**
+@brief		Sets when the size of a file is written out to its directory entry.
+@details	Files are opened with the TEFS_DEFAULT_CONSISTENCY policy. A size
+			that has not been written out yet is written out first. With
+			TEFS_CONSISTENCY_GROUP, the size is written out by the first write
+			after the file has grown by group_pages pages or group_milliseconds
+			have passed since it was last written out (the time is only used
+			if TEFS_MILLISECONDS() is defined). The size is always written out
+			when the file is flushed or closed.
+
+@param		file				A file_t structure.
+@param		policy				One of the TEFS_CONSISTENCY_* definitions.
+@param		group_pages			The max number of pages between the writes of
+								the size for TEFS_CONSISTENCY_GROUP (0 for no
+								limit).
+@param		group_milliseconds	The max time between the writes of the size for
+								TEFS_CONSISTENCY_GROUP (0 for no limit).
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_set_consistency(
+	file_t 		*file,
+	uint8_t		policy,
+	uint16_t	group_pages,
+	uint32_t	group_milliseconds
+);
+
+/**
+@brief		Allocates the data blocks (and the index blocks that point to
+			them) for the pages of a file up front.
+@details	Writes that append to the file do not have to allocate any blocks
+			until they pass the allocated pages. The size of the file is not
+			changed and the blocks past the end of the file are released
+			again when the file is closed (or lost if power is lost first).
+			A file without a root index (one that fits in a single child index
+			block) is only allocated up to the end of its child index block.
+
+@param		file				A file_t structure.
+@param		number_of_pages		The number of pages from the start of the file
+								to allocate.
+@param		erase_blocks		1 to erase the new blocks on the device as well.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_fallocate(
+	file_t 		*file,
+	uint32_t 	number_of_pages,
+	uint8_t		erase_blocks
+);
+
+/**
+@brief		Shortens a file.
+@details	The data blocks (and index blocks) past the new end of the file
+			are released and the new size is written out to the directory
+			entry.
+
+@param		file		A file_t structure.
+@param		eof_page	The new last page of the file.
+@param		eof_byte	The new last byte in the last page of the file.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_truncate(
+	file_t 		*file,
+	uint32_t 	eof_page,
+	uint16_t	eof_byte
+);
+
+/**
+@brief		Releases the data blocks at the start of a file.
+@details	Every whole block before the page is released and so are the child
+			index blocks that only pointed to them. The pages of the file keep
+			their addresses and reading or writing a page that has been
+			released returns TEFS_ERR_PAGE_RELEASED. This lets a log that is
+			appended to reclaim its oldest pages without rewriting the file.
+			The released blocks are found again when the file is opened. A
+			file with every block released is opened as an empty file that
+			starts at the block after them.
+
+@param		file				A file_t structure.
+@param		file_page_address	The first page of the file to keep.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_drop_head(
+	file_t 		*file,
+	uint32_t 	file_page_address
+);
+
 /**
 @brief		Writes data to a page in the file.
 @details	If the page does not already exist at the end of a file,
@@ -270,14 +1218,17 @@ tefs_write(
 	uint16_t 	byte_offset
 );
 
-// TODO: Finish implementing continuous writing.
 #if defined(TEFS_CONTINUOUS_SUPPORT)
 /**
 @brief		Notifies the card to prepare for sequential writing starting at the
 			specified page address in the file.
 @details	A sequential write must be stopped by calling
-			tefs_write_continuous_stop(). To write from pages,
-			tefs_write_continuous() in conjunction with tefs_write_next().
+			tefs_write_continuous_stop(). To write to pages, use
+			tefs_write_continuous() in conjunction with
+			tefs_write_continuous_next(). The pages of a data block are
+			written with one multi-block write and it is only broken at the
+			end of the data block, where the index blocks are updated. No
+			other TEFS functions can be used until the write is stopped.
 
 @param		file						A file_t structure.
 @param		start_file_page_address		The address of the first page in the
@@ -296,8 +1247,8 @@ tefs_write_continuous_start(
 @details	The data will be stored in the buffer which has been cleared with
 			zeros (hence, current data in the page on the card is not
 			pre-buffered). The data will be only written out to the card
-			when tefs_write_continuous_next() or tefs_flush() is explicitly
-			called.
+			when tefs_write_continuous_next() or tefs_write_continuous_stop()
+			is explicitly called.
 
 @param		file				A file_t structure.
 @param[in]	data				An array of data / an address to the data in
@@ -319,6 +1270,8 @@ tefs_write_continuous(
 /**
 @brief		Writes out the data in the buffer to the card for continuous writing
 			and advancing to the next page in the sequence.
+@details	The end of the file can only be passed by a page that has been
+			written to.
 
 @return		An error code as defined by one of the TEFS_ERR_* definitions.
 */
@@ -331,7 +1284,7 @@ tefs_write_continuous_next(
 @brief		Notifies the card to stop sequential writing and flushes the buffer
 			to the card.
 @details	This may take some time since it waits for the card to complete the
-			write.
+			write. The file size is written out to the directory entry.
 
 @return		An error code as defined by one of the TEFS_ERR_* definitions.
 */
@@ -344,6 +1297,8 @@ tefs_write_continuous_stop(
 /**
 @brief		Flushes the data in the buffer out to the device.
 @details	This will only flush the data if it has not already been flushed.
+			The addresses in the index cache of the file (if
+			TEFS_INDEX_CACHE_SIZE is defined) are written out as well.
 
 @param		file	A file_t structure.
 
@@ -377,14 +1332,39 @@ tefs_read(
 	uint16_t 	byte_offset
 );
 
-// TODO: Finish implementing continuous reading.
+/**
+@brief		Reads whole pages from the file into a buffer.
+@details	The pages in each data block are read from the device in one
+			sequence (a multi-block read on an SD card), so this is much faster
+			than reading the pages one at a time with tefs_read. All of the
+			pages must be before the last page of the file.
+
+@param		file						A file_t structure.
+@param		first_file_page_address		The address of the first logical page
+										to read.
+@param		number_of_pages				The number of pages to read.
+@param[out]	buffer						A location in memory to write the data to.
+										It must fit number_of_pages pages.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_read_pages(
+	file_t		*file,
+	uint32_t	first_file_page_address,
+	uint32_t	number_of_pages,
+	void		*buffer
+);
+
 #if defined(TEFS_CONTINUOUS_SUPPORT)
 /**
 @brief		Notifies the card to prepare for sequential reading starting at the
 			specified page address in the file.
 @details	A sequential read must be stopped by calling
 			tefs_read_continuous_stop(). To read from pages, use
-			tefs_read_continuous() in conjunction with tefs_read_next().
+			tefs_read_continuous() in conjunction with
+			tefs_read_continuous_next(). No other TEFS functions can be used
+			until the read is stopped.
 
 @param		file						A file_t structure.
 @param		start_file_page_address		The address of the first page in the
@@ -440,6 +1420,172 @@ tefs_read_continuous_stop(
 );
 #endif
 
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+/**
+@brief		Maps a page of the file into the page cache and gets a pointer to
+			it so that the page can be read or changed in place.
+@details	The page stays in the cache until it is released with
+			tefs_commit_page() or tefs_unmap_page(). Up to
+			TEFS_PAGE_CACHE_SIZE - 1 pages can be mapped at once. The page can
+			be the last page of the file, in which case a new data block is
+			allocated if it is needed. Nothing past the end of the last page
+			is read from the card, so those bytes are zeros if nothing has
+			been written to the page yet.
+
+@param		file				A file_t structure.
+@param		file_page_address	The address of the logical page in the file.
+@param[out]	page_data			A pointer to the data of the page (the page
+								size bytes of it).
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_map_page(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint8_t		**page_data
+);
+
+/**
+@brief		Marks the bytes of a mapped page that have been changed and
+			releases the page.
+@details	The page is written out like a page written with tefs_write()
+			(when it is replaced in the cache or tefs_flush() is called). The
+			file grows if the bytes go past the end of the last page.
+
+@param		file				A file_t structure.
+@param		file_page_address	The address of the logical page in the file.
+@param		number_of_bytes		The number of bytes that have been changed.
+@param		byte_offset			The byte offset of where the changed bytes start
+								in the page.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_commit_page(
+	file_t		*file,
+	uint32_t	file_page_address,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset
+);
+
+/**
+@brief		Releases a mapped page without changing it.
+
+@param		file				A file_t structure.
+@param		file_page_address	The address of the logical page in the file.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_unmap_page(
+	file_t		*file,
+	uint32_t	file_page_address
+);
+#endif
+
+#if defined(TEFS_ASYNC_QUEUE_SIZE)
+/**
+@brief		Adds a write of data to a page in the file to the asynchronous
+			queue.
+@details	The write is carried out like tefs_write() when the queue is
+			processed. The data must not be changed until the request has been
+			completed with tefs_complete_async(), so a page can be filled in
+			one buffer while the page in another one is being written.
+
+@param		file				A file_t structure.
+@param		file_page_address	The address of the logical page in the file.
+@param[in]	data				An array of data / an address to the data in
+								memory.
+@param		number_of_bytes		The size of the data in bytes.
+@param		byte_offset			The byte offset of where to start writing in the
+								page.
+@param[out]	request				The request that was added.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_write_async(
+	file_t		*file,
+	uint32_t	file_page_address,
+	void		*data,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset,
+	uint8_t		*request
+);
+
+/**
+@brief		Adds a read of data from a page in the file to the asynchronous
+			queue.
+@details	The read is carried out like tefs_read() when the queue is
+			processed. The buffer has the data once tefs_poll_async() returns 1
+			for the request.
+
+@param		file				A file_t structure.
+@param		file_page_address	The address of the logical page in the file.
+@param[out]	buffer				A location in memory to write the data to.
+@param		number_of_bytes		The number of bytes to read.
+@param		byte_offset			The byte offset of where to start reading in the
+								page.
+@param[out]	request				The request that was added.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_read_async(
+	file_t		*file,
+	uint32_t	file_page_address,
+	void		*buffer,
+	uint16_t	number_of_bytes,
+	uint16_t	byte_offset,
+	uint8_t		*request
+);
+
+/**
+@brief		Carries out the next request in the asynchronous queue.
+@details	The requests are carried out in the order they were added. This is
+			called by the code that drives the device in the background (a
+			thread if TEFS_THREAD_SAFE is defined or otherwise the main loop of
+			the application between other TEFS calls). Requests can be added
+			while one is being carried out.
+
+@return		1 if a request was carried out and 0 if there were none (or
+			another one is being carried out).
+*/
+uint8_t
+tefs_process_async(
+	void
+);
+
+/**
+@brief		Checks if a request in the asynchronous queue has been carried out.
+
+@param		request		A request from tefs_write_async() or tefs_read_async().
+
+@return		1 if the request has been carried out and 0 if it has not.
+*/
+uint8_t
+tefs_poll_async(
+	uint8_t request
+);
+
+/**
+@brief		Waits for a request in the asynchronous queue to be carried out and
+			removes it from the queue.
+@details	The requests before it are carried out first if nothing else is
+			processing the queue.
+
+@param		request		A request from tefs_write_async() or tefs_read_async().
+
+@return		The error code of the request as defined by one of the TEFS_ERR_*
+			definitions.
+*/
+int8_t
+tefs_complete_async(
+	uint8_t request
+);
+#endif
+
 #ifdef  __cplusplus
 }
 #endif
@@ -20,4 +20,200 @@
 // #define USE_DATAFLASH
 // #define USE_FTL
 
+/* Uncomment this line to enable continuous (multi-block) writing and reading
+   of the pages in a file with tefs_write_continuous() and
+   tefs_read_continuous(). This requires an SD card. */
+// #define TEFS_CONTINUOUS_SUPPORT
+
+/* Uncomment this line to store volumes on a device backend that is set with
+   tefs_select_device() instead of calling the SD card library directly. A
+   backend is a table of functions that read, write, flush and erase whole
+   pages, so a build is not tied to one device (src/tefs_mmap has one for a
+   memory mapped image file). The layout of an SD card is used, so USE_SD
+   must be defined too, and TEFS_CONTINUOUS_SUPPORT cannot be used. */
+// #define TEFS_DEVICE_BACKEND
+
+/* The size in bytes of the pages of a device backend. It uses this much RAM
+   for the buffer that partial pages are read and written through. */
+#if !defined(TEFS_DEVICE_PAGE_SIZE)
+#define TEFS_DEVICE_PAGE_SIZE	512
+#endif
+
+/* Uncomment this line to erase blocks with the erase commands of the SD card
+   (CMD32, CMD33 and CMD38) instead of writing zeros to every page. This is
+   used for the blocks erased by tefs_fallocate(). It must only be used with
+   cards that read erased blocks as zeros (DATA_STAT_AFTER_ERASE in the SCR
+   register is 0). */
+// #define TEFS_NATIVE_ERASE
+
+/* Uncomment this line to put a write-back cache of device pages in front of
+   the buffer of the SD card. Pages that were recently accessed are then kept
+   in RAM instead of being flushed and read in again each time a different
+   page is accessed. The value is the number of pages that are cached and they
+   are replaced with the clock algorithm. It uses TEFS_PAGE_CACHE_SIZE *
+   TEFS_PAGE_CACHE_PAGE_SIZE bytes of RAM. */
+// #define TEFS_PAGE_CACHE_SIZE	8
+
+/* The largest page size that the page cache supports. A device formatted with
+   larger pages is accessed without the cache. */
+#if !defined(TEFS_PAGE_CACHE_PAGE_SIZE)
+#define TEFS_PAGE_CACHE_PAGE_SIZE	512
+#endif
+
+/* Uncomment this line to make it safe to call the TEFS functions from
+   several threads. The calls are serialized on a lock for the device since
+   the buffer of the SD card and the page cache are shared by every file (a
+   continuous read or write keeps the lock until it is stopped). Calls that
+   use different files wait for each other as well. The volume
+   selected with tefs_select_volume() is kept for each thread. A POSIX threads
+   mutex is used unless TEFS_LOCK_DEVICE() and TEFS_UNLOCK_DEVICE() (and
+   TEFS_THREAD_LOCAL for the storage class of thread local variables) are
+   defined here. */
+// #define TEFS_THREAD_SAFE
+
+/* Uncomment this line to add the asynchronous queue for tefs_write_async()
+   and tefs_read_async(). The value is the max number of requests that can be
+   waiting to be completed (about 16 bytes of RAM each). With TEFS_THREAD_SAFE, a
+   lock for the queue is used as well and it must be defined together with
+   the device lock as TEFS_LOCK_QUEUE() and TEFS_UNLOCK_QUEUE(). */
+// #define TEFS_ASYNC_QUEUE_SIZE	4
+
+/* The policy that files are opened with for when their size is written out
+   to their directory entry (one of the TEFS_CONSISTENCY_* definitions). It
+   can be changed for each file with tefs_set_consistency(). Defining
+   UPDATE_FS_PAGE_CONSISTENCY or UPDATE_FS_RECORD_CONSISTENCY selects the page
+   or record policy. */
+#if !defined(TEFS_DEFAULT_CONSISTENCY)
+#if defined(UPDATE_FS_RECORD_CONSISTENCY)
+#define TEFS_DEFAULT_CONSISTENCY	TEFS_CONSISTENCY_RECORD
+#elif defined(UPDATE_FS_PAGE_CONSISTENCY)
+#define TEFS_DEFAULT_CONSISTENCY	TEFS_CONSISTENCY_PAGE
+#else
+#define TEFS_DEFAULT_CONSISTENCY	TEFS_CONSISTENCY_FLUSH
+#endif
+#endif
+
+/* The time in milliseconds (which may wrap around) for the group consistency
+   policy. Without it, the size of a file is only written out after a number
+   of pages. */
+#if !defined(TEFS_MILLISECONDS) && defined(ARDUINO)
+#define TEFS_MILLISECONDS()	millis()
+#endif
+
+/* Uncomment this line to keep a copy of the hash entries file in RAM. File
+   lookups are then resolved from memory and only the metadata entry of a
+   matching hash is read from the device. The value is the max number of hash
+   entries that are kept (4 bytes of RAM each). Entries past this are still
+   found by scanning the hash entries file. */
+// #define TEFS_HASH_INDEX_SIZE	256
+
+/* Uncomment this line to keep the state of recently closed files in RAM.
+   Opening one of them again then takes no reads from the device (the
+   directory lookup and the reads of the first index and data blocks are
+   skipped). The value is the max number of files that are kept and they are
+   replaced in least recently used order. It uses about sizeof(file_t) +
+   TEFS_OPEN_CACHE_NAME_SIZE + 14 bytes of RAM for each file. */
+// #define TEFS_OPEN_CACHE_SIZE	8
+
+/* The longest file name that the open cache keeps. Files with longer names are
+   opened without the cache. */
+#if !defined(TEFS_OPEN_CACHE_NAME_SIZE)
+#define TEFS_OPEN_CACHE_NAME_SIZE	16
+#endif
+
+/* The size in bytes of the buffer that the hash entries file is scanned with.
+   Each read from the file fills the buffer (up to the end of a page), so a
+   buffer the size of a page scans a whole page with a single read. The same
+   size is used for the buffers that the state section, index blocks and new
+   directory entries are accessed with. The buffer is on the stack and its
+   size must be a multiple of 4. */
+#if !defined(TEFS_SCAN_BUFFER_SIZE)
+#if defined(ARDUINO)
+#define TEFS_SCAN_BUFFER_SIZE	64
+#else
+#define TEFS_SCAN_BUFFER_SIZE	512
+#endif
+#endif
+
+/* The number of free block extents that are cached in RAM by the block
+   allocator (8 bytes of RAM each). Blocks that are in the cache are reserved
+   without scanning the state section on the device. It must be at least 1. */
+#if !defined(TEFS_FREE_EXTENT_CACHE_SIZE)
+#define TEFS_FREE_EXTENT_CACHE_SIZE	4
+#endif
+
+/* The policy that volumes reserve blocks with (one of the TEFS_ALLOCATE_*
+   definitions). It can be changed for each volume with
+   tefs_set_allocation_policy(). TEFS_ALLOCATE_NEAR_FILE keeps the blocks of
+   a growing file together so they can be read with multi-block reads and
+   TEFS_ALLOCATE_ROUND_ROBIN spreads the writes over the whole card. */
+#if !defined(TEFS_DEFAULT_ALLOCATION_POLICY)
+#define TEFS_DEFAULT_ALLOCATION_POLICY	TEFS_ALLOCATE_LOWEST
+#endif
+
+/* The number of blocks that a file reserves at once when it grows past its
+   last block (4 bytes of RAM each in every file_t). The blocks are reserved
+   with a single flush of the state section and are used by the file in order.
+   The ones that are left over are released when the file is closed. They
+   are marked as used in the state section until then, so up to
+   TEFS_RESERVE_AHEAD_SIZE - 1 blocks of each open file are lost if power is
+   lost before it is closed (they are not reclaimed). A value of 1 reserves
+   one block at a time and loses none. */
+#if !defined(TEFS_RESERVE_AHEAD_SIZE)
+#define TEFS_RESERVE_AHEAD_SIZE	4
+#endif
+
+/* The number of runs of blocks that are buffered in RAM while blocks are
+   released (8 bytes of RAM each). Adjacent blocks are merged into one run and
+   the runs are written to the state section together, so removing a file only
+   flushes the state section once. It must be at least 1. */
+#if !defined(TEFS_RELEASE_BUFFER_SIZE)
+#define TEFS_RELEASE_BUFFER_SIZE	4
+#endif
+
+/* Uncomment this line to cache part of the current child index page in each
+   file_t. Data blocks that are crossed into are then found without reading the
+   device (and without evicting the page in the device buffer) and the new
+   data blocks of a file are only written out to the child index block when
+   the cached part changes or the file is flushed. The value is the size of
+   the cache in bytes (in every file_t) and it must be a power of two. */
+// #define TEFS_INDEX_CACHE_SIZE	32
+
+/* Uncomment this line to keep track of the run of contiguous data blocks at
+   the start of each file (9 bytes of RAM in every file_t). The data blocks in
+   the run are found with arithmetic instead of reading the index blocks and
+   tefs_read_pages() reads the pages of the whole run in one multi-block read.
+   The run grows as blocks are added to the end of the file. For a file that
+   is opened, it is found from the child index blocks (a piece of a page at a
+   time) the first time a block past it is accessed. */
+// #define TEFS_EXTENT_SUPPORT
+
+/* Uncomment this line to release the blocks of removed files lazily.
+   tefs_remove then only deletes the directory entry and the blocks are
+   released by the next call to tefs_idle, or earlier if the device runs out
+   of free blocks. The value is the max number of removed files that can be
+   waiting (10 bytes of RAM each). The blocks of waiting files are not
+   released if power is lost before they are reclaimed. */
+// #define TEFS_LAZY_FREE_QUEUE_SIZE	4
+
+/* Uncomment this line to keep counters for each volume that are read with
+   tefs_get_stats(): the reads and writes of the device split by the region of
+   the volume (information page, state section, directory, index blocks and
+   data), flushes, hits and misses of the device buffer or the page cache,
+   blocks reserved and released and the number of hash entries that directory
+   lookups look at (about 76 bytes of RAM in every tefs_volume_t). */
+// #define TEFS_STATS
+
+/* Uncomment this line to call a hook that is set with tefs_set_trace_hook()
+   after each read, write and flush of the device, with the time that it took.
+   When neither this nor TEFS_STATS is defined, the device is accessed
+   directly. */
+// #define TEFS_TRACE
+
+/* The time in microseconds (which may wrap around) that device operations are
+   timed with for the trace hook. Without it, the time is passed as 0. */
+#if !defined(TEFS_TRACE_MICROSECONDS) && defined(ARDUINO)
+#define TEFS_TRACE_MICROSECONDS()	micros()
+#endif
+
 #endif /* TEFS_CONFIGURATION_H_ */
\ No newline at end of file
@@ -0,0 +1,234 @@
+/******************************************************************************/
+/**
+@file		tefs_mmap.c
+@author     Wade Penson
+@date		October, 2026
+@brief      TEFS device backend for a memory mapped image file.
+
+@copyright  Copyright 2015 Wade Penson
+
+@license    Licensed under the Apache License, Version 2.0 (the "License");
+            you may not use this file except in compliance with the License.
+            You may obtain a copy of the License at
+
+              http://www.apache.org/licenses/LICENSE-2.0
+
+            Unless required by applicable law or agreed to in writing, software
+            distributed under the License is distributed on an "AS IS" BASIS,
+            WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+            implied. See the License for the specific language governing
+            permissions and limitations under the License.
+*/
+/******************************************************************************/
+
+#define _DEFAULT_SOURCE
+
+#include "tefs_mmap.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The number of bytes in a number of pages. */
+#define T_MMAP_BYTES(number_of_pages)	((size_t) (number_of_pages) * TEFS_DEVICE_PAGE_SIZE)
+
+/* Adds pages to the range of pages that are written to the file by the next
+   flush. */
+static void
+tefs_mmap_mark_dirty(
+	tefs_mmap_device_t	*mmap_device,
+	uint32_t			page,
+	uint32_t			number_of_pages
+)
+{
+	if (mmap_device->dirty_start_page == mmap_device->dirty_end_page)
+	{
+		mmap_device->dirty_start_page = page;
+		mmap_device->dirty_end_page = page + number_of_pages;
+
+		return;
+	}
+
+	if (page < mmap_device->dirty_start_page)
+	{
+		mmap_device->dirty_start_page = page;
+	}
+
+	if (page + number_of_pages > mmap_device->dirty_end_page)
+	{
+		mmap_device->dirty_end_page = page + number_of_pages;
+	}
+}
+
+static int8_t
+tefs_mmap_read_pages(
+	tefs_device_t	*device,
+	uint32_t		page,
+	uint32_t		number_of_pages,
+	void			*buffer
+)
+{
+	tefs_mmap_device_t *mmap_device = (tefs_mmap_device_t *) device;
+
+	if (page >= device->number_of_pages || number_of_pages > device->number_of_pages - page)
+	{
+		return TEFS_ERR_READ;
+	}
+
+	memcpy(buffer, mmap_device->image + T_MMAP_BYTES(page), T_MMAP_BYTES(number_of_pages));
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_mmap_write_pages(
+	tefs_device_t	*device,
+	uint32_t		page,
+	uint32_t		number_of_pages,
+	void			*data
+)
+{
+	tefs_mmap_device_t *mmap_device = (tefs_mmap_device_t *) device;
+
+	if (page >= device->number_of_pages || number_of_pages > device->number_of_pages - page)
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	memcpy(mmap_device->image + T_MMAP_BYTES(page), data, T_MMAP_BYTES(number_of_pages));
+	tefs_mmap_mark_dirty(mmap_device, page, number_of_pages);
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_mmap_flush(
+	tefs_device_t *device
+)
+{
+	tefs_mmap_device_t *mmap_device = (tefs_mmap_device_t *) device;
+
+	if (mmap_device->dirty_start_page == mmap_device->dirty_end_page)
+	{
+		return TEFS_ERR_OK;
+	}
+
+	/* msync() needs an address at the start of a page of memory. */
+	size_t memory_page_size = (size_t) sysconf(_SC_PAGESIZE);
+	size_t start_byte = T_MMAP_BYTES(mmap_device->dirty_start_page) / memory_page_size * memory_page_size;
+	size_t end_byte = T_MMAP_BYTES(mmap_device->dirty_end_page);
+
+	if (msync(mmap_device->image + start_byte, end_byte - start_byte, MS_SYNC))
+	{
+		return TEFS_ERR_WRITE;
+	}
+
+	mmap_device->dirty_start_page = 0;
+	mmap_device->dirty_end_page = 0;
+
+	return TEFS_ERR_OK;
+}
+
+static int8_t
+tefs_mmap_erase_range(
+	tefs_device_t	*device,
+	uint32_t		start_page,
+	uint32_t		end_page
+)
+{
+	tefs_mmap_device_t *mmap_device = (tefs_mmap_device_t *) device;
+
+	if (start_page > end_page || end_page >= device->number_of_pages)
+	{
+		return TEFS_ERR_ERASE;
+	}
+
+	memset(mmap_device->image + T_MMAP_BYTES(start_page), 0, T_MMAP_BYTES(end_page - start_page + 1));
+	tefs_mmap_mark_dirty(mmap_device, start_page, end_page - start_page + 1);
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_mmap_open(
+	tefs_mmap_device_t	*mmap_device,
+	const char			*path,
+	uint32_t			number_of_pages
+)
+{
+	mmap_device->file_descriptor = open(path, O_RDWR | O_CREAT, 0644);
+
+	if (mmap_device->file_descriptor < 0)
+	{
+		return TEFS_ERR_READ;
+	}
+
+	struct stat file_stat;
+
+	if (fstat(mmap_device->file_descriptor, &file_stat))
+	{
+		close(mmap_device->file_descriptor);
+		return TEFS_ERR_READ;
+	}
+
+	if (number_of_pages == 0)
+	{
+		number_of_pages = (uint32_t) (file_stat.st_size / TEFS_DEVICE_PAGE_SIZE);
+	}
+	else if ((size_t) file_stat.st_size < T_MMAP_BYTES(number_of_pages) &&
+			 ftruncate(mmap_device->file_descriptor, (off_t) T_MMAP_BYTES(number_of_pages)))
+	{
+		close(mmap_device->file_descriptor);
+		return TEFS_ERR_WRITE;
+	}
+
+	if (number_of_pages == 0)
+	{
+		close(mmap_device->file_descriptor);
+		return TEFS_ERR_READ;
+	}
+
+	void *image = mmap(NULL, T_MMAP_BYTES(number_of_pages), PROT_READ | PROT_WRITE, MAP_SHARED,
+					   mmap_device->file_descriptor, 0);
+
+	if (image == MAP_FAILED)
+	{
+		close(mmap_device->file_descriptor);
+		return TEFS_ERR_READ;
+	}
+
+	mmap_device->image						= (uint8_t *) image;
+	mmap_device->dirty_start_page			= 0;
+	mmap_device->dirty_end_page				= 0;
+	mmap_device->device.read_pages			= tefs_mmap_read_pages;
+	mmap_device->device.write_pages			= tefs_mmap_write_pages;
+	mmap_device->device.flush				= tefs_mmap_flush;
+	mmap_device->device.erase_range			= tefs_mmap_erase_range;
+	mmap_device->device.number_of_pages		= number_of_pages;
+
+	return TEFS_ERR_OK;
+}
+
+int8_t
+tefs_mmap_close(
+	tefs_mmap_device_t *mmap_device
+)
+{
+	int8_t response = TEFS_ERR_OK;
+
+	if (msync(mmap_device->image, T_MMAP_BYTES(mmap_device->device.number_of_pages), MS_SYNC))
+	{
+		response = TEFS_ERR_WRITE;
+	}
+
+	if (munmap(mmap_device->image, T_MMAP_BYTES(mmap_device->device.number_of_pages)) ||
+		close(mmap_device->file_descriptor))
+	{
+		response = TEFS_ERR_WRITE;
+	}
+
+	mmap_device->image = NULL;
+
+	return response;
+}
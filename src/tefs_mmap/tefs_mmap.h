@@ -0,0 +1,92 @@
+/******************************************************************************/
+/**
+@file		tefs_mmap.h
+@author     Wade Penson
+@date		October, 2026
+@brief      TEFS device backend for a memory mapped image file.
+
+@copyright  Copyright 2015 Wade Penson
+
+@license    Licensed under the Apache License, Version 2.0 (the "License");
+            you may not use this file except in compliance with the License.
+            You may obtain a copy of the License at
+
+              http://www.apache.org/licenses/LICENSE-2.0
+
+            Unless required by applicable law or agreed to in writing, software
+            distributed under the License is distributed on an "AS IS" BASIS,
+            WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+            implied. See the License for the specific language governing
+            permissions and limitations under the License.
+*/
+/******************************************************************************/
+
+#ifndef TEFS_MMAP_H_
+#define TEFS_MMAP_H_
+
+#include "../tefs/tefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if !defined(TEFS_DEVICE_BACKEND)
+#error "The memory mapped device requires TEFS_DEVICE_BACKEND."
+#endif
+
+/** A device that is stored in an image file (such as a copy of an SD card)
+	that is mapped into memory. */
+typedef struct tefs_mmap_device
+{
+	/** The backend that is given to tefs_select_device(). */
+	tefs_device_t	device;
+	/** The file descriptor of the image file. */
+	int				file_descriptor;
+	/** The start of the image in memory. */
+	uint8_t			*image;
+	/** The first page that has been changed since the last flush. */
+	uint32_t		dirty_start_page;
+	/** The page after the last one that has been changed since the last
+		flush (it is the same as dirty_start_page if none have been). */
+	uint32_t		dirty_end_page;
+} tefs_mmap_device_t;
+
+/**
+@brief		Opens an image file and maps it into memory.
+@details	The file is created if it does not exist and it is grown to the
+			number of pages if it is smaller. Pages that are written are
+			shared with the file and the flush of the device writes the
+			changed pages to it with msync().
+
+@param		mmap_device		A tefs_mmap_device_t structure.
+@param		path			The path of the image file.
+@param		number_of_pages	The number of pages of TEFS_DEVICE_PAGE_SIZE bytes
+							on the device or 0 for the size of the existing
+							file.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_mmap_open(
+	tefs_mmap_device_t	*mmap_device,
+	const char			*path,
+	uint32_t			number_of_pages
+);
+
+/**
+@brief		Writes the image out to the file and unmaps it.
+
+@param		mmap_device		A tefs_mmap_device_t structure that was opened.
+
+@return		An error code as defined by one of the TEFS_ERR_* definitions.
+*/
+int8_t
+tefs_mmap_close(
+	tefs_mmap_device_t *mmap_device
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TEFS_MMAP_H_ */
@@ -23,6 +23,209 @@
 
 #include "tefs_stdio.h"
 
+/* The size of the pages that the device was formatted with. */
+#define T_PAGE_SIZE_EXPONENT	tefs_page_size_exponent()
+#define T_PAGE_SIZE				((uint16_t) POW_2_TO(T_PAGE_SIZE_EXPONENT))
+
+/* Writes out the bytes in the buffer that have been changed. */
+static int8_t
+t_write_buffer(
+	T_FILE *fp
+)
+{
+	if (fp->buffer_dirty_end > fp->buffer_dirty_start)
+	{
+		if (tefs_write(&fp->f, fp->buffer_page, fp->buffer + fp->buffer_dirty_start,
+					   fp->buffer_dirty_end - fp->buffer_dirty_start, fp->buffer_dirty_start))
+		{
+			return -1;
+		}
+
+		fp->buffer_dirty_start = 0;
+		fp->buffer_dirty_end = 0;
+	}
+
+	return 0;
+}
+
+/* Reads a page of the file into the buffer (after writing out the page that
+   was in it). Only the bytes that are in the file are read. */
+static int8_t
+t_load_buffer(
+	T_FILE		*fp,
+	uint32_t	page
+)
+{
+	if (fp->buffer_page == page)
+	{
+		return 0;
+	}
+
+	if (t_write_buffer(fp))
+	{
+		return -1;
+	}
+
+	uint16_t length = 0;
+
+	if (page < fp->f.eof_page)
+	{
+		length = T_PAGE_SIZE;
+	}
+	else if (page == fp->f.eof_page)
+	{
+		length = fp->f.eof_byte;
+	}
+
+	fp->buffer_page = 0xFFFFFFFF;
+
+	if (length > 0 && tefs_read(&fp->f, page, fp->buffer, length, 0))
+	{
+		return -1;
+	}
+
+	fp->buffer_page = page;
+	fp->buffer_length = length;
+
+	return 0;
+}
+
+/* Writes to the file through the buffer. Whole pages are written to the file
+   directly. */
+static size_t
+t_fwrite_buffered(
+	void		*ptr,
+	uint32_t	total_num_bytes,
+	T_FILE		*fp
+)
+{
+	uint32_t bytes_written = 0;
+
+	while (bytes_written < total_num_bytes)
+	{
+		uint16_t num_bytes = T_PAGE_SIZE - fp->byte_address;
+
+		if (total_num_bytes - bytes_written < num_bytes)
+		{
+			num_bytes = total_num_bytes - bytes_written;
+		}
+
+		if (num_bytes == T_PAGE_SIZE && fp->buffer_page != fp->page_address)
+		{
+			if (t_write_buffer(fp) ||
+				tefs_write(&fp->f, fp->page_address, (void *) (((char *) ptr) + bytes_written), T_PAGE_SIZE, 0))
+			{
+				return bytes_written;
+			}
+		}
+		else
+		{
+			if (t_load_buffer(fp, fp->page_address))
+			{
+				return bytes_written;
+			}
+
+			/* The file cannot have gaps. */
+			if (fp->byte_address > fp->buffer_length)
+			{
+				return bytes_written;
+			}
+
+			memcpy(fp->buffer + fp->byte_address, ((char *) ptr) + bytes_written, num_bytes);
+
+			if (fp->buffer_dirty_end == fp->buffer_dirty_start || fp->byte_address < fp->buffer_dirty_start)
+			{
+				fp->buffer_dirty_start = fp->byte_address;
+			}
+
+			if (fp->byte_address + num_bytes > fp->buffer_dirty_end)
+			{
+				fp->buffer_dirty_end = fp->byte_address + num_bytes;
+			}
+
+			if (fp->buffer_dirty_end > fp->buffer_length)
+			{
+				fp->buffer_length = fp->buffer_dirty_end;
+			}
+		}
+
+		bytes_written += num_bytes;
+		fp->byte_address += num_bytes;
+
+		if (fp->byte_address == T_PAGE_SIZE)
+		{
+			fp->page_address++;
+			fp->byte_address = 0;
+		}
+	}
+
+	return total_num_bytes;
+}
+
+/* Reads from the file through the buffer. Runs of whole pages are read from
+   the file directly. */
+static size_t
+t_fread_buffered(
+	void		*ptr,
+	uint32_t	total_num_bytes,
+	T_FILE		*fp
+)
+{
+	uint32_t bytes_read = 0;
+
+	/* The file has to have the data that is still in the buffer. */
+	if (t_write_buffer(fp))
+	{
+		return 0;
+	}
+
+	while (bytes_read < total_num_bytes)
+	{
+		if (fp->byte_address == 0 && fp->buffer_page != fp->page_address && total_num_bytes - bytes_read >= MULT_BY_POW_2_EXP((uint32_t) 2, T_PAGE_SIZE_EXPONENT))
+		{
+			uint32_t num_pages = DIV_BY_POW_2_EXP(total_num_bytes - bytes_read, T_PAGE_SIZE_EXPONENT);
+
+			if (tefs_read_pages(&fp->f, fp->page_address, num_pages, (void *) (((char *) ptr) + bytes_read)) == TEFS_ERR_OK)
+			{
+				bytes_read += MULT_BY_POW_2_EXP(num_pages, T_PAGE_SIZE_EXPONENT);
+				fp->page_address += num_pages;
+				continue;
+			}
+		}
+
+		if (t_load_buffer(fp, fp->page_address))
+		{
+			return bytes_read;
+		}
+
+		if (fp->byte_address >= fp->buffer_length)
+		{
+			fp->eof = 1;
+			return bytes_read;
+		}
+
+		uint16_t num_bytes = fp->buffer_length - fp->byte_address;
+
+		if (total_num_bytes - bytes_read < num_bytes)
+		{
+			num_bytes = total_num_bytes - bytes_read;
+		}
+
+		memcpy(((char *) ptr) + bytes_read, fp->buffer + fp->byte_address, num_bytes);
+
+		bytes_read += num_bytes;
+		fp->byte_address += num_bytes;
+
+		if (fp->byte_address == T_PAGE_SIZE)
+		{
+			fp->page_address++;
+			fp->byte_address = 0;
+		}
+	}
+
+	return total_num_bytes;
+}
+
 T_FILE *
 t_fopen(
 	char *file_name,
@@ -31,6 +234,19 @@ t_fopen(
 {
 	T_FILE *fp = (T_FILE *) malloc(sizeof(T_FILE));
 
+	if (fp == NULL)
+	{
+		return NULL;
+	}
+
+	/* Files are not buffered until t_setvbuf is called. */
+	fp->buffer = NULL;
+	fp->is_buffer_allocated = 0;
+	fp->buffer_page = 0xFFFFFFFF;
+	fp->buffer_length = 0;
+	fp->buffer_dirty_start = 0;
+	fp->buffer_dirty_end = 0;
+
 #if DEBUG
 	printf("Target mode: %.*s\n", 2, mode);
 #endif
@@ -205,12 +421,78 @@ t_fclose(
 	T_FILE *fp
 )
 {
+	if (fp->buffer != NULL)
+	{
+		t_write_buffer(fp);
+
+		if (fp->is_buffer_allocated)
+		{
+			free(fp->buffer);
+		}
+	}
+
 	tefs_close(&fp->f);
 	free(fp);
 
 	return 0;
 }
 
+int8_t
+t_setvbuf(
+	T_FILE	*fp,
+	char	*buffer,
+	int8_t	mode,
+	size_t	size
+)
+{
+	if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+	{
+		return -1;
+	}
+
+	if (mode != _IONBF && buffer != NULL && size < T_PAGE_SIZE)
+	{
+		return -1;
+	}
+
+	/* Write out and drop the current buffer. */
+	if (fp->buffer != NULL)
+	{
+		if (t_write_buffer(fp))
+		{
+			return -1;
+		}
+
+		if (fp->is_buffer_allocated)
+		{
+			free(fp->buffer);
+		}
+
+		fp->buffer = NULL;
+		fp->is_buffer_allocated = 0;
+		fp->buffer_page = 0xFFFFFFFF;
+	}
+
+	if (mode == _IONBF)
+	{
+		return 0;
+	}
+
+	if (buffer == NULL)
+	{
+		if ((buffer = (char *) malloc(T_PAGE_SIZE)) == NULL)
+		{
+			return -1;
+		}
+
+		fp->is_buffer_allocated = 1;
+	}
+
+	fp->buffer = (uint8_t *) buffer;
+
+	return 0;
+}
+
 int8_t
 t_remove(
 	char *file_name
@@ -230,14 +512,48 @@ t_fwrite(
 	uint32_t total_num_bytes = size * count;
 	uint32_t bytes_read = 0;
 
-	while (total_num_bytes - bytes_read >= 512 - fp->byte_address)
+	if (fp->buffer != NULL)
+	{
+		return t_fwrite_buffered(ptr, total_num_bytes, fp);
+	}
+
+#if defined(TEFS_CONTINUOUS_SUPPORT)
+	/* Stream the whole pages to the device in one sequence. */
+	if (fp->byte_address == 0 && total_num_bytes >= MULT_BY_POW_2_EXP((uint32_t) 2, T_PAGE_SIZE_EXPONENT))
+	{
+		if (tefs_write_continuous_start(&fp->f, fp->page_address))
+		{
+			return 0;
+		}
+
+		while (total_num_bytes - bytes_read >= T_PAGE_SIZE)
+		{
+			if (tefs_write_continuous(&fp->f, (void *) (((char *) ptr) + bytes_read), T_PAGE_SIZE, 0) ||
+				tefs_write_continuous_next(&fp->f))
+			{
+				tefs_write_continuous_stop(&fp->f);
+				return bytes_read;
+			}
+
+			bytes_read += T_PAGE_SIZE;
+			fp->page_address++;
+		}
+
+		if (tefs_write_continuous_stop(&fp->f))
+		{
+			return bytes_read;
+		}
+	}
+#endif
+
+	while (total_num_bytes - bytes_read >= T_PAGE_SIZE - fp->byte_address)
 	{
-		if (tefs_write(&fp->f, fp->page_address, (void *) (((char *) ptr) + bytes_read), 512 - fp->byte_address, fp->byte_address))
+		if (tefs_write(&fp->f, fp->page_address, (void *) (((char *) ptr) + bytes_read), T_PAGE_SIZE - fp->byte_address, fp->byte_address))
 		{
 			return bytes_read;
 		}
 
-		bytes_read += 512 - fp->byte_address;
+		bytes_read += T_PAGE_SIZE - fp->byte_address;
 		fp->page_address++;
 		fp->byte_address = 0;
 	}
@@ -267,20 +583,38 @@ t_fread(
 	uint32_t bytes_read = 0;
 	int8_t error;
 
-	while (total_num_bytes - bytes_read >= 512 - fp->byte_address)
+	if (fp->buffer != NULL)
+	{
+		return t_fread_buffered(ptr, total_num_bytes, fp);
+	}
+
+	while (total_num_bytes - bytes_read >= T_PAGE_SIZE - fp->byte_address)
 	{
-		if ((error = tefs_read(&fp->f, fp->page_address, (void *) (((char *) ptr) + bytes_read), 512 - fp->byte_address, fp->byte_address)))
+		/* Read the whole pages that are left in one go. */
+		if (fp->byte_address == 0 && total_num_bytes - bytes_read >= MULT_BY_POW_2_EXP((uint32_t) 2, T_PAGE_SIZE_EXPONENT))
+		{
+			uint32_t num_pages = DIV_BY_POW_2_EXP(total_num_bytes - bytes_read, T_PAGE_SIZE_EXPONENT);
+
+			if (tefs_read_pages(&fp->f, fp->page_address, num_pages, (void *) (((char *) ptr) + bytes_read)) == TEFS_ERR_OK)
+			{
+				bytes_read += MULT_BY_POW_2_EXP(num_pages, T_PAGE_SIZE_EXPONENT);
+				fp->page_address += num_pages;
+				continue;
+			}
+		}
+
+		if ((error = tefs_read(&fp->f, fp->page_address, (void *) (((char *) ptr) + bytes_read), T_PAGE_SIZE - fp->byte_address, fp->byte_address)))
 		{
 			if (error == TEFS_ERR_EOF)
 			{
 				fp->eof = 1;
-				return bytes_read + (512 - fp->byte_address);
+				return bytes_read + (T_PAGE_SIZE - fp->byte_address);
 			}
 
 			return bytes_read;
 		}
 
-		bytes_read += 512 - fp->byte_address;
+		bytes_read += T_PAGE_SIZE - fp->byte_address;
 		fp->page_address++;
 		fp->byte_address = 0;
 	}
@@ -333,6 +667,11 @@ t_fflush(
 	T_FILE *fp
 )
 {
+	if (fp->buffer != NULL && t_write_buffer(fp))
+	{
+		return -1;
+	}
+
 	tefs_flush(&fp->f);
 
 	return 0;
@@ -345,6 +684,12 @@ t_fseek(
 	int8_t whence
 )
 {
+	/* The file size has to include the data that is still in the buffer. */
+	if (fp->buffer != NULL && t_write_buffer(fp))
+	{
+		return -1;
+	}
+
 	fp->eof = 0;
 
 	if (whence == SEEK_SET || whence == SEEK_CUR)
@@ -352,11 +697,11 @@ t_fseek(
 		/* Seek from current position. */
 		if (whence == SEEK_CUR)
 		{
-			offset += (fp->page_address << 9) + fp->byte_address;
+			offset += MULT_BY_POW_2_EXP(fp->page_address, T_PAGE_SIZE_EXPONENT) + fp->byte_address;
 		}
 
-		uint32_t offset_page = offset >> 9;
-		uint16_t offset_byte = offset & 511;
+		uint32_t offset_page = DIV_BY_POW_2_EXP(offset, T_PAGE_SIZE_EXPONENT);
+		uint16_t offset_byte = MOD_BY_POW_2(offset, T_PAGE_SIZE);
 
 		/* Check if position is less than the size of the file. */
 		if ((offset_page == fp->f.eof_page && offset_byte > fp->f.eof_byte) || offset_page > fp->f.eof_page)
@@ -400,8 +745,13 @@ t_fsetpos(
 	fpos_t *pos
 )
 {
-	uint32_t pos_page = *pos >> 9;
-	uint16_t pos_byte = *pos & 511;
+	if (fp->buffer != NULL && t_write_buffer(fp))
+	{
+		return -1;
+	}
+
+	uint32_t pos_page = DIV_BY_POW_2_EXP(*pos, T_PAGE_SIZE_EXPONENT);
+	uint16_t pos_byte = MOD_BY_POW_2(*pos, T_PAGE_SIZE);
 
 	/* Check if position is less than the size of the file. */
 	if (pos_page > fp->f.eof_page)
@@ -433,7 +783,7 @@ t_fgetpos(
 	fpos_t *pos
 )
 {
-	*pos = (fp->page_address << 9) + fp->byte_address;
+	*pos = MULT_BY_POW_2_EXP(fp->page_address, T_PAGE_SIZE_EXPONENT) + fp->byte_address;
 
 	return 0;
 }
@@ -443,7 +793,7 @@ t_ftell(
 	T_FILE *fp
 )
 {
-	return (fp->page_address << 9) + fp->byte_address;
+	return MULT_BY_POW_2_EXP(fp->page_address, T_PAGE_SIZE_EXPONENT) + fp->byte_address;
 }
 
 void
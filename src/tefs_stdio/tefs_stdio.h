@@ -39,6 +39,16 @@ typedef struct _SD_File
 	uint32_t	page_address;
 	uint16_t	byte_address;
 	int8_t 		eof;
+	/* A copy of one page of the file (NULL if the file is not buffered). */
+	uint8_t		*buffer;
+	uint8_t		is_buffer_allocated;
+	/* The page in the buffer (0xFFFFFFFF if there is none). */
+	uint32_t	buffer_page;
+	/* The number of bytes of the page that are in the file or written to the buffer. */
+	uint16_t	buffer_length;
+	/* The bytes in the buffer that have not been written to the file yet. */
+	uint16_t	buffer_dirty_start;
+	uint16_t	buffer_dirty_end;
 } T_FILE;
 
 T_FILE*
@@ -52,6 +62,19 @@ t_fclose(
 	T_FILE *fp
 );
 
+/* Sets the buffering of the file. With _IOFBF (or _IOLBF, which is the same)
+   writes and reads go through a page sized buffer. It is allocated if buffer
+   is NULL or else buffer is used and size must be at least a page. With _IONBF
+   every call goes to the file directly. Returns 0 on success and -1 on
+   failure. */
+int8_t
+t_setvbuf(
+	T_FILE	*fp,
+	char	*buffer,
+	int8_t	mode,
+	size_t	size
+);
+
 int8_t
 t_remove(
 	char *file_name
@@ -2,6 +2,14 @@
 
 #include "../src/tefs/tefs.h"
 
+#if defined(TEFS_DEVICE_BACKEND)
+#include "../src/tefs_mmap/tefs_mmap.h"
+
+/* The image file that the tests are run on. */
+#define TEST_IMAGE_PATH			"tefs_test.img"
+#define TEST_IMAGE_NUM_PAGES	62500
+#endif
+
 #if defined(USE_DATAFLASH) && defined(USE_FTL)
 #include "dataflash/ftl/ftl_api.h"
 extern volatile flare_ftl_t ftl;
@@ -27,6 +35,16 @@ main()
 		printf("Dataflash failed to initialize. Error code: %i\n", error);
 		return -1;
 	}
+#elif defined(TEFS_DEVICE_BACKEND)
+	tefs_mmap_device_t mmap_device;
+	int error = 0;
+
+	if ((error = tefs_mmap_open(&mmap_device, TEST_IMAGE_PATH, TEST_IMAGE_NUM_PAGES)) ||
+		(error = tefs_select_device(&mmap_device.device)))
+	{
+		printf("Image file failed to open. Error code: %i\n", error);
+		return -1;
+	}
 #elif defined(USE_SD)
 	int error = 0;
 
@@ -39,5 +57,10 @@ main()
 
 	runalltests_tefs();
 	runalltests_tefs_stdio();
+
+#if defined(TEFS_DEVICE_BACKEND)
+	tefs_mmap_close(&mmap_device);
+#endif
+
 	return 0;
 }
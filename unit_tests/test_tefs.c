@@ -24,6 +24,10 @@
 #include "planck_unit/src/planckunit.h"
 #include "../src/tefs/tefs.h"
 
+#if defined(TEFS_THREAD_SAFE)
+#include <pthread.h>
+#endif
+
 #define CHIP_SELECT_PIN 4
 
 static uint8_t	data[512];
@@ -378,6 +382,20 @@ test_tefs_format_device_helper(
 	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, get_block_address(2), four_byte_buffer);
 	current_byte += 4;
 
+#if defined(USE_SD)
+	/* Read the free block hint and the number of used blocks. The directory
+	   files use the first four blocks. */
+	four_byte_buffer = 0;
+	device_read(0, &four_byte_buffer, 4, current_byte);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 4, four_byte_buffer);
+	current_byte += 4;
+
+	four_byte_buffer = 0;
+	device_read(0, &four_byte_buffer, 4, current_byte);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 4, four_byte_buffer);
+	current_byte += 4;
+#endif
+
 	/* Check if the rest of the info section has zeros. */
 	while(current_byte < format_info->page_size)
 	{
@@ -674,6 +692,9 @@ test_tefs_remove_files_consecutively_helper(
 		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_DELETED, four_byte_buffer);
 	}
 
+	/* Release the blocks of files that are removed lazily. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_idle());
+
 	/* Note: This test will fail if the hash entries or meta data file wrote past a single data block! */
 	if (check_state_section(tc, 0, 4))
 	{
@@ -729,6 +750,9 @@ test_tefs_remove_files_staggered_helper(
 		free(file);
 	}
 
+	/* Release the blocks of files that are removed lazily. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_idle());
+
 	if (check_state_section(tc, 0, 4))
 	{
 		PLANCK_UNIT_ASSERT_FALSE(tc);
@@ -759,6 +783,59 @@ test_tefs_remove_large_single_file(
 	test_tefs_remove_files_consecutively_helper(tc, 1, 100);
 }
 
+void
+test_tefs_remove_block_sized_single_file(
+	planck_unit_test_t *tc
+)
+{
+	test_tefs_remove_files_consecutively_helper(tc, 1, format_info->block_size * 2);
+}
+
+#if defined(TEFS_LAZY_FREE_QUEUE_SIZE)
+void
+test_tefs_remove_lazily(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	for (i = 0; i < format_info->block_size + 1; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_remove(files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_exists(files[0].name));
+
+	/* The blocks stay reserved until the device is idle. */
+	if (check_state_section(tc, 0, 7))
+	{
+		PLANCK_UNIT_ASSERT_FALSE(tc);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_idle());
+
+	if (check_state_section(tc, 0, 4))
+	{
+		PLANCK_UNIT_ASSERT_FALSE(tc);
+	}
+
+	free(files[0].file);
+}
+#endif
+
 void
 test_tefs_remove_multiple_empty_files_consecutively(
 	planck_unit_test_t *tc
@@ -813,6 +890,191 @@ test_tefs_exists_single_file(
 	free(files[0].file);
 }
 
+void
+test_tefs_exists_multiple_files(
+	planck_unit_test_t *tc
+)
+{
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+
+	uint16_t file_num;
+	for (file_num = 0; file_num < 100; file_num++)
+	{
+		file_t file;
+		char file_name[12];
+		sprintf(file_name, "%s%d", "file.", file_num);
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, file_name));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+	}
+
+	/* Remove every other file. */
+	for (file_num = 0; file_num < 100; file_num += 2)
+	{
+		char file_name[12];
+		sprintf(file_name, "%s%d", "file.", file_num);
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_remove(file_name));
+	}
+
+	for (file_num = 0; file_num < 100; file_num++)
+	{
+		char file_name[12];
+		sprintf(file_name, "%s%d", "file.", file_num);
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, file_num % 2, tefs_exists(file_name));
+	}
+
+	/* A new file should reuse the directory entry of the first removed file. */
+	file_t file;
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, "new.file"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+
+	four_byte_buffer = 0;
+	device_read(get_block_address(1), &four_byte_buffer, 4, 0);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, hash_string("new.file"), four_byte_buffer);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, tefs_exists("new.file"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_exists("file.0"));
+}
+
+void
+test_tefs_readdir_multiple_files(
+	planck_unit_test_t *tc
+)
+{
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+
+	/* The size of each file is its number in bytes. */
+	uint16_t file_num;
+	for (file_num = 0; file_num < 100; file_num++)
+	{
+		file_t file;
+		char file_name[12];
+		sprintf(file_name, "%s%d", "file.", file_num);
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, file_name));
+
+		if (file_num > 0)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(&file, 0, data, file_num, 0));
+		}
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+	}
+
+	/* Remove every other file. */
+	for (file_num = 0; file_num < 100; file_num += 2)
+	{
+		char file_name[12];
+		sprintf(file_name, "%s%d", "file.", file_num);
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_remove(file_name));
+	}
+
+	tefs_dir_t dir;
+	uint8_t is_listed[100] = {0};
+	uint16_t number_of_files = 0;
+	char file_name[65];
+	uint32_t eof_page;
+	uint16_t eof_byte;
+	uint32_t root_index_block_address;
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_opendir(&dir));
+
+	while (tefs_readdir(&dir, file_name, &eof_page, &eof_byte, &root_index_block_address) == TEFS_ERR_OK)
+	{
+		unsigned int listed_num = 100;
+		sscanf(file_name, "file.%u", &listed_num);
+
+		PLANCK_UNIT_ASSERT_TRUE(tc, listed_num < 100);
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, listed_num % 2);
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, is_listed[listed_num]);
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, eof_page);
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, listed_num, eof_byte);
+		PLANCK_UNIT_ASSERT_TRUE(tc, root_index_block_address >= get_block_address(0));
+
+		is_listed[listed_num] = 1;
+		number_of_files++;
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 50, number_of_files);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_EOF, tefs_readdir(&dir, file_name, &eof_page, &eof_byte,
+																	&root_index_block_address));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_closedir(&dir));
+}
+
+void
+test_tefs_compact_directory(
+	planck_unit_test_t *tc
+)
+{
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+
+	/* Each file starts with its number. */
+	uint16_t file_num;
+	for (file_num = 0; file_num < 100; file_num++)
+	{
+		file_t file;
+		char file_name[12];
+		sprintf(file_name, "%s%d", "file.", file_num);
+
+		data[0] = (uint8_t) file_num;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, file_name));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(&file, 0, data, 1, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+	}
+
+	/* Keep every third file. */
+	for (file_num = 0; file_num < 100; file_num++)
+	{
+		char file_name[12];
+		sprintf(file_name, "%s%d", "file.", file_num);
+
+		if (file_num % 3 != 0)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_remove(file_name));
+		}
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_compact_directory());
+
+	/* The hash entries file only has the entries of the 34 files that are
+	   left. */
+	four_byte_buffer = 0;
+	device_read(0, &four_byte_buffer, TEFS_DIR_EOF_PAGE_SIZE, 20);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, four_byte_buffer);
+	four_byte_buffer = 0;
+	device_read(0, &four_byte_buffer, TEFS_DIR_EOF_BYTE_SIZE, 24);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 34 * format_info->hash_size, four_byte_buffer);
+
+	for (file_num = 0; file_num < 100; file_num++)
+	{
+		char file_name[12];
+		sprintf(file_name, "%s%d", "file.", file_num);
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, file_num % 3 == 0, tefs_exists(file_name));
+
+		if (file_num % 3 == 0)
+		{
+			file_t file;
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, file_name));
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(&file, 0, buffer, 1, 0));
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) file_num, buffer[0]);
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+		}
+	}
+
+	/* A new file takes the entry after the last file. */
+	file_t file;
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, "new.file"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+
+	four_byte_buffer = 0;
+	device_read(get_block_address(1), &four_byte_buffer, 4, 34 * format_info->hash_size);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, hash_string("new.file"), four_byte_buffer);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, tefs_exists("new.file"));
+}
+
 void
 test_tefs_write_page_to_single_file(
     planck_unit_test_t *tc
@@ -909,8 +1171,8 @@ test_tefs_write_data_block_to_single_file(
 }
 
 void
-test_tefs_write_child_block_to_single_file(
-    planck_unit_test_t *tc
+test_tefs_write_after_reopen_to_single_file(
+	planck_unit_test_t *tc
 )
 {
 	files[0].file = malloc(sizeof(file_t));
@@ -922,37 +1184,59 @@ test_tefs_write_child_block_to_single_file(
 	}
 
 	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
-    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
 
-    populate_data_array_1();
+	populate_data_array_1();
 
-    uint32_t pages_per_child_block = format_info->page_size * format_info->block_size / address_size * format_info->block_size;
-    uint32_t num_pages = (pages_per_child_block < format_info->num_pages) ? pages_per_child_block : format_info->num_pages; // TODO
+	/* Write into the middle of the second data block and then close the file
+	   so that the blocks reserved ahead are released. */
+	uint32_t num_pages = format_info->block_size + format_info->block_size / 2;
 
-    for (i = 0; i < num_pages; i++)
-    {
-        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
-        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, device_read(get_block_address(5) + i, buffer, format_info->page_size, 0));
+	for (i = 0; i < num_pages; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
 
-        for (j = 0; j < format_info->page_size; j++)
-        {
-            PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
-        }
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
 
-        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
-    }
+	if (check_state_section(tc, 0, 7))
+	{
+		PLANCK_UNIT_ASSERT_FALSE(tc);
+	}
+
+	/* Read a page in the first data block and then append the rest of the
+	   second data block. It must be written to the same data block. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, 0, buffer, format_info->page_size, 0));
+
+	for (i = num_pages; i < format_info->block_size * 2; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, device_read(get_block_address(6) + i - format_info->block_size,
+																 buffer, format_info->page_size, 0));
+
+		for (j = 0; j < format_info->page_size; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+		}
+	}
 
 	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
 
-    uint32_t size = 0;
-    device_read(get_block_address(3), &size, 4, TEFS_DIR_STATUS_SIZE);
-    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, num_pages, size);
+	/* Check that the pages written before the file was reopened are intact. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
 
-    size = 0;
-    device_read(get_block_address(3), &size, 2, TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE);
-    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, size);
+	for (i = 0; i < format_info->block_size * 2; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, i, buffer, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) i, buffer[0]);
+	}
 
-	if (check_state_section(tc, 0, 5 + num_pages / format_info->block_size))
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	if (check_state_section(tc, 0, 7))
 	{
 		PLANCK_UNIT_ASSERT_FALSE(tc);
 	}
@@ -961,8 +1245,8 @@ test_tefs_write_child_block_to_single_file(
 }
 
 void
-test_tefs_write_multiple_child_blocks_to_single_file(
-    planck_unit_test_t *tc
+test_tefs_append_to_page_after_read_in_other_block(
+	planck_unit_test_t *tc
 )
 {
 	files[0].file = malloc(sizeof(file_t));
@@ -974,65 +1258,1371 @@ test_tefs_write_multiple_child_blocks_to_single_file(
 	}
 
 	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
-    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
 
-    populate_data_array_1();
+	populate_data_array_1();
 
-    uint32_t pages_per_child_block = format_info->page_size * format_info->block_size / address_size * format_info->block_size;
-    uint32_t num_pages = (pages_per_child_block < format_info->num_pages) ? pages_per_child_block : format_info->num_pages; // TODO
+	/* Fill the first data block and write the start of the first page of
+	   the second one. */
+	for (i = 0; i < format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
 
-    for (i = 0; i < num_pages; i++)
-    {
-        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
-        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, device_read(get_block_address(5) + i, buffer, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, format_info->block_size, data, 61, 0));
 
-        for (j = 0; j < format_info->page_size; j++)
-        {
-            PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
-        }
+	/* The page that is read is at the same place in the first data block, so
+	   it is in the buffer when the rest of the partial page is appended. The
+	   partial page must still be read in before it is written to. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, 0, buffer, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, format_info->block_size, data + 61,
+													   format_info->page_size - 61, 61));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
 
-        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
-    }
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
 
-	for (i = num_pages; i < num_pages * 2; i++)
+	for (i = 0; i <= format_info->block_size; i++)
 	{
-		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
-		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, device_read(get_block_address(5) + i + format_info->block_size * 2, buffer, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, i, buffer, format_info->page_size, 0));
 
 		for (j = 0; j < format_info->page_size; j++)
 		{
 			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
 		}
-
-		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
 	}
 
 	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
 
-    uint32_t size = 0;
-    device_read(get_block_address(3), &size, 4, TEFS_DIR_STATUS_SIZE);
-    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, num_pages * 2, size);
-
-    size = 0;
-    device_read(get_block_address(3), &size, 2, TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE);
-    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, size);
-
-	if (check_state_section(tc, 0, 5 + num_pages * 2 / format_info->block_size + 2))
-	{
-		PLANCK_UNIT_ASSERT_FALSE(tc);
-	}
-
 	free(files[0].file);
 }
 
+#if defined(TEFS_OPEN_CACHE_SIZE)
 void
-test_tefs_read_after_write_to_single_file(
+test_tefs_reopen_from_open_cache(
 	planck_unit_test_t *tc
 )
 {
-	files[0].file = malloc(sizeof(file_t));
+	file_t file;
+	file_t other_file;
 
-	if (files[0].file == NULL)
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, "cached"));
+
+	/* Fill the first data block and then reopen the file from the cache to
+	   add the second one. */
+	for (i = 0; i < format_info->block_size; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(&file, i, data, format_info->page_size, 0));
+	}
+
+	uint32_t eof_page = file.eof_page;
+	uint16_t eof_byte = file.eof_byte;
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, "cached"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, eof_page, file.eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, eof_byte, file.eof_byte);
+
+	for (i = format_info->block_size; i < format_info->block_size * 2; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(&file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+
+	/* The file is opened twice at the same time, so the state of neither
+	   handle is kept when they are closed. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, "cached"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&other_file, "cached"));
+	data[0] = 0xAA;
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(&other_file, format_info->block_size * 2, data, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&other_file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, "cached"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, format_info->block_size * 2, file.eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, file.eof_byte);
+
+	for (i = 0; i < format_info->block_size * 2; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(&file, i, buffer, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) i, buffer[0]);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(&file, format_info->block_size * 2, buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0xAA, buffer[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+
+	/* Open more files than the cache holds so that the file is replaced. */
+	for (i = 0; i < TEFS_OPEN_CACHE_SIZE + 1; i++)
+	{
+		char file_name[12];
+		sprintf(file_name, "%s%d", "file.", i);
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&other_file, file_name));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&other_file));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, "cached"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, format_info->block_size * 2, file.eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(&file, format_info->block_size, buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) format_info->block_size, buffer[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+
+	/* A removed file is not opened from the cache. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_remove("cached"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, "cached"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, file.eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, file.eof_byte);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&file));
+}
+#endif
+
+#if defined(TEFS_INDEX_CACHE_SIZE)
+void
+test_tefs_write_index_cache_to_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	/* Write three data blocks. The addresses of the new data blocks are kept
+	   in the index cache until the file is flushed. */
+	for (i = 0; i < format_info->block_size * 3; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
+
+	uint32_t four_byte_buffer = 0;
+
+	for (i = 0; i < 3; i++)
+	{
+		device_read(get_block_address(4), &four_byte_buffer, address_size, i * address_size);
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, get_block_address(5 + i), four_byte_buffer);
+	}
+
+	/* The pages are found from the index cache. */
+	for (i = 0; i < format_info->block_size * 3; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, i, buffer, format_info->page_size, 0));
+
+		for (j = 0; j < format_info->page_size; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+		}
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	free(files[0].file);
+}
+#endif
+
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+void
+test_tefs_write_through_page_cache_to_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	/* Write more pages than the cache holds so that some are evicted. */
+	for (i = 0; i < TEFS_PAGE_CACHE_SIZE + 2 && i < format_info->block_size; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
+
+	/* Every page is on the card after the flush. */
+	for (i = 0; i < TEFS_PAGE_CACHE_SIZE + 2 && i < format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, device_raw_read(get_block_address(5) + i, buffer, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) i, buffer[0]);
+
+		for (j = 1; j < format_info->page_size; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+		}
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	free(files[0].file);
+}
+
+void
+test_tefs_map_pages_of_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	uint8_t *page_data;
+
+	/* Fill the pages of the first block and the first page of the next block
+	   in place. */
+	for (i = 0; i <= format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_map_page(files[0].file, i, &page_data));
+		memcpy(page_data, data, format_info->page_size);
+		page_data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_commit_page(files[0].file, i, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, format_info->block_size + 1, files[0].file->eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, files[0].file->eof_byte);
+
+	/* A page that is only mapped is not changed. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_map_page(files[0].file, 1, &page_data));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, page_data[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_unmap_page(files[0].file, 1));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_NOT_MAPPED, tefs_unmap_page(files[0].file, 1));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
+
+	for (i = 0; i <= format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, i, buffer, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) i, buffer[0]);
+
+		for (j = 1; j < format_info->page_size; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+		}
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	free(files[0].file);
+}
+#endif
+
+void
+test_tefs_select_volume(
+	planck_unit_test_t *tc
+)
+{
+	tefs_volume_t second_volume;
+	memset(&second_volume, 0, sizeof(tefs_volume_t));
+
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, 0, data, format_info->page_size, 0));
+
+	uint8_t page_size_exponent = tefs_page_size_exponent();
+
+	/* The second volume has not been loaded from a device. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(&second_volume));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_page_size_exponent());
+
+	/* A file is read from the volume that it was opened on (the selected
+	   volume does not change). */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, 0, buffer, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_page_size_exponent());
+
+	for (j = 0; j < format_info->page_size; j++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(&second_volume));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(NULL));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, page_size_exponent, tefs_page_size_exponent());
+
+	free(files[0].file);
+}
+
+void
+test_tefs_mount_after_reboot(
+	planck_unit_test_t *tc
+)
+{
+	/* A zeroed volume on the same device is like the volume after a reboot. */
+	tefs_volume_t rebooted_volume;
+	memset(&rebooted_volume, 0, sizeof(tefs_volume_t));
+
+	files[0].file = malloc(sizeof(file_t));
+	files[1].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL || files[1].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_mount());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[1].file, files[1].name));
+
+	populate_data_array_1();
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, 0, data, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[1].file));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(&rebooted_volume));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_mount());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, tefs_page_size_exponent(), find_power_of_2_exp(format_info->page_size));
+
+	/* Both files are found in the directory that was read from the device. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, tefs_exists(files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, tefs_exists(files[1].name));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, 0, buffer, format_info->page_size, 0));
+
+	for (j = 0; j < format_info->page_size; j++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(NULL));
+
+	free(files[0].file);
+	free(files[1].file);
+}
+
+#if defined(TEFS_DEVICE_BACKEND)
+void
+test_tefs_page_size_of_device_backend(
+	planck_unit_test_t *tc
+)
+{
+	tefs_volume_t rebooted_volume;
+	memset(&rebooted_volume, 0, sizeof(tefs_volume_t));
+
+	/* Only the page size of the backend can be formatted. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_SIZE, tefs_format_device(format_info->num_pages,
+		TEFS_DEVICE_PAGE_SIZE * 2, format_info->block_size, format_info->hash_size,
+		format_info->meta_data_size, format_info->max_file_name_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_SIZE, tefs_format_device(format_info->num_pages,
+		TEFS_DEVICE_PAGE_SIZE / 2, format_info->block_size, format_info->hash_size,
+		format_info->meta_data_size, format_info->max_file_name_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+
+	/* A volume that has pages of another size is not mounted. */
+	uint8_t page_size_exponent = find_power_of_2_exp(TEFS_DEVICE_PAGE_SIZE) + 1;
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_device_write(0, &page_size_exponent, 1, 8));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_device_flush());
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(&rebooted_volume));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_SIZE, tefs_mount());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(NULL));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+}
+#endif
+
+#if defined(USE_SD)
+void
+test_tefs_statfs_after_reboot(
+	planck_unit_test_t *tc
+)
+{
+	tefs_volume_t rebooted_volume;
+	tefs_volume_t power_lost_volume;
+	memset(&rebooted_volume, 0, sizeof(tefs_volume_t));
+	memset(&power_lost_volume, 0, sizeof(tefs_volume_t));
+
+	uint32_t number_of_blocks;
+	uint32_t number_of_free_blocks;
+	uint32_t expected_number_of_blocks = state_section_size_in_bytes * 8;
+
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_statfs(&number_of_blocks, &number_of_free_blocks));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, expected_number_of_blocks, number_of_blocks);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, expected_number_of_blocks - 4, number_of_free_blocks);
+
+	/* The file has a child index block and two data blocks once it is closed. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+	for (i = 0; i <= format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_statfs(&number_of_blocks, &number_of_free_blocks));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, expected_number_of_blocks - 7, number_of_free_blocks);
+
+	/* The free space that was written out is read back after a reboot. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(&rebooted_volume));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_statfs(&number_of_blocks, &number_of_free_blocks));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, expected_number_of_blocks, number_of_blocks);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, expected_number_of_blocks - 7, number_of_free_blocks);
+
+	/* Grow the file without closing it. If power is lost, the free space is
+	   counted from the state section instead and it matches the count that
+	   was kept in memory. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	for (i = format_info->block_size + 1; i <= format_info->block_size * 2; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_statfs(&number_of_blocks, &number_of_free_blocks));
+	uint32_t expected_number_of_free_blocks = number_of_free_blocks;
+	PLANCK_UNIT_ASSERT_TRUE(tc, expected_number_of_free_blocks < expected_number_of_blocks - 7);
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(&power_lost_volume));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_statfs(&number_of_blocks, &number_of_free_blocks));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, expected_number_of_free_blocks, number_of_free_blocks);
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(NULL));
+
+	free(files[0].file);
+}
+#endif
+
+#if defined(USE_SD)
+void
+test_tefs_create_file_on_full_device(
+	planck_unit_test_t *tc
+)
+{
+	tefs_volume_t rebooted_volume;
+	memset(&rebooted_volume, 0, sizeof(tefs_volume_t));
+
+	uint32_t number_of_blocks;
+	uint32_t number_of_free_blocks;
+
+	files[0].file = malloc(sizeof(file_t));
+	files[1].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL || files[1].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	/* A device with room for 8 blocks after the information page and the
+	   state section. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_format_device(2 + format_info->block_size * 8,
+		format_info->page_size, format_info->block_size, format_info->hash_size,
+		format_info->meta_data_size, format_info->max_file_name_size, 0));
+
+	/* The directory files and a file with two data blocks leave one block. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+	for (i = 0; i <= format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_statfs(&number_of_blocks, &number_of_free_blocks));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 8, number_of_blocks);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, number_of_free_blocks);
+
+	/* A new file needs two blocks, so the block is given back. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_DEVICE_FULL, tefs_open(files[1].file, files[1].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_statfs(&number_of_blocks, &number_of_free_blocks));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, number_of_free_blocks);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_exists(files[1].name));
+
+	/* The information page and the first file are left as they were. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(&rebooted_volume));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_mount());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, format_info->block_size, buffer,
+		format_info->page_size, 0));
+
+	for (j = 0; j < format_info->page_size; j++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(NULL));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+
+	free(files[0].file);
+	free(files[1].file);
+}
+#endif
+
+#if defined(TEFS_STATS)
+#if defined(TEFS_TRACE)
+/* The number of device operations that have been passed to the trace hook. */
+static uint32_t number_of_traced_operations;
+
+static void
+count_traced_operation(
+	uint8_t		operation,
+	uint8_t		region,
+	uint32_t	page,
+	uint32_t	number_of_bytes,
+	int8_t		response,
+	uint32_t	elapsed_microseconds
+)
+{
+	number_of_traced_operations++;
+}
+#endif
+
+void
+test_tefs_stats_of_single_file(
+	planck_unit_test_t *tc
+)
+{
+	tefs_stats_t stats;
+	uint32_t number_of_operations;
+
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_reset_stats());
+#if defined(TEFS_TRACE)
+	number_of_traced_operations = 0;
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_trace_hook(count_traced_operation));
+#endif
+
+	/* Creating the file looks up its name in an empty directory. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_get_stats(&stats));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, stats.lookups);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, stats.lookup_probes);
+	PLANCK_UNIT_ASSERT_TRUE(tc, stats.device_writes[TEFS_REGION_DIRECTORY] > 0);
+	PLANCK_UNIT_ASSERT_TRUE(tc, stats.blocks_reserved > 0);
+
+	/* Each page that is written to the file is a write in the data region. */
+	populate_data_array_1();
+	for (i = 0; i <= format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_get_stats(&stats));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, format_info->block_size + 1, stats.device_writes[TEFS_REGION_DATA]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, stats.device_reads[TEFS_REGION_DATA]);
+	PLANCK_UNIT_ASSERT_TRUE(tc, stats.device_writes[TEFS_REGION_STATE] > 0);
+	PLANCK_UNIT_ASSERT_TRUE(tc, stats.device_flushes > 0);
+	PLANCK_UNIT_ASSERT_TRUE(tc, stats.buffer_hits + stats.buffer_misses > 0);
+
+	number_of_operations = stats.device_flushes;
+	for (i = 0; i < TEFS_NUMBER_OF_REGIONS; i++)
+	{
+		number_of_operations += stats.device_reads[i] + stats.device_writes[i];
+	}
+
+#if defined(TEFS_TRACE)
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, number_of_operations, number_of_traced_operations);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_trace_hook(NULL));
+#endif
+
+	/* The file is the first entry in the directory, so finding it looks at
+	   one hash and compares one name. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_reset_stats());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, tefs_exists(files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_get_stats(&stats));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, stats.lookups);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, stats.lookup_probes);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, stats.lookup_max_probes);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, stats.lookup_name_compares);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, stats.device_reads[TEFS_REGION_DATA]);
+
+	/* Removing the file releases every block that it reserved. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_remove(files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_idle());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_get_stats(&stats));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 3, stats.blocks_released);
+
+	free(files[0].file);
+}
+#endif
+
+#if defined(USE_SD)
+void
+test_tefs_allocation_policies(
+	planck_unit_test_t *tc
+)
+{
+	file_t removed_file;
+	file_t growing_file;
+	file_t new_file;
+	uint32_t first_data_block;
+	uint32_t last_data_block;
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+
+	/* Leave a hole at the start of the device by removing a file with two
+	   data blocks. */
+	populate_data_array_1();
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&removed_file, "hole"));
+
+	for (i = 0; i <= format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(&removed_file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&removed_file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&growing_file, "growing"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(&growing_file, 0, data, format_info->page_size, 0));
+	first_data_block = growing_file.data_block_address;
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_remove("hole"));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_idle());
+
+	/* The next block of the file is the one after its last block instead of
+	   one from the hole. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_allocation_policy(TEFS_ALLOCATE_NEAR_FILE));
+
+	for (i = 1; i <= format_info->block_size * 2; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(&growing_file, i, data, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, first_data_block + (i / format_info->block_size) * format_info->block_size,
+										 growing_file.data_block_address);
+	}
+
+	last_data_block = growing_file.data_block_address;
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&growing_file));
+
+	/* The blocks of a new file come after the blocks that were reserved last
+	   and the hole is not reused yet. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_allocation_policy(TEFS_ALLOCATE_ROUND_ROBIN));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&new_file, "rotated"));
+	PLANCK_UNIT_ASSERT_TRUE(tc, new_file.child_index_block_address > last_data_block);
+	PLANCK_UNIT_ASSERT_TRUE(tc, new_file.data_block_address > last_data_block);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&new_file));
+
+	/* The cursor is kept on the device. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_idle());
+	tefs_volume_t rebooted_volume;
+	memset(&rebooted_volume, 0, sizeof(tefs_volume_t));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(&rebooted_volume));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_allocation_policy(TEFS_ALLOCATE_NEXT_FIT));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&new_file, "next"));
+	PLANCK_UNIT_ASSERT_TRUE(tc, new_file.child_index_block_address > last_data_block);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&new_file));
+
+	/* The lowest policy fills the hole. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_allocation_policy(TEFS_ALLOCATE_LOWEST));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&new_file, "lowest"));
+	PLANCK_UNIT_ASSERT_TRUE(tc, new_file.child_index_block_address < first_data_block);
+	PLANCK_UNIT_ASSERT_TRUE(tc, new_file.data_block_address < first_data_block);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(&new_file));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_allocation_policy(TEFS_ALLOCATE_DEFAULT));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(NULL));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_allocation_policy(TEFS_ALLOCATE_DEFAULT));
+}
+#endif
+
+#if defined(TEFS_THREAD_SAFE)
+/* Writes pages that start with the number of the page and the file to a file
+   from a thread. */
+static void *
+write_file_from_thread(
+	void *argument
+)
+{
+	file_info_t *file_info = (file_info_t *) argument;
+	uint8_t page_data[512];
+	uint32_t page;
+
+	memcpy(page_data, data, format_info->page_size);
+	page_data[1] = (uint8_t) (file_info - files);
+
+	for (page = 0; page < 2 * format_info->block_size; page++)
+	{
+		page_data[0] = (uint8_t) page;
+
+		if (tefs_write(file_info->file, page, page_data, format_info->page_size, 0))
+		{
+			return argument;
+		}
+	}
+
+	return tefs_flush(file_info->file) ? argument : NULL;
+}
+
+void
+test_tefs_write_files_from_threads(
+	planck_unit_test_t *tc
+)
+{
+	pthread_t threads[2];
+	void *result;
+
+	files[0].file = malloc(sizeof(file_t));
+	files[1].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL || files[1].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[1].file, files[1].name));
+
+	populate_data_array_1();
+
+	for (i = 0; i < 2; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, pthread_create(&threads[i], NULL, write_file_from_thread, &files[i]));
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, pthread_join(threads[i], &result));
+		PLANCK_UNIT_ASSERT_TRUE(tc, result == NULL);
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		for (current_page = 0; current_page < 2 * format_info->block_size; current_page++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[i].file, current_page, buffer, format_info->page_size, 0));
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) current_page, buffer[0]);
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, i, buffer[1]);
+
+			for (j = 2; j < format_info->page_size; j++)
+			{
+				PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+			}
+		}
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[i].file));
+		free(files[i].file);
+	}
+}
+#endif
+
+#if defined(TEFS_ASYNC_QUEUE_SIZE)
+void
+test_tefs_write_async_to_single_file(
+	planck_unit_test_t *tc
+)
+{
+	static uint8_t	page_buffers[2][512];
+	uint8_t			requests[TEFS_ASYNC_QUEUE_SIZE];
+	uint8_t			request;
+
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	/* Append pages with two buffers: one is filled while the page in the
+	   other one is written. */
+	for (i = 0; i <= format_info->block_size; i++)
+	{
+		if (i >= 2)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_complete_async(requests[i % 2]));
+		}
+
+		memcpy(page_buffers[i % 2], data, format_info->page_size);
+		page_buffers[i % 2][0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write_async(files[0].file, i, page_buffers[i % 2],
+																  format_info->page_size, 0, &requests[i % 2]));
+		tefs_process_async();
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_complete_async(requests[i]));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, format_info->block_size + 1, files[0].file->eof_page);
+
+	/* The queue is full until a request is completed. */
+	for (i = 0; i < TEFS_ASYNC_QUEUE_SIZE; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_async(files[0].file, i, buffer, format_info->page_size, 0,
+																 &requests[i]));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_poll_async(requests[i]));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_QUEUE_FULL, tefs_read_async(files[0].file, 0, buffer,
+																			   format_info->page_size, 0, &request));
+
+	for (i = 0; i < TEFS_ASYNC_QUEUE_SIZE; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_complete_async(requests[i]));
+	}
+
+	/* The reads were carried out in order, so the buffer has the last page. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ASYNC_QUEUE_SIZE - 1, buffer[0]);
+
+	for (j = 1; j < format_info->page_size; j++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	free(files[0].file);
+}
+#endif
+
+void
+test_tefs_fallocate_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	/* Allocate three blocks and erase them. A file that is already allocated
+	   is not changed. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_fallocate(files[0].file, 3 * format_info->block_size, 1));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 3, files[0].file->number_of_allocated_blocks);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, files[0].file->eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_fallocate(files[0].file, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 3, files[0].file->number_of_allocated_blocks);
+
+	populate_data_array_1();
+
+	/* The appends use the allocated blocks. */
+	for (i = 0; i < 2 * format_info->block_size; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 3, files[0].file->number_of_allocated_blocks);
+
+	for (i = 0; i < 2 * format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, i, buffer, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) i, buffer[0]);
+
+		for (j = 1; j < format_info->page_size; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+		}
+	}
+
+	/* The block that was not used is released when the file is closed. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 2, files[0].file->number_of_allocated_blocks);
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 2, files[0].file->number_of_allocated_blocks);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, 2 * format_info->block_size - 1, buffer,
+													  format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) (2 * format_info->block_size - 1), buffer[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	free(files[0].file);
+}
+
+void
+test_tefs_consistency_policy_of_single_file(
+	planck_unit_test_t *tc
+)
+{
+	file_t *file = malloc(sizeof(file_t));
+	file_t *other_file = malloc(sizeof(file_t));
+
+	if (file == NULL || other_file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(file, files[0].name));
+
+	populate_data_array_1();
+
+	/* The size is only written out by the record policy and by the group
+	   policy once the file has grown by two pages. A second file_t that is
+	   opened for the file sees the size in the directory entry. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_consistency(file, TEFS_CONSISTENCY_FLUSH, 0, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(file, 0, data, 10, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(other_file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, other_file->eof_byte);
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_consistency(file, TEFS_CONSISTENCY_RECORD, 0, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(other_file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 10, other_file->eof_byte);
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(file, 0, data, 20, 10));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(other_file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 30, other_file->eof_byte);
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_set_consistency(file, TEFS_CONSISTENCY_GROUP, 2, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(file, 0, data, format_info->page_size - 30, 30));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(other_file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, other_file->eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 30, other_file->eof_byte);
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(file, 1, data, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(other_file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 2, other_file->eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, other_file->eof_byte);
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(file, 2, data, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(other_file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 2, other_file->eof_page);
+
+	/* Closing the file writes out the rest. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(other_file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 3, other_file->eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(other_file));
+
+	free(other_file);
+	free(file);
+}
+
+void
+test_tefs_truncate_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	/* Write past the first child index block so that the file has a root
+	   index. */
+	uint32_t pages_per_child_block = format_info->page_size * format_info->block_size / address_size * format_info->block_size;
+	uint32_t num_pages = pages_per_child_block + format_info->block_size;
+
+	for (i = 0; i < num_pages; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	/* A file can not be made longer. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_EOF, tefs_truncate(files[0].file, num_pages, 1));
+
+	/* The file fits in a single child index block again. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_truncate(files[0].file, format_info->block_size + 1, 10));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, format_info->block_size + 1, files[0].file->eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 10, files[0].file->eof_byte);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 2, files[0].file->number_of_allocated_blocks);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_EOF, tefs_read(files[0].file, format_info->block_size + 1, buffer, 11, 0));
+
+	/* The size has been written out and the file can grow again. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, format_info->block_size + 1, files[0].file->eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 10, files[0].file->eof_byte);
+
+	data[0] = (uint8_t) (format_info->block_size + 1);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, format_info->block_size + 1, data + 10,
+													   format_info->page_size - 10, 10));
+
+	for (i = format_info->block_size + 2; i < num_pages; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	for (i = 0; i < num_pages; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, i, buffer, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) i, buffer[0]);
+
+		for (j = 1; j < format_info->page_size; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+		}
+	}
+
+	/* Truncating to an empty file keeps the first data block. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_truncate(files[0].file, 0, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, files[0].file->number_of_allocated_blocks);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, 0, data, 10, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, 0, buffer, 10, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[1], buffer[1]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	free(files[0].file);
+}
+
+void
+test_tefs_drop_head_of_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	uint32_t pages_per_child_block = format_info->page_size * format_info->block_size / address_size * format_info->block_size;
+	uint32_t num_pages = pages_per_child_block + format_info->block_size * 2;
+
+	for (i = 0; i < num_pages; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	/* Only whole blocks are released. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_drop_head(files[0].file, format_info->block_size * 2 + 1));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 2, files[0].file->first_block_number);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_RELEASED, tefs_read(files[0].file, 0, buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_RELEASED, tefs_read(files[0].file, format_info->block_size * 2 - 1,
+																			buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, format_info->block_size * 2, buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) (format_info->block_size * 2), buffer[0]);
+
+	/* Releasing the blocks of the first child index block releases it as
+	   well. The rest of the file is still there after it is opened again. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_drop_head(files[0].file, pages_per_child_block + format_info->block_size));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_RELEASED, tefs_read(files[0].file, 0, buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_RELEASED, tefs_read(files[0].file, pages_per_child_block,
+																			buffer, 1, 0));
+
+	for (i = pages_per_child_block + format_info->block_size; i < num_pages; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, i, buffer, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) i, buffer[0]);
+
+		for (j = 1; j < format_info->page_size; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+		}
+	}
+
+	/* The file is appended to as before. */
+	data[0] = (uint8_t) num_pages;
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, num_pages, data, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_drop_head(files[0].file, num_pages));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, num_pages, buffer, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) num_pages, buffer[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	/* The blocks that are left are released with the file. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_remove(files[0].name));
+
+	free(files[0].file);
+}
+
+void
+test_tefs_drop_all_and_reopen_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	uint32_t num_pages = format_info->block_size * 2;
+
+	for (i = 0; i < num_pages; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	/* Every block of the file is released. It is like an empty file that
+	   starts at the end of the dropped pages once it is opened again. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_drop_head(files[0].file, num_pages));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 2, files[0].file->first_block_number);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_RELEASED, tefs_read(files[0].file, num_pages - 1, buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_drop_head(files[0].file, num_pages));
+
+	data[0] = (uint8_t) num_pages;
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, num_pages, data, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, num_pages, buffer, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) num_pages, buffer[0]);
+
+	for (j = 1; j < format_info->page_size; j++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_remove(files[0].name));
+
+	/* The size that was written out can be in a block that was dropped
+	   afterwards if power is lost. The file is then empty from the block
+	   after the dropped ones. */
+	tefs_volume_t rebooted_volume;
+	memset(&rebooted_volume, 0, sizeof(tefs_volume_t));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	for (i = 0; i <= num_pages; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
+
+	for (i = num_pages + 1; i < num_pages + format_info->block_size; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_drop_head(files[0].file, num_pages + format_info->block_size));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(&rebooted_volume));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 3, files[0].file->first_block_number);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, num_pages + format_info->block_size, files[0].file->eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_PAGE_RELEASED, tefs_read(files[0].file, num_pages, buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_drop_head(files[0].file, num_pages + format_info->block_size));
+
+	data[0] = (uint8_t) (num_pages + format_info->block_size);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, num_pages + format_info->block_size, data,
+													   format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, num_pages + format_info->block_size, buffer,
+													  format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) (num_pages + format_info->block_size), buffer[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_select_volume(NULL));
+
+	free(files[0].file);
+}
+
+void
+test_tefs_write_child_block_to_single_file(
+    planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+    populate_data_array_1();
+
+    uint32_t pages_per_child_block = format_info->page_size * format_info->block_size / address_size * format_info->block_size;
+    uint32_t num_pages = (pages_per_child_block < format_info->num_pages) ? pages_per_child_block : format_info->num_pages; // TODO
+
+    for (i = 0; i < num_pages; i++)
+    {
+        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, device_read(get_block_address(5) + i, buffer, format_info->page_size, 0));
+
+        for (j = 0; j < format_info->page_size; j++)
+        {
+            PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+        }
+
+        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
+    }
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+    uint32_t size = 0;
+    device_read(get_block_address(3), &size, 4, TEFS_DIR_STATUS_SIZE);
+    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, num_pages, size);
+
+    size = 0;
+    device_read(get_block_address(3), &size, 2, TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE);
+    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, size);
+
+	if (check_state_section(tc, 0, 5 + num_pages / format_info->block_size))
+	{
+		PLANCK_UNIT_ASSERT_FALSE(tc);
+	}
+
+	free(files[0].file);
+}
+
+void
+test_tefs_write_multiple_child_blocks_to_single_file(
+    planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+    populate_data_array_1();
+
+    uint32_t pages_per_child_block = format_info->page_size * format_info->block_size / address_size * format_info->block_size;
+    uint32_t num_pages = (pages_per_child_block < format_info->num_pages) ? pages_per_child_block : format_info->num_pages; // TODO
+
+    for (i = 0; i < num_pages; i++)
+    {
+        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, device_read(get_block_address(5) + i, buffer, format_info->page_size, 0));
+
+        for (j = 0; j < format_info->page_size; j++)
+        {
+            PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+        }
+
+        PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
+    }
+
+	for (i = num_pages; i < num_pages * 2; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, device_read(get_block_address(5) + i + format_info->block_size * 2, buffer, format_info->page_size, 0));
+
+		for (j = 0; j < format_info->page_size; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], buffer[j]);
+		}
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_flush(files[0].file));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+    uint32_t size = 0;
+    device_read(get_block_address(3), &size, 4, TEFS_DIR_STATUS_SIZE);
+    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, num_pages * 2, size);
+
+    size = 0;
+    device_read(get_block_address(3), &size, 2, TEFS_DIR_STATUS_SIZE + TEFS_DIR_EOF_PAGE_SIZE);
+    PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, size);
+
+	if (check_state_section(tc, 0, 5 + num_pages * 2 / format_info->block_size + 2))
+	{
+		PLANCK_UNIT_ASSERT_FALSE(tc);
+	}
+
+	free(files[0].file);
+}
+
+void
+test_tefs_read_after_write_to_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
 	{
 		printf("%s\n", memory_error);
 		exit(-1);
@@ -1061,6 +2651,153 @@ test_tefs_read_after_write_to_single_file(
 	free(files[0].file);
 }
 
+void
+test_tefs_read_pages_from_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	/* Read up to four pages at once. */
+	uint8_t *pages_buffer = malloc(format_info->page_size * 4);
+
+	if (files[0].file == NULL || pages_buffer == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	uint32_t num_pages = format_info->block_size * 2 + 2;
+
+	for (i = 0; i < num_pages; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	/* Read every run of up to four pages, including the ones that cross data
+	   blocks, and compare them with the pages that were written. */
+	uint32_t first_page;
+	for (first_page = 0; first_page < num_pages; first_page++)
+	{
+		uint32_t num_pages_to_read = (num_pages - first_page < 4) ? num_pages - first_page : 4;
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_pages(files[0].file, first_page, num_pages_to_read, pages_buffer));
+
+		for (i = 0; i < num_pages_to_read; i++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) (first_page + i), pages_buffer[i * format_info->page_size]);
+
+			for (j = 1; j < format_info->page_size; j++)
+			{
+				PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], pages_buffer[i * format_info->page_size + j]);
+			}
+		}
+	}
+
+	/* Reading past the last whole page is an error. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_EOF, tefs_read_pages(files[0].file, num_pages - 1, 2, pages_buffer));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	free(pages_buffer);
+	free(files[0].file);
+}
+
+#if defined(TEFS_EXTENT_SUPPORT)
+void
+test_tefs_read_pages_from_extent_of_single_file(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	uint32_t num_pages = format_info->block_size * 3;
+	uint8_t *pages_buffer = malloc(format_info->page_size * num_pages);
+
+	if (files[0].file == NULL || pages_buffer == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	/* The blocks of a file on a fresh device are contiguous. */
+	for (i = 0; i < num_pages; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, i, data, format_info->page_size, 0));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 3, files[0].file->extent_length);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	/* The extent is found from the index when the file is read again (a file
+	   that is reopened from the open cache still has it). */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 3, files[0].file->extent_length);
+#else
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1, files[0].file->extent_length);
+#endif
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_pages(files[0].file, 0, num_pages, pages_buffer));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 3, files[0].file->extent_length);
+
+	for (i = 0; i < num_pages; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) i, pages_buffer[i * format_info->page_size]);
+
+		for (j = 1; j < format_info->page_size; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[j], pages_buffer[i * format_info->page_size + j]);
+		}
+	}
+
+	/* Pages are still appended after a read of the extent. */
+	data[0] = (uint8_t) num_pages;
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, num_pages, data, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, num_pages, buffer, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) num_pages, buffer[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	/* Reading the same pages across two blocks again leaves the last page in
+	   the current data block, so it is read and overwritten in its own
+	   block. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_pages(files[0].file, format_info->block_size - 1, 2, pages_buffer));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_pages(files[0].file, format_info->block_size - 1, 2, pages_buffer));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) format_info->block_size, pages_buffer[format_info->page_size]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, format_info->block_size, buffer,
+													  format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) format_info->block_size, buffer[0]);
+
+	data[0] = (uint8_t) (num_pages + 1);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, format_info->block_size, data,
+													   format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, 0, buffer, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, buffer[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, format_info->block_size, buffer,
+													  format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) (num_pages + 1), buffer[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	free(pages_buffer);
+	free(files[0].file);
+}
+#endif
+
 void
 test_tefs_read_after_write_to_multiple_files_one_at_a_time(
 	planck_unit_test_t *tc
@@ -1378,49 +3115,80 @@ test_tefs_hash_collision(
 //	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_DELETED, address);
 //}
 
-//#if defined(TEFS_CONTINUOUS_SUPPORT)
-//void test_tefs_sequential_read_and_write(
-//	planck_unit_test_t *tc
-//)
-//{
-//	file_t file;
-//	format_device();
-//	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(&file, "test.aaa"));
-//
-//	populate_data_array_1();
-//
-//	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write_continuous_start(&file, 0));
-//
-//	uint8_t buffer[27];
-//	uint16_t i;
-//
-//	/* Write and read multiple pages */
-//	for (i = 0; i < 16385 * 2; i++)
-//	{
-//		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write_continuous(&file, data, 512, 0));
-//		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write_continuous_next(&file));
-//	}
-//
-//	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write_continuous_stop(&file));
-//
-//	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_continuous_start(&file, 0));
-//
-//	for (i = 0; i < 16385 * 2; i++)
-//	{
-//		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_continuous(&file, buffer, 27, 2));
-//
-//		uint8_t j;
-//		for (j = 0; j < 27; j++)
-//		{
-//			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[2 + j], buffer[j]);
-//		}
-//
-//		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_continuous_next(&file));
-//	}
-//
-//	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_continuous_stop(&file));
-//}
-//#endif
+#if defined(TEFS_CONTINUOUS_SUPPORT)
+void
+test_tefs_sequential_read_and_write(
+	planck_unit_test_t *tc
+)
+{
+	files[0].file = malloc(sizeof(file_t));
+
+	if (files[0].file == NULL)
+	{
+		printf("%s\n", memory_error);
+		exit(-1);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, format_device());
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+
+	populate_data_array_1();
+
+	uint8_t buffer[27];
+	uint32_t num_pages = format_info->block_size * 2 + 2;
+
+	/* Write multiple data blocks in one sequence. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write_continuous_start(files[0].file, 0));
+
+	for (i = 0; i < num_pages; i++)
+	{
+		data[0] = (uint8_t) i;
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write_continuous(files[0].file, data, format_info->page_size, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write_continuous_next(files[0].file));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_WRITE_PAST_END, tefs_write_continuous_next(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write_continuous_stop(files[0].file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	/* The file size is kept after the file is reopened. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_open(files[0].file, files[0].name));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, num_pages, files[0].file->eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, files[0].file->eof_byte);
+
+	for (i = 0; i < num_pages; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, i, buffer, 1, 0));
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) i, buffer[0]);
+	}
+
+	/* Read the pages back in one sequence. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_continuous_start(files[0].file, 0));
+
+	for (i = 0; i < num_pages; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_continuous(files[0].file, buffer, 27, 2));
+
+		for (j = 0; j < 27; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[2 + j], buffer[j]);
+		}
+
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_continuous_next(files[0].file));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, TEFS_ERR_EOF, tefs_read_continuous(files[0].file, buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read_continuous_stop(files[0].file));
+
+	/* Pages can still be appended one at a time after a sequence. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_write(files[0].file, num_pages, data, format_info->page_size, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_read(files[0].file, num_pages - 1, buffer, 1, 0));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, (uint8_t) (num_pages - 1), buffer[0]);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, tefs_close(files[0].file));
+
+	free(files[0].file);
+}
+#endif
 
 planck_unit_suite_t*
 tefs_getsuite(
@@ -1438,6 +3206,10 @@ tefs_getsuite(
 	planck_unit_add_to_suite(suite, test_tefs_remove_empty_single_file);
 	planck_unit_add_to_suite(suite, test_tefs_remove_small_single_file);
 	planck_unit_add_to_suite(suite, test_tefs_remove_large_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_remove_block_sized_single_file);
+#if defined(TEFS_LAZY_FREE_QUEUE_SIZE)
+	planck_unit_add_to_suite(suite, test_tefs_remove_lazily);
+#endif
 
 	planck_unit_add_to_suite(suite, test_tefs_remove_multiple_empty_files_consecutively);
 	planck_unit_add_to_suite(suite, test_tefs_remove_multiple_files_with_data_consecutively);
@@ -1445,12 +3217,59 @@ tefs_getsuite(
 	planck_unit_add_to_suite(suite, test_tefs_remove_multiple_files_with_data_staggered);
 
 	planck_unit_add_to_suite(suite, test_tefs_exists_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_exists_multiple_files);
+	planck_unit_add_to_suite(suite, test_tefs_readdir_multiple_files);
+	planck_unit_add_to_suite(suite, test_tefs_compact_directory);
 	planck_unit_add_to_suite(suite, test_tefs_write_page_to_single_file);
 	planck_unit_add_to_suite(suite, test_tefs_write_data_block_to_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_write_after_reopen_to_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_append_to_page_after_read_in_other_block);
+#if defined(TEFS_OPEN_CACHE_SIZE)
+	planck_unit_add_to_suite(suite, test_tefs_reopen_from_open_cache);
+#endif
+#if defined(TEFS_INDEX_CACHE_SIZE)
+	planck_unit_add_to_suite(suite, test_tefs_write_index_cache_to_single_file);
+#endif
+#if defined(USE_SD) && defined(TEFS_PAGE_CACHE_SIZE)
+	planck_unit_add_to_suite(suite, test_tefs_write_through_page_cache_to_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_map_pages_of_single_file);
+#endif
+	planck_unit_add_to_suite(suite, test_tefs_select_volume);
+	planck_unit_add_to_suite(suite, test_tefs_mount_after_reboot);
+#if defined(TEFS_DEVICE_BACKEND)
+	planck_unit_add_to_suite(suite, test_tefs_page_size_of_device_backend);
+#endif
+#if defined(USE_SD)
+	planck_unit_add_to_suite(suite, test_tefs_statfs_after_reboot);
+#endif
+#if defined(USE_SD)
+	planck_unit_add_to_suite(suite, test_tefs_create_file_on_full_device);
+#endif
+#if defined(TEFS_STATS)
+	planck_unit_add_to_suite(suite, test_tefs_stats_of_single_file);
+#endif
+#if defined(USE_SD)
+	planck_unit_add_to_suite(suite, test_tefs_allocation_policies);
+#endif
+#if defined(TEFS_THREAD_SAFE)
+	planck_unit_add_to_suite(suite, test_tefs_write_files_from_threads);
+#endif
+#if defined(TEFS_ASYNC_QUEUE_SIZE)
+	planck_unit_add_to_suite(suite, test_tefs_write_async_to_single_file);
+#endif
+	planck_unit_add_to_suite(suite, test_tefs_fallocate_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_consistency_policy_of_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_truncate_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_drop_head_of_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_drop_all_and_reopen_single_file);
 	planck_unit_add_to_suite(suite, test_tefs_write_child_block_to_single_file);
 	planck_unit_add_to_suite(suite, test_tefs_write_multiple_child_blocks_to_single_file);
 
 	planck_unit_add_to_suite(suite, test_tefs_read_after_write_to_single_file);
+	planck_unit_add_to_suite(suite, test_tefs_read_pages_from_single_file);
+#if defined(TEFS_EXTENT_SUPPORT)
+	planck_unit_add_to_suite(suite, test_tefs_read_pages_from_extent_of_single_file);
+#endif
 	planck_unit_add_to_suite(suite, test_tefs_read_after_write_to_multiple_files_one_at_a_time);
 	planck_unit_add_to_suite(suite, test_tefs_read_after_write_to_multiple_files_staggered);
 //	planck_unit_add_to_suite(suite, test_tefs_write_to_multiple_files_one_at_a_time);//
@@ -1460,7 +3279,7 @@ tefs_getsuite(
 //	planck_unit_add_to_suite(suite, test_tefs_release_block);~
 
 #if defined(USE_SD) && defined(TEFS_CONTINUOUS_SUPPORT)
-	//planck_unit_add_to_suite(suite, test_tefs_sequential_read_and_write);//
+	planck_unit_add_to_suite(suite, test_tefs_sequential_read_and_write);
 #endif
 
 	/* Tests to check if errors are correctly returned. */
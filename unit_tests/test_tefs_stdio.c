@@ -163,6 +163,94 @@ test_tefs_stdio_write_past_block_boundary(
 	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 512, size);
 }
 
+void
+test_tefs_stdio_write_records_buffered(
+	planck_unit_test_t *tc
+)
+{
+	format_device();
+	T_FILE *file = t_fopen("test.aaa", "w+");
+	PLANCK_UNIT_ASSERT_TRUE(tc, file != NULL);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, t_setvbuf(file, NULL, _IOFBF, 0));
+
+	populate_data_array_1();
+
+	/* Write 12 byte records that cross page boundaries. */
+	uint32_t i;
+	for (i = 0; i < 100; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 12, t_fwrite(data + (i % 14), 12, 1, file));
+	}
+
+	/* Only the whole pages have been written to the file so far. */
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 2, file->f.eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, file->f.eof_byte);
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, t_fflush(file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 2, file->f.eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1200 - 1024, file->f.eof_byte);
+
+	/* Read the records back with a buffer that is supplied. */
+	char page_buffer[512];
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, t_setvbuf(file, page_buffer, _IOFBF, sizeof(page_buffer)));
+	t_rewind(file);
+
+	uint8_t record[12];
+	for (i = 0; i < 100; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 12, t_fread(record, 12, 1, file));
+
+		uint8_t j;
+		for (j = 0; j < 12; j++)
+		{
+			PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[(i % 14) + j], record[j]);
+		}
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, t_fread(record, 12, 1, file));
+	PLANCK_UNIT_ASSERT_TRUE(tc, t_feof(file));
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, t_fclose(file));
+}
+
+/* A device backend is only formatted with its own page size. */
+#if !defined(TEFS_DEVICE_BACKEND)
+void
+test_tefs_stdio_write_and_seek_with_small_pages(
+	planck_unit_test_t *tc
+)
+{
+	/* The file position is kept in terms of the formatted page size. */
+	tefs_format_device(62500, 256, block_size, hash_size, meta_data_size, max_file_name_size, 1);
+	T_FILE *file = t_fopen("test.aaa", "w+");
+	PLANCK_UNIT_ASSERT_TRUE(tc, file != NULL);
+
+	populate_data_array_1();
+
+	uint32_t i;
+	for (i = 0; i < 4; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 300, t_fwrite(data + i, 300, 1, file));
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1200, t_ftell(file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 4, file->f.eof_page);
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 1200 - 1024, file->f.eof_byte);
+
+	uint8_t buffer[300];
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, t_fseek(file, 600, SEEK_SET));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 300, t_fread(buffer, 300, 1, file));
+
+	for (i = 0; i < 300; i++)
+	{
+		PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, data[i + 2], buffer[i]);
+	}
+
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 900, t_ftell(file));
+	PLANCK_UNIT_ASSERT_INT_ARE_EQUAL(tc, 0, t_fclose(file));
+}
+#endif
+
 planck_unit_suite_t*
 tefs_stdio_getsuite(
 	void
@@ -172,6 +260,10 @@ tefs_stdio_getsuite(
 
 	planck_unit_add_to_suite(suite, test_tefs_stdio_write_pages);
 	planck_unit_add_to_suite(suite, test_tefs_stdio_write_past_block_boundary);
+	planck_unit_add_to_suite(suite, test_tefs_stdio_write_records_buffered);
+#if !defined(TEFS_DEVICE_BACKEND)
+	planck_unit_add_to_suite(suite, test_tefs_stdio_write_and_seek_with_small_pages);
+#endif
 
 	return suite;
 }